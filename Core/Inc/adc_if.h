@@ -36,6 +36,18 @@ extern "C" {
 /* Exported types ------------------------------------------------------------*/
 /* USER CODE BEGIN ET */
 
+/**
+  * @brief One scan of VREFINT, the battery divider (ADC_IN3) and the temperature sensor
+  */
+typedef struct
+{
+  uint32_t timestamp;    /* UTIL_TIMER_GetCurrentTime() of the scan (ms) */
+  uint16_t vdda_mv;      /* from VREFINT, reference of the other two channels */
+  uint16_t battery_mv;   /* battery voltage, rebuilt from the divider */
+  int16_t temperature;   /* degree Celsius (q7.8) */
+  bool valid;            /* false if the scan failed: the values are 0 */
+} SYS_Measurement_t;
+
 /* USER CODE END ET */
 
 /* Exported constants --------------------------------------------------------*/
@@ -83,6 +95,12 @@ extern "C" {
   */
 #define VDD_MIN                     3000
 
+/**
+  * @brief Age (ms) after which SYS_GetMeasurement() scans again. SendTxData() scans once
+  *        per report, and the MAC answers DevStatusReq with that same scan.
+  */
+#define SYS_MEASUREMENT_MAX_AGE     60000U
+
 /* USER CODE END EC */
 
 /* External variables --------------------------------------------------------*/
@@ -121,6 +139,17 @@ uint16_t SYS_GetBatteryLevel(void);
 
 /* USER CODE BEGIN EFP */
 
+/**
+  * @brief Scan the ADC channels now and cache the result
+  */
+void SYS_UpdateMeasurement(void);
+
+/**
+  * @brief  Last scan, done again if older than SYS_MEASUREMENT_MAX_AGE
+  * @param  measurement output
+  */
+void SYS_GetMeasurement(SYS_Measurement_t *measurement);
+
 /* USER CODE END EFP */
 
 #ifdef __cplusplus
@@ -116,6 +116,15 @@ FLASH_IF_StatusTypedef FLASH_IF_Read(void *pDestination, const void *pSource, ui
 FLASH_IF_StatusTypedef FLASH_IF_Erase(void *pStart, uint32_t uLength);
 
 /* USER CODE BEGIN EFP */
+/**
+  * @brief  Program already erased flash, without the page backup/erase of FLASH_IF_Write
+  * @note   Each 64-bit word can be programmed once per erase: for append-only storage.
+  * @param  pDestination flash address, 64-bit aligned
+  * @param  pSource data
+  * @param  uLength number of bytes, multiple of 8
+  * @return FLASH_IF_StatusTypedef status
+  */
+FLASH_IF_StatusTypedef FLASH_IF_Program(void *pDestination, const void *pSource, uint32_t uLength);
 
 /* USER CODE END EFP */
 
@@ -81,7 +81,7 @@ extern "C" {
   * @brief Disable Low Power mode
   * @note  0: LowPowerMode enabled. MCU enters stop2 mode, 1: LowPowerMode disabled. MCU enters sleep mode only
   */
-#define LOW_POWER_DISABLE                    1
+#define LOW_POWER_DISABLE                    0
 
 /* USER CODE BEGIN EC */
 
@@ -32,12 +32,48 @@ extern "C" {
 
 /* Includes ------------------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
-
+#include "meter_link.h"
 /* USER CODE END Includes */
 
 /* Exported types ------------------------------------------------------------*/
 /* USER CODE BEGIN ET */
+/**
+  * @brief Deepest low power mode the meter port allows
+  */
+typedef enum
+{
+  METER_LP_SLEEP,  /* bytes in flight: USART1 DMA needs the bus clock */
+  METER_LP_STOP1,  /* reception armed: USART1 wakes the MCU on a start bit (Stop0/Stop1 only) */
+  METER_LP_STOP2,  /* port idle */
+} MeterLowPower_t;
+
+/**
+  * @brief Line quality counters of the meter port (since boot)
+  */
+typedef struct
+{
+  uint32_t good_frames;     /* frames ended without error */
+  uint32_t corrupt_frames;  /* BCC/CRC mismatch or aborted on a line error */
+  uint32_t aborted_frames;  /* frames ended early by a line error or a gap */
+  uint32_t parity_errors;
+  uint32_t framing_errors;
+  uint32_t noise_errors;
+  uint32_t overrun_errors;
+  uint32_t gap_timeouts;    /* inter-character gap > METER_GAP_TIMEOUT_CHARS */
+  uint32_t decode_bytes;       /* bytes fed to the decoder and the BCC/CRC check */
+  uint64_t decode_cycles;      /* CPU cycles spent on them (METER_DECODE_PROFILE) */
+  uint32_t last_frame_cycles;  /* CPU cycles of the last complete frame */
+} MeterLineStats_t;
 
+/**
+  * @brief Timing of the current (or last) meter read, UTIL_TIMER ticks (ms)
+  */
+typedef struct
+{
+  uint32_t start;       /* MeterUart_StartReceive() */
+  uint32_t first_byte;  /* first byte received, 0 while none */
+  uint32_t end;         /* frame complete, 0 while in progress */
+} MeterReadTiming_t;
 /* USER CODE END ET */
 
 /* Exported constants --------------------------------------------------------*/
@@ -47,11 +83,19 @@ extern "C" {
 
 /* External variables --------------------------------------------------------*/
 /* USER CODE BEGIN EV */
-#define UART_BUFFER_SIZE 512
-extern char  uart_rx_char;
-extern char  uart_rx_buffer[UART_BUFFER_SIZE];
-extern volatile uint16_t uart_rx_index;
-extern volatile uint8_t uart_rx_complete;
+/* Circular DMA ring for USART1 (meter). HT/TC/IDLE events drain it into uart_rx_buffer */
+#define METER_RX_DMA_BUFFER_SIZE 256
+/* Longest silence inside a frame, in characters (USART receiver timeout): a frame that
+   stops longer than this, or any parity/framing/noise error, fails at once */
+#define METER_GAP_TIMEOUT_CHARS 10U
+/* 1: copy every complete meter frame to the trace port (LPUART1) without blocking.
+   0: removes the mirror code entirely */
+#define METER_FRAME_MIRROR 1
+/* Shortest time between two mirrored frames (ms); frames in between are skipped */
+#define METER_MIRROR_MIN_INTERVAL 10000U
+/* 1: count the CPU cycles spent decoding and checking meter frames (DWT cycle counter)
+   in MeterLineStats_t. 0: no counting */
+#define METER_DECODE_PROFILE 1
 extern volatile uint8_t meter_data_ready;
 extern UART_HandleTypeDef huart1;
 
@@ -115,7 +159,92 @@ void vcom_DMA_TX_IRQHandler(void);
 void vcom_Resume(void);
 
 /* USER CODE BEGIN EFP */
+/**
+  * @brief  Create the meter session resources (identification timer). Call once at init.
+  */
+void MeterUart_Init(void);
 
+/**
+  * @brief  Let a start bit on USART1 wake the MCU from Stop1 (HSI16 kernel clock, EXTI line 26).
+  *         Call after MX_USART1_UART_Init().
+  */
+void MeterUart_EnableWakeup(void);
+
+/**
+  * @brief  Restore USART1 and its DMA channels after Stop2 (not retained). Called by the LPM.
+  */
+void MeterUart_Resume(void);
+
+/**
+  * @brief  Deepest low power mode usable now without losing meter bytes.
+  * @note   Called by the LPM with interrupts masked.
+  * @retval @ref MeterLowPower_t
+  */
+MeterLowPower_t MeterUart_GetLowPowerMode(void);
+
+/**
+  * @brief  Start meter (USART1) reception in circular DMA mode with idle-line detection.
+  * @note   Clears uart_rx_buffer/uart_rx_index/uart_rx_complete. The CPU is only
+  *         interrupted on DMA half/full transfer and on line idle, not per byte.
+  *         With METER_IEC_MODE_C the readout is requested with a mode C session.
+  */
+void MeterUart_StartReceive(void);
+
+/**
+  * @brief  Keep meter (USART1) reception armed between reads for the frames a push-only
+  *         meter sends on its own (passive, METER_PUSH_BAUD, no mode C session).
+  * @note   Clears uart_rx_buffer/uart_rx_index/uart_rx_complete. While it is armed the
+  *         port allows Stop1 at most (see MeterUart_GetLowPowerMode()).
+  */
+void MeterUart_StartCapture(void);
+
+/**
+  * @brief  Stop meter (USART1) reception and the associated DMA channel.
+  * @note   Also acknowledges the frame (clears uart_rx_complete).
+  */
+void MeterUart_StopReceive(void);
+
+/**
+  * @brief  Line quality counters of the meter port.
+  * @retval pointer to the counters
+  */
+const MeterLineStats_t *MeterUart_GetLineStats(void);
+
+/**
+  * @brief  Integrity of the frame, valid once uart_rx_complete is set.
+  * @retval @ref MeterFrameCheck_t
+  */
+MeterFrameCheck_t MeterUart_GetFrameCheck(void);
+
+/**
+  * @brief  How the frame being received (or last received) is acquired.
+  * @retval @ref MeterReadMode_t
+  */
+MeterReadMode_t MeterUart_GetReadMode(void);
+
+/**
+  * @brief  The meter only pushes frames: no mode C, or no identification ever received.
+  */
+bool MeterUart_PushOnly(void);
+
+/**
+  * @brief  Timing of the read, complete once uart_rx_complete is set.
+  * @note   The first byte time is estimated from the first DMA event and the
+  *         number of characters it carried at the current baud rate.
+  * @retval pointer to the timing
+  */
+const MeterReadTiming_t *MeterUart_GetReadTiming(void);
+
+#if (METER_FRAME_MIRROR == 1)
+/**
+  * @brief  Queue the frame in uart_rx_buffer to the trace port (LPUART1, DMA).
+  * @note   Written straight into the trace FIFO (UTIL_ADV_TRACE_ZCSend_Allocation):
+  *         returns at once. The frame is skipped if it comes less than
+  *         METER_MIRROR_MIN_INTERVAL after the last one mirrored, or if the FIFO
+  *         has no room for it.
+  */
+void MeterUart_MirrorFrame(void);
+#endif /* METER_FRAME_MIRROR == 1 */
 /* USER CODE END EFP */
 
 #ifdef __cplusplus
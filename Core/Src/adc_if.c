@@ -23,6 +23,7 @@
 #include "sys_app.h"
 
 /* USER CODE BEGIN Includes */
+#include "stm32_timer.h"
 
 /* USER CODE END Includes */
 
@@ -45,6 +46,14 @@ extern ADC_HandleTypeDef hadc;
 #define TEMPSENSOR_TYP_AVGSLOPE        (( int32_t) 2500)        /*!< Internal temperature sensor, parameter Avg_Slope (unit: uV/DegCelsius). Refer to device datasheet for min/typ/max values. */
 
 /* USER CODE BEGIN PD */
+/* Channels of the scan, in sequence order */
+#define SCAN_VREFINT       0U
+#define SCAN_BATTERY       1U
+#define SCAN_TEMPERATURE   2U
+#define SCAN_CHANNELS      3U
+
+/* Per conversion: 16 x (160.5 + 12.5) ADC cycles, 0.7 ms at 16 MHz / 4 */
+#define SCAN_TIMEOUT       10U
 
 /* USER CODE END PD */
 
@@ -56,6 +65,16 @@ extern ADC_HandleTypeDef hadc;
 /* Private variables ---------------------------------------------------------*/
 
 /* USER CODE BEGIN PV */
+static const uint32_t scan_channel[SCAN_CHANNELS] =
+{
+  ADC_CHANNEL_VREFINT, ADC_CHANNEL_3, ADC_CHANNEL_TEMPSENSOR
+};
+static const uint32_t scan_rank[SCAN_CHANNELS] =
+{
+  ADC_REGULAR_RANK_1, ADC_REGULAR_RANK_2, ADC_REGULAR_RANK_3
+};
+
+static SYS_Measurement_t measurement = {0};
 
 /* USER CODE END PV */
 
@@ -68,11 +87,35 @@ extern ADC_HandleTypeDef hadc;
 static uint32_t ADC_ReadChannels(uint32_t channel);
 
 /* USER CODE BEGIN PFP */
+/**
+  * @brief  Convert every channel of the scan in one ADC enable and calibration
+  * @param  levels output, SCAN_CHANNELS levels (12 bits)
+  * @retval false if a conversion did not end
+  */
+static bool ADC_ReadSequence(uint32_t *levels);
+
+/**
+  * @brief  Scan and convert the levels into the cached measurement
+  */
+static void ADC_Measure(void);
 
 /* USER CODE END PFP */
 
 /* Exported functions --------------------------------------------------------*/
 /* USER CODE BEGIN EF */
+void SYS_UpdateMeasurement(void)
+{
+  ADC_Measure();
+}
+
+void SYS_GetMeasurement(SYS_Measurement_t *result)
+{
+  if (!measurement.valid || UTIL_TIMER_GetElapsedTime(measurement.timestamp) > SYS_MEASUREMENT_MAX_AGE)
+  {
+    ADC_Measure();
+  }
+  *result = measurement;
+}
 
 /* USER CODE END EF */
 
@@ -84,10 +127,13 @@ void SYS_InitMeasurement(void)
   hadc.Instance = ADC;
   /* USER CODE BEGIN SYS_InitMeasurement_2 */
   
-  /* Perform dummy reads after first calibration to stabilize ADC.
+  /* Perform a dummy scan after first calibration to stabilize ADC.
      The first ADC reading after reset can return incorrect values. */
-  (void)SYS_GetBatteryLevel();
-  (void)SYS_GetBatteryLevel();
+  {
+    uint32_t levels[SCAN_CHANNELS];
+
+    (void)ADC_ReadSequence(levels);
+  }
   
   /* USER CODE END SYS_InitMeasurement_2 */
 }
@@ -102,6 +148,11 @@ void SYS_DeInitMeasurement(void)
 int16_t SYS_GetTemperatureLevel(void)
 {
   /* USER CODE BEGIN SYS_GetTemperatureLevel_1 */
+  SYS_Measurement_t scan;
+
+  /* Converted with VDDA (VREFINT of the same scan), not with the battery voltage */
+  SYS_GetMeasurement(&scan);
+  return scan.temperature;
 
   /* USER CODE END SYS_GetTemperatureLevel_1 */
   __IO int16_t temperatureDegreeC = 0;
@@ -144,56 +195,10 @@ int16_t SYS_GetTemperatureLevel(void)
 uint16_t SYS_GetBatteryLevel(void)
 {
   /* USER CODE BEGIN SYS_GetBatteryLevel_1 */
+  SYS_Measurement_t scan;
 
-  uint16_t userbatteryLevelmV = 0;
-  uint32_t measVref = 0;
-  uint32_t vdd_mV = 0;
-  uint32_t raw_pin = 0;
-  uint32_t pin_mV = 0;
-
-  /* Measure internal VREFINT to compute Vdd (in mV) */
-  measVref = ADC_ReadChannels(ADC_CHANNEL_VREFINT);
-
-  if (measVref == 0)
-  {
-    return 0; /* no measurement available */
-  }
-
-  if ((uint32_t)*VREFINT_CAL_ADDR != (uint32_t)0xFFFFU)
-  {
-    /* Device with Reference voltage calibrated in production: use device optimized parameters */
-    vdd_mV = __LL_ADC_CALC_VREFANALOG_VOLTAGE(measVref, ADC_RESOLUTION_12B);
-  }
-  else
-  {
-    /* Device with Reference voltage not calibrated in production: use generic parameters */
-    vdd_mV = (VREFINT_CAL_VREF * 1510) / measVref;
-  }
-
-  /* Read the external battery sense pin on ADC_IN3 (PB4) */
-  raw_pin = ADC_ReadChannels(ADC_CHANNEL_3);
-
-  if (raw_pin == 0)
-  {
-    pin_mV = 0;
-  }
-  else
-  {
-    /* Convert ADC counts to mV using measured Vdd. ADC resolution is 12-bit (0..4095) */
-    pin_mV = (raw_pin * vdd_mV) / 4095U;
-  }
-
-  /* The hardware uses a resistor divider so that the ADC sees ~0.28 * Vbattery.
-     To reconstruct the real battery voltage (mV) we multiply by the inverse (4.03 ~= 403/100).
-     Use integer math to avoid floats. */
-  userbatteryLevelmV = (uint16_t)((pin_mV * 403U) / 100U);
-
-  /* Debug: print ADC internals to help diagnose first-uplink anomalies */
-  /* Note: use %u and cast to unsigned int to avoid unsupported long specifiers */
-  APP_LOG(TS_ON, VLEVEL_M, "DEBUG: SYS_GetBatteryLevel: measVref=%u vdd_mV=%u raw_pin=%u pin_mV=%u batt_mV=%u\r\n",
-    (unsigned int)measVref, (unsigned int)vdd_mV, (unsigned int)raw_pin, (unsigned int)pin_mV, (unsigned int)userbatteryLevelmV);
-
-  return userbatteryLevelmV;
+  SYS_GetMeasurement(&scan);
+  return scan.battery_mv; /* 0: no measurement available */
 
   /* USER CODE END SYS_GetBatteryLevel_1 */
   uint16_t batteryLevelmV = 0;
@@ -230,6 +235,132 @@ uint16_t SYS_GetBatteryLevel(void)
 
 /* Private Functions Definition -----------------------------------------------*/
 /* USER CODE BEGIN PrFD */
+static bool ADC_ReadSequence(uint32_t *levels)
+{
+  ADC_ChannelConfTypeDef sConfig = {0};
+  bool done = true;
+
+  MX_ADC_Init();
+
+  /* CubeMX settings with the whole sequence in one start, and 16 samples averaged
+     by the oversampler back to 12 bits */
+  hadc.Init.ScanConvMode = ADC_SCAN_ENABLE;
+  hadc.Init.NbrOfConversion = SCAN_CHANNELS;
+  hadc.Init.EOCSelection = ADC_EOC_SINGLE_CONV;
+  hadc.Init.LowPowerAutoWait = ENABLE;  /* each conversion waits until the previous one is read */
+  hadc.Init.OversamplingMode = ENABLE;
+  hadc.Init.Oversampling.Ratio = ADC_OVERSAMPLING_RATIO_16;
+  hadc.Init.Oversampling.RightBitShift = ADC_RIGHTBITSHIFT_4;
+  hadc.Init.Oversampling.TriggeredMode = ADC_TRIGGEREDMODE_SINGLE_TRIGGER;
+  if (HAL_ADC_Init(&hadc) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  /* Start Calibration */
+  if (HAL_ADCEx_Calibration_Start(&hadc) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  /* Configure the sequence */
+  sConfig.SamplingTime = ADC_SAMPLINGTIME_COMMON_1;
+  for (uint8_t i = 0; i < SCAN_CHANNELS; i++)
+  {
+    sConfig.Channel = scan_channel[i];
+    sConfig.Rank = scan_rank[i];
+    if (HAL_ADC_ConfigChannel(&hadc, &sConfig) != HAL_OK)
+    {
+      Error_Handler();
+    }
+  }
+
+  if (HAL_ADC_Start(&hadc) != HAL_OK)
+  {
+    /* Start Error */
+    Error_Handler();
+  }
+  for (uint8_t i = 0; i < SCAN_CHANNELS; i++)
+  {
+    if (HAL_ADC_PollForConversion(&hadc, SCAN_TIMEOUT) != HAL_OK)
+    {
+      done = false;
+      break;
+    }
+    levels[i] = HAL_ADC_GetValue(&hadc);
+  }
+
+  HAL_ADC_Stop(&hadc);   /* it calls also ADC_Disable() */
+  HAL_ADC_DeInit(&hadc);
+
+  return done;
+}
+
+static void ADC_Measure(void)
+{
+  uint32_t levels[SCAN_CHANNELS];
+  uint32_t vdda_mV = 0;
+  uint32_t pin_mV = 0;
+  int32_t temperature = 0;
+
+  measurement.timestamp = UTIL_TIMER_GetCurrentTime();
+  measurement.valid = ADC_ReadSequence(levels) && (levels[SCAN_VREFINT] != 0U);
+  if (!measurement.valid)
+  {
+    measurement.vdda_mv = 0;
+    measurement.battery_mv = 0;
+    measurement.temperature = 0;
+    APP_LOG(TS_ON, VLEVEL_M, "ADC: medicion fallida\r\n");
+    return;
+  }
+
+  if ((uint32_t)*VREFINT_CAL_ADDR != (uint32_t)0xFFFFU)
+  {
+    /* Device with Reference voltage calibrated in production: use device optimized parameters */
+    vdda_mV = __LL_ADC_CALC_VREFANALOG_VOLTAGE(levels[SCAN_VREFINT], ADC_RESOLUTION_12B);
+  }
+  else
+  {
+    /* Device with Reference voltage not calibrated in production: use generic parameters */
+    vdda_mV = (VREFINT_CAL_VREF * 1510) / levels[SCAN_VREFINT];
+  }
+
+  /* Battery sense pin on ADC_IN3 (PB4), in mV of VDDA. ADC resolution is 12-bit (0..4095) */
+  pin_mV = (levels[SCAN_BATTERY] * vdda_mV) / 4095U;
+
+  /* The hardware uses a resistor divider so that the ADC sees ~0.28 * Vbattery.
+     To reconstruct the real battery voltage (mV) we multiply by the inverse (4.03 ~= 403/100).
+     Use integer math to avoid floats. */
+  measurement.battery_mv = (uint16_t)((pin_mV * 403U) / 100U);
+  measurement.vdda_mv = (uint16_t)vdda_mV;
+
+  /* check whether device has temperature sensor calibrated in production */
+  if (((int32_t)*TEMPSENSOR_CAL2_ADDR - (int32_t)*TEMPSENSOR_CAL1_ADDR) != 0)
+  {
+    /* Device with temperature sensor calibrated in production:
+       use device optimized parameters */
+    temperature = __LL_ADC_CALC_TEMPERATURE(vdda_mV, levels[SCAN_TEMPERATURE], LL_ADC_RESOLUTION_12B);
+  }
+  else
+  {
+    /* Device with temperature sensor not calibrated in production:
+       use generic parameters */
+    temperature = __LL_ADC_CALC_TEMPERATURE_TYP_PARAMS(TEMPSENSOR_TYP_AVGSLOPE,
+                                                       TEMPSENSOR_TYP_CAL1_V,
+                                                       TEMPSENSOR_CAL1_TEMP,
+                                                       vdda_mV,
+                                                       levels[SCAN_TEMPERATURE],
+                                                       LL_ADC_RESOLUTION_12B);
+  }
+
+  /* from int16 to q7.8 */
+  measurement.temperature = (int16_t)(temperature * 256);
+
+  /* Note: use %u and cast to unsigned int to avoid unsupported long specifiers */
+  APP_LOG(TS_ON, VLEVEL_M, "ADC: vref=%u vdda_mV=%u raw_pin=%u pin_mV=%u batt_mV=%u temp=%d C\r\n",
+          (unsigned int)levels[SCAN_VREFINT], (unsigned int)vdda_mV, (unsigned int)levels[SCAN_BATTERY],
+          (unsigned int)pin_mV, (unsigned int)measurement.battery_mv, (int)temperature);
+}
 
 /* USER CODE END PrFD */
 
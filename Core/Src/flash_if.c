@@ -24,7 +24,8 @@
 #include "stm32_mem.h"
 
 /* USER CODE BEGIN Includes */
-
+#include "power_profile.h"
+#include "clock_profile.h"
 /* USER CODE END Includes */
 
 /* External variables ---------------------------------------------------------*/
@@ -144,14 +145,16 @@ FLASH_IF_StatusTypedef FLASH_IF_Write(void *pDestination, const void *pSource, u
 {
   FLASH_IF_StatusTypedef ret_status = FLASH_IF_ERROR;
   /* USER CODE BEGIN FLASH_IF_Write_1 */
-
+  ClockProfile_Request(CLOCK_CLIENT_FLASH);
+  PowerProfile_Enter(POWER_STATE_FLASH_BUSY);
   /* USER CODE END FLASH_IF_Write_1 */
   if (IS_FLASH_MAIN_MEM_ADDRESS((uint32_t)pDestination))
   {
     ret_status = FLASH_IF_INT_Write(pDestination, pSource, uLength);
   }
   /* USER CODE BEGIN FLASH_IF_Write_2 */
-
+  PowerProfile_Enter(POWER_STATE_FLASH_IDLE);
+  ClockProfile_Release(CLOCK_CLIENT_FLASH);
   /* USER CODE END FLASH_IF_Write_2 */
   return ret_status;
 }
@@ -176,7 +179,8 @@ FLASH_IF_StatusTypedef FLASH_IF_Erase(void *pStart, uint32_t uLength)
 {
   FLASH_IF_StatusTypedef ret_status = FLASH_IF_ERROR;
   /* USER CODE BEGIN FLASH_IF_Erase_1 */
-
+  ClockProfile_Request(CLOCK_CLIENT_FLASH);
+  PowerProfile_Enter(POWER_STATE_FLASH_BUSY);
   /* USER CODE END FLASH_IF_Erase_1 */
   /* Check Flash start address */
   if (IS_FLASH_MAIN_MEM_ADDRESS((uint32_t)pStart))
@@ -184,13 +188,54 @@ FLASH_IF_StatusTypedef FLASH_IF_Erase(void *pStart, uint32_t uLength)
     ret_status = FLASH_IF_INT_Erase(pStart, uLength);
   }
   /* USER CODE BEGIN FLASH_IF_Erase_2 */
-
+  PowerProfile_Enter(POWER_STATE_FLASH_IDLE);
+  ClockProfile_Release(CLOCK_CLIENT_FLASH);
   /* USER CODE END FLASH_IF_Erase_2 */
   return ret_status;
 }
 
 /* USER CODE BEGIN EF */
+FLASH_IF_StatusTypedef FLASH_IF_Program(void *pDestination, const void *pSource, uint32_t uLength)
+{
+  FLASH_IF_StatusTypedef ret_status = FLASH_IF_OK;
+  uint32_t dest = (uint32_t)pDestination;
+  const uint8_t *source = (const uint8_t *)pSource;
+  uint64_t data;
 
+  if ((pDestination == NULL) || (pSource == NULL) || !IS_ADDR_ALIGNED_64BITS(uLength)
+      || !IS_ADDR_ALIGNED_64BITS(dest) || !IS_FLASH_MAIN_MEM_ADDRESS(dest))
+  {
+    return FLASH_IF_PARAM_ERROR;
+  }
+
+  ret_status = FLASH_IF_INT_Clear_Error();
+  if (ret_status != FLASH_IF_OK)
+  {
+    return ret_status;
+  }
+  if (HAL_FLASH_Unlock() != HAL_OK)
+  {
+    return FLASH_IF_LOCK_ERROR;
+  }
+
+  ClockProfile_Request(CLOCK_CLIENT_FLASH);
+  PowerProfile_Enter(POWER_STATE_FLASH_BUSY);
+  for (uint32_t offset = 0U; offset < uLength; offset += 8U)
+  {
+    UTIL_MEM_cpy_8(&data, &source[offset], 8U);
+    if ((HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, dest + offset, data) != HAL_OK)
+        || (*(const uint64_t *)(dest + offset) != data))
+    {
+      ret_status = FLASH_IF_WRITE_ERROR;
+      break;
+    }
+  }
+
+  HAL_FLASH_Lock();
+  PowerProfile_Enter(POWER_STATE_FLASH_IDLE);
+  ClockProfile_Release(CLOCK_CLIENT_FLASH);
+  return ret_status;
+}
 /* USER CODE END EF */
 
 /* Private Functions Definition -----------------------------------------------*/
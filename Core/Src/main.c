@@ -30,6 +30,8 @@
 #include "usart_if.h"
 #include "stm32_timer.h"
 #include "lora_app.h"
+#include "event_log.h"
+#include "clock_profile.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -113,16 +115,10 @@ int main(void)
   MX_USART1_UART_Init();
   
   // Configurar USART1 para despertar del modo STOP
-  UART_WakeUpTypeDef WakeUpSelection;
-  WakeUpSelection.WakeUpEvent = UART_WAKEUP_ON_STARTBIT;
-  HAL_UARTEx_StopModeWakeUpSourceConfig(&huart1, WakeUpSelection);
-  
-  while (__HAL_UART_GET_FLAG(&huart1, USART_ISR_BUSY) == SET);
-  while (__HAL_UART_GET_FLAG(&huart1, USART_ISR_REACK) == RESET);
-
-  __HAL_UART_ENABLE_IT(&huart1, UART_IT_WUF);
+  MeterUart_EnableWakeup();
+  // Reloj bajo (MSI 16 MHz, rango 2) salvo para LoRaWAN y escrituras en Flash
+  ClockProfile_Init();
   UTIL_TIMER_Create(&LedTimer, 1000, UTIL_TIMER_ONESHOT, OnLedTimerEvent, NULL);
-  HAL_UARTEx_EnableStopMode(&huart1);
   HAL_UART_Transmit(&huart1, (uint8_t*)iniciouart1, strlen(iniciouart1), HAL_MAX_DELAY);
   /* USER CODE END 2 */
 
@@ -162,8 +158,11 @@ void SystemClock_Config(void)
 
   /** Initializes the CPU, AHB and APB buses clocks
   */
-  RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_LSE|RCC_OSCILLATORTYPE_MSI;
+  RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSI|RCC_OSCILLATORTYPE_LSE
+                              |RCC_OSCILLATORTYPE_MSI;
   RCC_OscInitStruct.LSEState = RCC_LSE_ON;
+  RCC_OscInitStruct.HSIState = RCC_HSI_ON;
+  RCC_OscInitStruct.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
   RCC_OscInitStruct.MSIState = RCC_MSI_ON;
   RCC_OscInitStruct.MSICalibrationValue = RCC_MSICALIBRATION_DEFAULT;
   RCC_OscInitStruct.MSIClockRange = RCC_MSIRANGE_11;
@@ -204,14 +203,11 @@ static void OnLedTimerEvent(void *context)
  */
 void RequestMeterRead(uint8_t attempt)
 {
-    char msg[64];
-    snprintf(msg, sizeof(msg), "\r\n[APP] Solicitando lectura del medidor... Intento %u\r\n", attempt);
-    HAL_UART_Transmit(&hlpuart1, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
+    // Llamada tambien desde el timer de reintento (interrupcion): sin transmision bloqueante
+    EventLog_Push(EVT_METER_REQUEST, attempt, 0);
 
-    uart_rx_index = 0;
-    uart_rx_complete = 0;
     meter_data_ready = 0;
-    HAL_UART_Receive_IT(&huart1, (uint8_t*)&uart_rx_char, 1);
+    MeterUart_StartReceive();
 }
 
 /**
@@ -219,21 +215,13 @@ void RequestMeterRead(uint8_t attempt)
  */
 static void ProcessUartData(void)
 {
-    char dbg_msg[80];
-    snprintf(dbg_msg, sizeof(dbg_msg), "DEBUG ProcessUartData: uart_rx_index=%d uart_rx_complete=%d\r\n", uart_rx_index, uart_rx_complete);
-    HAL_UART_Transmit(&huart1, (uint8_t*)dbg_msg, strlen(dbg_msg), HAL_MAX_DELAY);
-    
-    char header[] = "\r\n>>> TRAMA COMPLETA <<<\r\n";
-    HAL_UART_Transmit(&huart1, (uint8_t*)header, strlen(header), HAL_MAX_DELAY);
-    HAL_UART_Transmit(&huart1, (uint8_t*)uart_rx_buffer, uart_rx_index, HAL_MAX_DELAY);
-
-    char footer[] = "\r\n>>> FIN TRAMA <<<\r\n\r\n";
-    HAL_UART_Transmit(&huart1, (uint8_t*)footer, strlen(footer), HAL_MAX_DELAY);
+#if (METER_FRAME_MIRROR == 1)
+    // Copia de la trama al puerto de trazas (DMA, no bloquea el bucle principal)
+    MeterUart_MirrorFrame();
+#endif /* METER_FRAME_MIRROR == 1 */
 
+    // La aplicacion rearma (MeterUart_StartReceive) o detiene (MeterUart_StopReceive) la recepcion
     LoRaWAN_NotifyMeterDataReady();
-    
-    uart_rx_complete = 0;
-    uart_rx_index = 0;
 }
 /* USER CODE END 4 */
 
@@ -25,7 +25,8 @@
 #include "usart_if.h"
 
 /* USER CODE BEGIN Includes */
-
+#include "power_profile.h"
+#include "clock_profile.h"
 /* USER CODE END Includes */
 
 /* External variables ---------------------------------------------------------*/
@@ -65,7 +66,10 @@ const struct UTIL_LPM_Driver_s UTIL_PowerDriver =
 
 /* Private variables ---------------------------------------------------------*/
 /* USER CODE BEGIN PV */
-
+/**
+  * @brief Mode entered by the last PWR_EnterStopMode(): lighter than Stop2 while the meter port needs it
+  */
+static MeterLowPower_t stop_mode_entered = METER_LP_STOP2;
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
@@ -92,14 +96,25 @@ void PWR_ExitOffMode(void)
 void PWR_EnterStopMode(void)
 {
   /* USER CODE BEGIN EnterStopMode_1 */
-
+  stop_mode_entered = MeterUart_GetLowPowerMode();
+  if (stop_mode_entered == METER_LP_SLEEP)
+  {
+    PWR_EnterSleepMode();
+    return;
+  }
   /* USER CODE END EnterStopMode_1 */
   HAL_SuspendTick();
   /* Clear Status Flag before entering STOP/STANDBY Mode */
   LL_PWR_ClearFlag_C1STOP_C1STB();
 
   /* USER CODE BEGIN EnterStopMode_2 */
-
+  PowerProfile_Enter((stop_mode_entered == METER_LP_STOP1) ? POWER_STATE_MCU_STOP1 : POWER_STATE_MCU_STOP2);
+  if (stop_mode_entered == METER_LP_STOP1)
+  {
+    /* USART1 start-bit wakeup only works down to Stop1 */
+    HAL_PWREx_EnterSTOP1Mode(PWR_STOPENTRY_WFI);
+    return;
+  }
   /* USER CODE END EnterStopMode_2 */
   HAL_PWREx_EnterSTOP2Mode(PWR_STOPENTRY_WFI);
   /* USER CODE BEGIN EnterStopMode_3 */
@@ -110,7 +125,12 @@ void PWR_EnterStopMode(void)
 void PWR_ExitStopMode(void)
 {
   /* USER CODE BEGIN ExitStopMode_1 */
-
+  if (stop_mode_entered == METER_LP_SLEEP)
+  {
+    PWR_ExitSleepMode();
+    return;
+  }
+  PowerProfile_Enter(ClockProfile_IsFull() ? POWER_STATE_MCU_RUN : POWER_STATE_MCU_RUN_LOW);
   /* USER CODE END ExitStopMode_1 */
   /* Resume sysTick : work around for debugger problem in dual core */
   HAL_ResumeTick();
@@ -122,7 +142,12 @@ void PWR_ExitStopMode(void)
   /* Resume not retained USARTx and DMA */
   vcom_Resume();
   /* USER CODE BEGIN ExitStopMode_2 */
-
+  /* The ADC is initialized for every conversion (ADC_ReadChannels) and the SUBGHZ
+     radio is woken up by its driver: only USART1 needs restoring */
+  if (stop_mode_entered == METER_LP_STOP2)
+  {
+    MeterUart_Resume();
+  }
   /* USER CODE END ExitStopMode_2 */
 }
 
@@ -134,7 +159,7 @@ void PWR_EnterSleepMode(void)
   /* Suspend sysTick */
   HAL_SuspendTick();
   /* USER CODE BEGIN EnterSleepMode_2 */
-
+  PowerProfile_Enter(ClockProfile_IsFull() ? POWER_STATE_MCU_SLEEP : POWER_STATE_MCU_SLEEP_LOW);
   /* USER CODE END EnterSleepMode_2 */
   HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
   /* USER CODE BEGIN EnterSleepMode_3 */
@@ -145,7 +170,7 @@ void PWR_EnterSleepMode(void)
 void PWR_ExitSleepMode(void)
 {
   /* USER CODE BEGIN ExitSleepMode_1 */
-
+  PowerProfile_Enter(ClockProfile_IsFull() ? POWER_STATE_MCU_RUN : POWER_STATE_MCU_RUN_LOW);
   /* USER CODE END ExitSleepMode_1 */
   /* Resume sysTick */
   HAL_ResumeTick();
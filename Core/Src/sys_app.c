@@ -32,6 +32,8 @@
 #include "sys_sensors.h"
 
 /* USER CODE BEGIN Includes */
+#include "event_log.h"
+#include "power_profile.h"
 
 /* USER CODE END Includes */
 
@@ -131,6 +133,10 @@ void SystemApp_Init(void)
 #endif /* LOW_POWER_DISABLE */
 
   /* USER CODE BEGIN SystemApp_Init_2 */
+  /* Events recorded from interrupts are printed by a sequencer task */
+  EventLog_Init();
+  /* Time per power state, from here on */
+  PowerProfile_Init();
 
   /* USER CODE END SystemApp_Init_2 */
 }
@@ -22,7 +22,11 @@
 #include "usart_if.h"
 
 /* USER CODE BEGIN Includes */
-
+#include <string.h>
+#include <stdio.h>
+#include "stm32_timer.h"
+#include "event_log.h"
+#include "power_profile.h"
 /* USER CODE END Includes */
 
 /* External variables ---------------------------------------------------------*/
@@ -87,17 +91,70 @@ static void (*TxCpltCallback)(void *);
 static void (*RxCpltCallback)(uint8_t *rxChar, uint16_t size, uint8_t error);
 
 /* USER CODE BEGIN PV */
-char  uart_rx_char;
-char  uart_rx_buffer[UART_BUFFER_SIZE];
-volatile uint16_t uart_rx_index = 0;
-volatile uint8_t uart_rx_complete = 0;
-const char end_marker[] = ")C.1.0("; // marcador final de trama (sin el ID)
+/**
+  * @brief circular DMA ring written by DMA1_Channel2 (USART1_RX)
+  */
+static uint8_t meter_rx_dma_buffer[METER_RX_DMA_BUFFER_SIZE];
+
+/**
+  * @brief read position in meter_rx_dma_buffer (bytes already moved to uart_rx_buffer)
+  */
+static uint16_t meter_rx_dma_pos = 0;
+
+/**
+  * @brief Line quality counters of the meter port
+  */
+static MeterLineStats_t meter_line_stats;
+
+/**
+  * @brief Request, first byte and end of frame times of the read
+  */
+static MeterReadTiming_t meter_read_timing;
+
+#if (METER_DECODE_PROFILE == 1)
+/**
+  * @brief CPU cycles spent on the frame being received
+  */
+static uint32_t meter_frame_cycles = 0;
+#endif /* METER_DECODE_PROFILE == 1 */
+
+#if (METER_FRAME_MIRROR == 1)
+static uint32_t meter_mirror_tick = 0;
+static bool meter_mirror_done = false;   /* a frame was mirrored (meter_mirror_tick valid) */
+static uint32_t meter_mirror_skipped = 0;
+#endif /* METER_FRAME_MIRROR == 1 */
+
+#if (METER_IEC_MODE_C == 1)
+static UTIL_TIMER_Object_t MeterSessionTimer;
+#endif /* METER_IEC_MODE_C == 1 */
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
 
 /* USER CODE BEGIN PFP */
+static void MeterUart_Append(const uint8_t *data, uint16_t size);
+static void MeterUart_SetBaudRate(uint32_t baud);
+static void MeterUart_RestartDma(bool gap_timeout);
+static bool MeterUart_Transmit(const uint8_t *data, uint16_t len);
+static void MeterUart_AbortTransmit(void);
+static void MeterUart_StartTimer(uint32_t timeout);
+static void MeterUart_StopTimer(void);
+#if (METER_IEC_MODE_C == 1)
+static void OnMeterSessionTimeout(void *context);
+#endif /* METER_IEC_MODE_C == 1 */
 
+/**
+  * @brief USART1, its DMA ring and the session timer, as seen by the meter link
+  */
+static const MeterLink_Port_t meter_port =
+{
+  MeterUart_SetBaudRate,
+  MeterUart_RestartDma,
+  MeterUart_Transmit,
+  MeterUart_AbortTransmit,
+  MeterUart_StartTimer,
+  MeterUart_StopTimer,
+};
 /* USER CODE END PFP */
 
 /* Exported functions --------------------------------------------------------*/
@@ -225,43 +282,17 @@ void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
     TxCpltCallback(NULL);
   }
   /* USER CODE BEGIN HAL_UART_TxCpltCallback_2 */
-
+  else if (huart->Instance == USART1)
+  {
+    MeterLink_TxComplete();
+  }
   /* USER CODE END HAL_UART_TxCpltCallback_2 */
 }
 
 void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
 {
   /* USER CODE BEGIN HAL_UART_RxCpltCallback_1 */
-    if (huart->Instance == USART1) {
-        if (uart_rx_index < UART_BUFFER_SIZE - 1 && !uart_rx_complete) {
-            uart_rx_buffer[uart_rx_index++] = uart_rx_char;
-            uart_rx_buffer[uart_rx_index] = '\0';
-
-            // Detectar fin: C.1.0(XXXXXXXX)
-            if (uart_rx_char == ')' && uart_rx_index >= 15) {
-                char *marker = strstr(uart_rx_buffer, "C.1.0(");
-                if (marker != NULL && (uart_rx_buffer + uart_rx_index - 1) > (marker + 6)) {
-                    uart_rx_complete = 1;
-                    // DEBUG: Log cuando se completa la trama
-                    char dbg[64];
-                    snprintf(dbg, sizeof(dbg), "DEBUG: Trama completa detectada, %d bytes\r\n", uart_rx_index);
-                    HAL_UART_Transmit(&huart1, (uint8_t*)dbg, strlen(dbg), 100);
-                }
-            }
-        }
-
-        // Protección overflow
-        if (uart_rx_index >= UART_BUFFER_SIZE - 1) {
-            uart_rx_index = 0;
-            memset(uart_rx_buffer, 0, UART_BUFFER_SIZE);
-        }
-
-        // Solo continuar recibiendo si NO se completó la trama
-        if (!uart_rx_complete) {
-            HAL_UART_Receive_IT(&huart1, (uint8_t*)&uart_rx_char, 1);
-        }
-        return;
-    }
+
   /* USER CODE END HAL_UART_RxCpltCallback_1 */
   if (huart->Instance == LPUART1)
   {
@@ -277,11 +308,408 @@ void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
 }
 
 /* USER CODE BEGIN EF */
+void MeterUart_Init(void)
+{
+#if (METER_DECODE_PROFILE == 1)
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif /* METER_DECODE_PROFILE == 1 */
+#if (METER_IEC_MODE_C == 1)
+  UTIL_TIMER_Create(&MeterSessionTimer, METER_IEC_IDENT_TIMEOUT, UTIL_TIMER_ONESHOT, OnMeterSessionTimeout, NULL);
+#endif /* METER_IEC_MODE_C == 1 */
+  MeterLink_Init(&meter_port);
+}
+
+void MeterUart_StartReceive(void)
+{
+  /* Restart from a clean ring: abort any previous reception (no-op if idle) */
+  HAL_UART_AbortReceive(&huart1);
+
+  meter_read_timing.start = UTIL_TIMER_GetCurrentTime();
+  meter_read_timing.first_byte = 0;
+  meter_read_timing.end = 0;
+#if (METER_DECODE_PROFILE == 1)
+  meter_frame_cycles = 0;
+#endif /* METER_DECODE_PROFILE == 1 */
+
+  PowerProfile_Enter(POWER_STATE_METER_LISTEN);
+
+  MeterLink_StartRead();
+}
+
+void MeterUart_StartCapture(void)
+{
+  HAL_UART_AbortReceive(&huart1);
+  PowerProfile_Enter(POWER_STATE_METER_LISTEN);
+  MeterLink_StartCapture();
+}
+
+void MeterUart_StopReceive(void)
+{
+  MeterLink_Stop();
+  HAL_UART_AbortReceive(&huart1);
+  PowerProfile_Enter(POWER_STATE_METER_OFF);
+}
+
+const MeterLineStats_t *MeterUart_GetLineStats(void)
+{
+  return &meter_line_stats;
+}
+
+void MeterUart_EnableWakeup(void)
+{
+  UART_WakeUpTypeDef WakeUpSelection;
+
+  WakeUpSelection.WakeUpEvent = UART_WAKEUP_ON_STARTBIT;
+  HAL_UARTEx_StopModeWakeUpSourceConfig(&huart1, WakeUpSelection);
+
+  while (__HAL_UART_GET_FLAG(&huart1, USART_ISR_BUSY) == SET);
+  while (__HAL_UART_GET_FLAG(&huart1, USART_ISR_REACK) == RESET);
+
+  __HAL_UART_ENABLE_IT(&huart1, UART_IT_WUF);
+  HAL_UARTEx_EnableStopMode(&huart1);
+  LL_EXTI_EnableIT_0_31(LL_EXTI_LINE_26);
+}
+
+void MeterUart_Resume(void)
+{
+  /* Stop2 is only entered with the reception stopped: re-run the whole MSP init
+     (kernel clock, DMA channels) and the configuration kept in huart1.Init
+     (baud rate and prescaler of the last session, TX inversion) */
+  huart1.gState = HAL_UART_STATE_RESET;
+  if (HAL_UART_Init(&huart1) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  MeterUart_EnableWakeup();
+}
+
+MeterLowPower_t MeterUart_GetLowPowerMode(void)
+{
+  uint16_t dma_pos;
+
+  if (MeterLink_SessionActive())
+  {
+    return METER_LP_SLEEP;  /* sign-on, ACK or read command on the line, answer expected */
+  }
+
+  if (huart1.RxState == HAL_UART_STATE_READY)
+  {
+    return METER_LP_STOP2;
+  }
+  /* Reception armed (read or background capture of a push-only meter): Stop1 at best, the
+     DMA channels are not retained in Stop2. With background capture on such a meter Stop2
+     is never entered */
+  if (uart_rx_complete)
+  {
+    return METER_LP_STOP1;  /* frame waiting for the application, nothing more to receive */
+  }
+
+  /* Character on the line, bytes in the ring not drained yet (the DMA events only come
+     every half ring or on line idle) or frame started: stay awake until it ends */
+  dma_pos = (uint16_t)(METER_RX_DMA_BUFFER_SIZE - __HAL_DMA_GET_COUNTER(huart1.hdmarx));
+  if (__HAL_UART_GET_FLAG(&huart1, USART_ISR_BUSY) == SET ||
+      (dma_pos % METER_RX_DMA_BUFFER_SIZE) != meter_rx_dma_pos || uart_rx_index > 0U)
+  {
+    return METER_LP_SLEEP;
+  }
+  return METER_LP_STOP1;
+}
+
+MeterFrameCheck_t MeterUart_GetFrameCheck(void)
+{
+  return MeterLink_GetFrameCheck();
+}
 
+MeterReadMode_t MeterUart_GetReadMode(void)
+{
+  return MeterLink_GetReadMode();
+}
+
+bool MeterUart_PushOnly(void)
+{
+  return MeterLink_PushOnly();
+}
+
+const MeterReadTiming_t *MeterUart_GetReadTiming(void)
+{
+  return &meter_read_timing;
+}
+
+#if (METER_FRAME_MIRROR == 1)
+void MeterUart_MirrorFrame(void)
+{
+  static const char *const status_name[] = { "sin BCC", "BCC OK", "CORRUPTA" };
+  char header[64];
+  static const char footer[] = "\r\n>>> FIN TRAMA <<<\r\n\r\n";
+  uint16_t header_len;
+  uint16_t length;
+  uint8_t *fifo;
+  uint16_t fifo_size;
+  uint16_t pos;
+
+  if (meter_mirror_done && UTIL_TIMER_GetElapsedTime(meter_mirror_tick) < METER_MIRROR_MIN_INTERVAL)
+  {
+    meter_mirror_skipped++;
+    return;
+  }
+
+  header_len = (uint16_t)snprintf(header, sizeof(header), "\r\n>>> TRAMA COMPLETA (%u bytes, %s, %u omitidas) <<<\r\n",
+                                  (unsigned int)uart_rx_index, status_name[MeterLink_GetFrameCheck()],
+                                  (unsigned int)meter_mirror_skipped);
+  if (header_len >= sizeof(header))
+  {
+    header_len = sizeof(header) - 1U;
+  }
+  length = (uint16_t)(header_len + uart_rx_index + sizeof(footer) - 1U);
+
+  if (UTIL_ADV_TRACE_COND_ZCSend_Allocation(VLEVEL_M, T_REG_OFF, TS_OFF, length, &fifo, &fifo_size, &pos) != UTIL_ADV_TRACE_OK)
+  {
+    meter_mirror_skipped++;
+    return;
+  }
+
+  /* The allocated area may wrap around the end of the FIFO */
+  for (uint16_t i = 0; i < header_len; i++)
+  {
+    fifo[pos] = (uint8_t)header[i];
+    pos = (uint16_t)((pos + 1U) % fifo_size);
+  }
+  for (uint16_t i = 0; i < uart_rx_index; i++)
+  {
+    fifo[pos] = (uint8_t)uart_rx_buffer[i];
+    pos = (uint16_t)((pos + 1U) % fifo_size);
+  }
+  for (uint16_t i = 0; i < sizeof(footer) - 1U; i++)
+  {
+    fifo[pos] = (uint8_t)footer[i];
+    pos = (uint16_t)((pos + 1U) % fifo_size);
+  }
+  UTIL_ADV_TRACE_COND_ZCSend_Finalize();
+
+  meter_mirror_tick = UTIL_TIMER_GetCurrentTime();
+  meter_mirror_done = true;
+  meter_mirror_skipped = 0;
+}
+#endif /* METER_FRAME_MIRROR == 1 */
+
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
+{
+  if (huart->Instance != USART1)
+  {
+    return;
+  }
+
+  /* Size is the DMA write position inside the ring (Size == buffer size on TC) */
+  if (Size > METER_RX_DMA_BUFFER_SIZE)
+  {
+    return;
+  }
+
+  if (Size > meter_rx_dma_pos)
+  {
+    MeterUart_Append(&meter_rx_dma_buffer[meter_rx_dma_pos], Size - meter_rx_dma_pos);
+  }
+  else if (Size < meter_rx_dma_pos)
+  {
+    /* DMA wrapped around: tail of the ring first, then the head */
+    MeterUart_Append(&meter_rx_dma_buffer[meter_rx_dma_pos], METER_RX_DMA_BUFFER_SIZE - meter_rx_dma_pos);
+    MeterUart_Append(&meter_rx_dma_buffer[0], Size);
+  }
+
+  meter_rx_dma_pos = (Size == METER_RX_DMA_BUFFER_SIZE) ? 0 : Size;
+}
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+  uint32_t error;
+
+  if (huart->Instance != USART1)
+  {
+    return;
+  }
+
+  /* In DMA mode the HAL aborts reception on PE/FE/NE/ORE and on receiver timeout */
+  error = huart->ErrorCode;
+  if ((error & HAL_UART_ERROR_PE) != 0U)
+  {
+    meter_line_stats.parity_errors++;
+  }
+  if ((error & HAL_UART_ERROR_FE) != 0U)
+  {
+    meter_line_stats.framing_errors++;
+  }
+  if ((error & HAL_UART_ERROR_NE) != 0U)
+  {
+    meter_line_stats.noise_errors++;
+  }
+  if ((error & HAL_UART_ERROR_ORE) != 0U)
+  {
+    meter_line_stats.overrun_errors++;
+  }
+  if ((error & HAL_UART_ERROR_RTO) != 0U)
+  {
+    meter_line_stats.gap_timeouts++;
+  }
+
+  if (MeterLink_LineError())
+  {
+    meter_line_stats.aborted_frames++;
+  }
+}
 /* USER CODE END EF */
 
 /* Private Functions Definition -----------------------------------------------*/
 
 /* USER CODE BEGIN PrFD */
+/**
+  * @brief  Pass a chunk drained from the DMA ring to the meter link (frame buffer,
+  *         OBIS decoder and mode C session), with timing and line statistics
+  * @param  data first byte of the chunk
+  * @param  size number of bytes
+  */
+static void MeterUart_Append(const uint8_t *data, uint16_t size)
+{
+#if (METER_DECODE_PROFILE == 1)
+  uint32_t cycles = DWT->CYCCNT;
+#endif /* METER_DECODE_PROFILE == 1 */
+
+  if (uart_rx_complete)
+  {
+    return;
+  }
+
+  if (meter_read_timing.first_byte == 0U && size > 0U)
+  {
+    /* The DMA event comes after the chunk: back off its length, 10 bits per 7E1 character */
+    uint32_t chunk_ms = ((uint32_t)size * 10000U) / huart1.Init.BaudRate;
+    uint32_t elapsed = UTIL_TIMER_GetElapsedTime(meter_read_timing.start);
+
+    meter_read_timing.first_byte = meter_read_timing.start + ((elapsed > chunk_ms) ? elapsed - chunk_ms : 0U);
+  }
+
+  MeterLink_Receive(data, size);
 
+#if (METER_DECODE_PROFILE == 1)
+  cycles = DWT->CYCCNT - cycles;
+  meter_frame_cycles += cycles;
+  meter_line_stats.decode_cycles += cycles;
+  meter_line_stats.decode_bytes += size;
+#endif /* METER_DECODE_PROFILE == 1 */
+
+  if (uart_rx_complete)
+  {
+    meter_read_timing.end = UTIL_TIMER_GetCurrentTime();
+#if (METER_DECODE_PROFILE == 1)
+    meter_line_stats.last_frame_cycles = meter_frame_cycles;
+    meter_frame_cycles = 0;
+#endif /* METER_DECODE_PROFILE == 1 */
+    if (MeterLink_GetFrameCheck() == METER_FRAME_CORRUPT)
+    {
+      meter_line_stats.corrupt_frames++;
+    }
+    else
+    {
+      meter_line_stats.good_frames++;
+    }
+
+    EventLog_Push(EVT_METER_FRAME, uart_rx_index, MeterLink_GetFrameCheck());
+  }
+}
+
+/**
+  * @brief  Change the USART1 baud rate, selecting the smallest kernel clock prescaler
+  *         that keeps BRR within 16 bits (300 Bd needs /4 at 48 MHz)
+  * @param  baud new baud rate
+  */
+static void MeterUart_SetBaudRate(uint32_t baud)
+{
+  uint32_t pclk = HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_USART1);
+  uint32_t prescaler = UART_PRESCALER_DIV1;
+
+  HAL_UART_AbortReceive(&huart1);
+  while (prescaler < UART_PRESCALER_DIV256 && UART_DIV_SAMPLING16(pclk, baud, prescaler) > 0xFFFFU)
+  {
+    prescaler++;
+  }
+
+  huart1.Init.BaudRate = baud;
+  huart1.Init.ClockPrescaler = prescaler;
+
+  __HAL_UART_DISABLE(&huart1);
+  MODIFY_REG(huart1.Instance->PRESC, USART_PRESC_PRESCALER, prescaler);
+  huart1.Instance->BRR = (uint16_t)UART_DIV_SAMPLING16(pclk, baud, prescaler);
+  __HAL_UART_ENABLE(&huart1);
+}
+
+/**
+  * @brief  (Re)start the circular DMA reception from the beginning of the ring
+  * @param  gap_timeout end a frame that stops in the middle with a receiver timeout error
+  * @note   A failed start is recovered by the meter read timeout/retry logic
+  */
+static void MeterUart_RestartDma(bool gap_timeout)
+{
+  HAL_UART_AbortReceive(&huart1);
+  meter_rx_dma_pos = 0;
+  /* Circular DMA + IDLE: HAL_UARTEx_RxEventCallback fires on HT, TC and line idle only */
+  HAL_UARTEx_ReceiveToIdle_DMA(&huart1, meter_rx_dma_buffer, METER_RX_DMA_BUFFER_SIZE);
+
+  /* Receiver timeout: counted from the last received character (10 bits per 7E1 character),
+     so it only ends a frame that stopped in the middle. ReceiveToIdle_DMA leaves RTOIE alone */
+  if (gap_timeout)
+  {
+    HAL_UART_ReceiverTimeout_Config(&huart1, METER_GAP_TIMEOUT_CHARS * 10U);
+    SET_BIT(huart1.Instance->CR2, USART_CR2_RTOEN);
+    ATOMIC_SET_BIT(huart1.Instance->CR1, USART_CR1_RTOIE);
+  }
+  else
+  {
+    ATOMIC_CLEAR_BIT(huart1.Instance->CR1, USART_CR1_RTOIE);
+    CLEAR_BIT(huart1.Instance->CR2, USART_CR2_RTOEN);
+  }
+}
+
+/**
+  * @brief  Start sending to the meter, MeterLink_TxComplete() when done
+  * @param  data message, valid until the transmission completes
+  * @param  len message length
+  * @retval false if the DMA transfer could not start
+  */
+static bool MeterUart_Transmit(const uint8_t *data, uint16_t len)
+{
+  return HAL_UART_Transmit_DMA(&huart1, (uint8_t *)data, len) == HAL_OK;
+}
+
+static void MeterUart_AbortTransmit(void)
+{
+  HAL_UART_AbortTransmit(&huart1);
+}
+
+/**
+  * @brief  (Re)start the session timer
+  * @param  timeout timeout in ms
+  */
+static void MeterUart_StartTimer(uint32_t timeout)
+{
+#if (METER_IEC_MODE_C == 1)
+  UTIL_TIMER_Stop(&MeterSessionTimer);
+  UTIL_TIMER_SetPeriod(&MeterSessionTimer, timeout);
+  UTIL_TIMER_Start(&MeterSessionTimer);
+#endif /* METER_IEC_MODE_C == 1 */
+}
+
+static void MeterUart_StopTimer(void)
+{
+#if (METER_IEC_MODE_C == 1)
+  UTIL_TIMER_Stop(&MeterSessionTimer);
+#endif /* METER_IEC_MODE_C == 1 */
+}
+
+#if (METER_IEC_MODE_C == 1)
+static void OnMeterSessionTimeout(void *context)
+{
+  MeterLink_Timeout();
+}
+#endif /* METER_IEC_MODE_C == 1 */
 /* USER CODE END PrFD */
@@ -0,0 +1,37 @@
+/*
+ * clock_calc.c
+ * MSI range frequencies and Flash wait states (reference manual, Flash access latency).
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "clock_calc.h"
+
+static const uint32_t msi_frequency[CLOCK_MSI_RANGE_COUNT] =
+{
+  100000U, 200000U, 400000U, 800000U, 1000000U, 2000000U,
+  4000000U, 8000000U, 16000000U, 24000000U, 32000000U, 48000000U
+};
+
+/* Highest HCLK3 (MHz) for 0, 1 and 2 wait states in each voltage range */
+static const uint8_t flash_limit_range1[] = { 18U, 36U, 48U };
+static const uint8_t flash_limit_range2[] = { 6U, 12U, 16U };
+
+uint32_t ClockProfile_MsiFrequency(uint8_t range)
+{
+  return (range < CLOCK_MSI_RANGE_COUNT) ? msi_frequency[range] : 0U;
+}
+
+uint8_t ClockProfile_FlashLatency(uint32_t hclk, bool range2)
+{
+  const uint8_t *limit = range2 ? flash_limit_range2 : flash_limit_range1;
+
+  for (uint8_t ws = 0; ws < sizeof(flash_limit_range1); ws++)
+  {
+    if (hclk <= (uint32_t)limit[ws] * 1000000U)
+    {
+      return ws;
+    }
+  }
+  return CLOCK_LATENCY_INVALID;
+}
@@ -0,0 +1,47 @@
+/*
+ * clock_calc.h
+ * Clock arithmetic of the STM32WLE5 used by clock_profile.c: MSI range
+ * frequencies and Flash wait states per voltage range. No HAL dependency, so
+ * the tables can be checked on the host (test/test_clock_calc.c).
+ * This file is outside CubeMX-managed files so it won't be overwritten.
+ */
+#ifndef __CLOCK_CALC_H__
+#define __CLOCK_CALC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+  * @brief Number of MSI ranges (0..11)
+  */
+#define CLOCK_MSI_RANGE_COUNT   12U
+
+/**
+  * @brief Returned by ClockProfile_FlashLatency() for a frequency the range does not allow
+  */
+#define CLOCK_LATENCY_INVALID   0xFFU
+
+/**
+  * @brief  Frequency of an MSI range
+  * @param  range 0..11
+  * @retval Hz, 0 for an invalid range
+  */
+uint32_t ClockProfile_MsiFrequency(uint8_t range);
+
+/**
+  * @brief  Flash wait states needed at a HCLK3 frequency
+  * @param  hclk Hz
+  * @param  range2 true for voltage range 2
+  * @retval wait states, CLOCK_LATENCY_INVALID if the frequency is not allowed in that range
+  */
+uint8_t ClockProfile_FlashLatency(uint32_t hclk, bool range2);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CLOCK_CALC_H__ */
@@ -0,0 +1,114 @@
+/*
+ * clock_profile.c
+ * Switches between the full speed and the low clock profile following the
+ * requests of its clients.
+ */
+
+#include "platform.h"
+#include "sys_app.h"
+#include "utilities_conf.h"
+#include "power_profile.h"
+#include "clock_profile.h"
+
+/* HAL values of 0, 1 and 2 wait states (index returned by ClockProfile_FlashLatency()) */
+static const uint32_t flash_latency[] = { FLASH_LATENCY_0, FLASH_LATENCY_1, FLASH_LATENCY_2 };
+
+static volatile uint32_t clock_clients = 0;
+static volatile bool clock_full = true;
+static bool clock_scaling = false;
+
+/**
+  * @brief  Switch the MSI range and the voltage range (interrupts disabled)
+  * @note   HAL_RCC_OscConfig() sets the wait states for the current voltage range and
+  *         updates SystemCoreClock. The HAL tick and the timer server run from the
+  *         RTC, and the UART kernel clocks from HSI16: nothing else depends on SYSCLK.
+  */
+static void ApplyProfile(bool full)
+{
+  RCC_OscInitTypeDef osc = {0};
+
+  osc.OscillatorType = RCC_OSCILLATORTYPE_MSI;
+  osc.MSIState = RCC_MSI_ON;
+  osc.MSICalibrationValue = RCC_MSICALIBRATION_DEFAULT;
+
+  if (full)
+  {
+    /* The frequency can only go up once range 1 is reached */
+    if (HAL_PWREx_ControlVoltageScaling(PWR_REGULATOR_VOLTAGE_SCALE1) != HAL_OK)
+    {
+      Error_Handler();
+    }
+    osc.MSIClockRange = (uint32_t)CLOCK_PROFILE_FULL_MSI_RANGE << RCC_CR_MSIRANGE_Pos;
+    if (HAL_RCC_OscConfig(&osc) != HAL_OK)
+    {
+      Error_Handler();
+    }
+  }
+  else
+  {
+    uint8_t ws = ClockProfile_FlashLatency(ClockProfile_MsiFrequency(CLOCK_PROFILE_LOW_MSI_RANGE), true);
+
+    osc.MSIClockRange = (uint32_t)CLOCK_PROFILE_LOW_MSI_RANGE << RCC_CR_MSIRANGE_Pos;
+    if (HAL_RCC_OscConfig(&osc) != HAL_OK)
+    {
+      Error_Handler();
+    }
+    /* Wait states of range 2 before lowering the voltage */
+    __HAL_FLASH_SET_LATENCY(flash_latency[ws]);
+    while (__HAL_FLASH_GET_LATENCY() != flash_latency[ws])
+    {
+    }
+    HAL_PWREx_ControlVoltageScaling(PWR_REGULATOR_VOLTAGE_SCALE2);
+  }
+
+  clock_full = full;
+  PowerProfile_Enter(full ? POWER_STATE_MCU_RUN : POWER_STATE_MCU_RUN_LOW);
+}
+
+void ClockProfile_Init(void)
+{
+#if (CLOCK_PROFILE_ENABLED == 1)
+  uint32_t usart1 = __HAL_RCC_GET_USART1_SOURCE();
+  uint32_t lpuart1 = __HAL_RCC_GET_LPUART1_SOURCE();
+
+  clock_scaling = (usart1 == RCC_USART1CLKSOURCE_HSI || usart1 == RCC_USART1CLKSOURCE_LSE) &&
+                  (lpuart1 == RCC_LPUART1CLKSOURCE_HSI || lpuart1 == RCC_LPUART1CLKSOURCE_LSE);
+  if (!clock_scaling)
+  {
+    APP_LOG(TS_ON, VLEVEL_M, "Reloj: UART con reloj derivado de SYSCLK, se mantiene a %u MHz\r\n",
+            (unsigned int)(SystemCoreClock / 1000000U));
+    return;
+  }
+  ClockProfile_Release((ClockClient_t)0U);
+  APP_LOG(TS_ON, VLEVEL_M, "Reloj: %u MHz en reposo, %u MHz para LoRaWAN y Flash\r\n",
+          (unsigned int)(ClockProfile_MsiFrequency(CLOCK_PROFILE_LOW_MSI_RANGE) / 1000000U),
+          (unsigned int)(ClockProfile_MsiFrequency(CLOCK_PROFILE_FULL_MSI_RANGE) / 1000000U));
+#endif /* CLOCK_PROFILE_ENABLED == 1 */
+}
+
+void ClockProfile_Request(ClockClient_t client)
+{
+  UTILS_ENTER_CRITICAL_SECTION();
+  clock_clients |= (uint32_t)client;
+  if (clock_scaling && !clock_full)
+  {
+    ApplyProfile(true);
+  }
+  UTILS_EXIT_CRITICAL_SECTION();
+}
+
+void ClockProfile_Release(ClockClient_t client)
+{
+  UTILS_ENTER_CRITICAL_SECTION();
+  clock_clients &= ~(uint32_t)client;
+  if (clock_scaling && clock_full && clock_clients == 0U)
+  {
+    ApplyProfile(false);
+  }
+  UTILS_EXIT_CRITICAL_SECTION();
+}
+
+bool ClockProfile_IsFull(void)
+{
+  return clock_full;
+}
@@ -0,0 +1,71 @@
+/*
+ * clock_profile.h
+ * System clock profiles. The core runs from MSI 48 MHz in voltage range 1 only
+ * while a client needs it (LoRaWAN crypto and radio setup, Flash writes), and
+ * from a low MSI range in voltage range 2 the rest of the time (meter
+ * acquisition, idle).
+ * This file is outside CubeMX-managed files so it won't be overwritten.
+ */
+#ifndef __CLOCK_PROFILE_H__
+#define __CLOCK_PROFILE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "clock_calc.h"   /* ClockProfile_MsiFrequency(), ClockProfile_FlashLatency() */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+  * @brief 1: drop to the low profile when no client holds full speed. 0: always full speed.
+  */
+#define CLOCK_PROFILE_ENABLED         1
+
+/**
+  * @brief MSI ranges (0..11) of each profile. Range 2 allows at most 16 MHz (MSI range 8).
+  *        RX windows are opened from timer interrupts at the low profile: below range 8
+  *        the SUBGHZ SPI (HCLK3 / 4) slows their setup down.
+  */
+#define CLOCK_PROFILE_FULL_MSI_RANGE  11U   /* 48 MHz, as SystemClock_Config() */
+#define CLOCK_PROFILE_LOW_MSI_RANGE   8U    /* 16 MHz */
+
+/**
+  * @brief Users of full speed (bit mask)
+  */
+typedef enum
+{
+  CLOCK_CLIENT_LORAWAN = (1U << 0),  /* Frame encryption, MIC and radio setup */
+  CLOCK_CLIENT_FLASH   = (1U << 1),  /* Program and erase, kept in range 1 */
+} ClockClient_t;
+
+/**
+  * @brief  Start switching profiles. Call once the UART kernel clocks are configured.
+  * @note   Profiles are only switched if the UART kernel clocks do not follow SYSCLK
+  *         (HSI16 or LSE): their baud registers then stay valid at any profile.
+  */
+void ClockProfile_Init(void);
+
+/**
+  * @brief  Run at full speed until the client releases it (any context)
+  * @param  client client
+  */
+void ClockProfile_Request(ClockClient_t client);
+
+/**
+  * @brief  End of the full speed need of a client; the low profile is entered when no
+  *         client is left (any context)
+  * @param  client client
+  */
+void ClockProfile_Release(ClockClient_t client);
+
+/**
+  * @brief  Tell whether the core runs at full speed
+  */
+bool ClockProfile_IsFull(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CLOCK_PROFILE_H__ */
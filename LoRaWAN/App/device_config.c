@@ -0,0 +1,198 @@
+/*
+ * device_config.c
+ * Downlink configuration commands and validation of the stored configuration
+ * (see device_config.h).
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "device_config.h"
+
+/* Trace of the received commands. A build without the firmware headers (host)
+   can define DEVICE_CONFIG_LOG before compiling this file, empty or to printf */
+#ifndef DEVICE_CONFIG_LOG
+#include "sys_app.h"
+#define DEVICE_CONFIG_LOG(...) APP_LOG(TS_ON, VLEVEL_M, __VA_ARGS__)
+#endif /* DEVICE_CONFIG_LOG */
+
+/**
+  * @brief  Default configuration: nothing set by downlink
+  * @param  config configuration to fill
+  */
+void DeviceConfig_Defaults(DeviceConfig_t *config)
+{
+  config->reporting_interval_ms = 0;
+  config->config_valid = 0;
+  config->batch_size = 0;
+  config->payload_format = PAYLOAD_FORMAT_TLV;
+  config->report_refresh = 0;
+}
+
+/**
+  * @brief  Take the copy read from Flash if it is valid, the defaults otherwise
+  * @note   Fields a downlink could not have set (corrupt page, older firmware)
+  *         fall back to their default one by one: the same limits as
+  *         DeviceConfig_ApplyCommand().
+  * @param  config output, configuration in use
+  * @param  stored copy read from Flash
+  * @retval true if the stored copy was valid
+  */
+bool DeviceConfig_Load(DeviceConfig_t *config, const DeviceConfig_t *stored)
+{
+  /* interval 0 = default */
+  if (stored->config_valid != CONFIG_MAGIC || stored->reporting_interval_ms >= MAX_REPORTING_INTERVAL_MS)
+  {
+    DeviceConfig_Defaults(config);
+    return false;
+  }
+
+  *config = *stored;
+  if (config->reporting_interval_ms < MIN_REPORTING_INTERVAL * 1000U ||
+      config->reporting_interval_ms > MAX_REPORTING_INTERVAL * 1000U ||
+      (config->reporting_interval_ms % 1000U) != 0U)
+  {
+    config->reporting_interval_ms = 0;
+  }
+  if (config->batch_size > METER_BATCH_MAX)
+  {
+    config->batch_size = 0;
+  }
+  if (config->payload_format >= PAYLOAD_FORMAT_COUNT)
+  {
+    config->payload_format = PAYLOAD_FORMAT_TLV;
+  }
+  if (config->report_refresh > MAX_REPORT_REFRESH)
+  {
+    config->report_refresh = 0;
+  }
+  return true;
+}
+
+/**
+  * @brief  Apply a downlink configuration command
+  * @param  config configuration to change, marked valid when a setting changes
+  * @param  payload command: ID (2 bytes, big-endian) then its parameters
+  * @param  size size of payload in bytes
+  * @retval what changed, DEVICE_CONFIG_NONE if the command was rejected
+  */
+DeviceConfig_Change_t DeviceConfig_ApplyCommand(DeviceConfig_t *config, const uint8_t *payload, uint8_t size)
+{
+  DeviceConfig_Change_t change = DEVICE_CONFIG_NONE;
+
+  if (payload == NULL || size < 2)
+  {
+    DEVICE_CONFIG_LOG("Invalid command size: %d\r\n", size);
+    return DEVICE_CONFIG_NONE;
+  }
+
+  // Command ID is Big-Endian (FF 03)
+  uint16_t cmd_id = (uint16_t)((payload[0] << 8) | payload[1]);
+
+  DEVICE_CONFIG_LOG("Received command: 0x%04X\r\n", cmd_id);
+
+  switch (cmd_id)
+  {
+    case CMD_SET_REPORTING_INTERVAL:
+      if (size >= CMD_0xFF03_SIZE)
+      {
+        // Parameter is Little-Endian (LSB first)
+        uint16_t interval_seconds = (uint16_t)((payload[3] << 8) | payload[2]);
+        DEVICE_CONFIG_LOG("Set interval: %d seconds\r\n", interval_seconds);
+        if (interval_seconds != 0 && interval_seconds < MIN_REPORTING_INTERVAL)
+        {
+          DEVICE_CONFIG_LOG("Interval too short (min %d seconds), ignored\r\n", MIN_REPORTING_INTERVAL);
+          break;
+        }
+        // 0 = back to the default interval (the rest of the configuration is kept)
+        config->reporting_interval_ms = (uint32_t)interval_seconds * 1000U;
+        change = DEVICE_CONFIG_INTERVAL;
+      }
+      else
+      {
+        DEVICE_CONFIG_LOG("Invalid 0xFF03 size: %d\r\n", size);
+      }
+      break;
+
+    case CMD_SET_BATCH_SIZE:
+      if (size >= CMD_0xFF04_SIZE)
+      {
+        DEVICE_CONFIG_LOG("Set batch size: %d readings\r\n", payload[2]);
+        // 0 = METER_BATCH_DEFAULT, clamped to METER_BATCH_MAX
+        config->batch_size = (payload[2] > METER_BATCH_MAX) ? (uint8_t)METER_BATCH_MAX : payload[2];
+        change = DEVICE_CONFIG_BATCH_SIZE;
+      }
+      else
+      {
+        DEVICE_CONFIG_LOG("Invalid 0xFF04 size: %d\r\n", size);
+      }
+      break;
+
+    case CMD_SET_PAYLOAD_FORMAT:
+      if (size >= CMD_0xFF05_SIZE)
+      {
+        DEVICE_CONFIG_LOG("Set payload format: %d\r\n", payload[2]);
+        if (payload[2] >= PAYLOAD_FORMAT_COUNT)
+        {
+          DEVICE_CONFIG_LOG("Unknown payload format: %u\r\n", (unsigned int)payload[2]);
+          break;
+        }
+        config->payload_format = payload[2];
+        change = DEVICE_CONFIG_PAYLOAD_FORMAT;
+        DEVICE_CONFIG_LOG("New payload format: %s\r\n", (payload[2] == PAYLOAD_FORMAT_COMPACT) ? "compact" : "TLV");
+      }
+      else
+      {
+        DEVICE_CONFIG_LOG("Invalid 0xFF05 size: %d\r\n", size);
+      }
+      break;
+
+    case CMD_SET_REPORT_REFRESH:
+      if (size >= CMD_0xFF06_SIZE)
+      {
+        // 0 = off (every field in every uplink), N = full report every N uplinks
+        if (payload[2] > MAX_REPORT_REFRESH)
+        {
+          DEVICE_CONFIG_LOG("Report refresh too long (max %d uplinks), ignored\r\n", MAX_REPORT_REFRESH);
+          break;
+        }
+        config->report_refresh = payload[2];
+        change = DEVICE_CONFIG_REPORT_REFRESH;
+        DEVICE_CONFIG_LOG("Report by exception: %s (full report every %u uplinks)\r\n",
+                          (payload[2] > 1U) ? "ON" : "OFF", (unsigned int)payload[2]);
+      }
+      else
+      {
+        DEVICE_CONFIG_LOG("Invalid 0xFF06 size: %d\r\n", size);
+      }
+      break;
+
+    case CMD_RESET:
+      if (size >= CMD_0xFF10_SIZE && payload[2] == 0xFF)
+      {
+        DEVICE_CONFIG_LOG("RESET command received - Will restart after uplink completes\r\n");
+        return DEVICE_CONFIG_RESET;
+      }
+      DEVICE_CONFIG_LOG("Invalid 0xFF10 command\r\n");
+      break;
+
+    case CMD_FACTORY_RESET_LORAWAN:
+      if (size >= CMD_0xFF99_SIZE && payload[2] == 0xFF)
+      {
+        DEVICE_CONFIG_LOG("FACTORY RESET command received (0xFF99FF)\r\n");
+        return DEVICE_CONFIG_FACTORY_RESET;
+      }
+      DEVICE_CONFIG_LOG("Invalid 0xFF99 command\r\n");
+      break;
+
+    default:
+      DEVICE_CONFIG_LOG("Unknown command: 0x%04X\r\n", cmd_id);
+      break;
+  }
+
+  if (change != DEVICE_CONFIG_NONE)
+  {
+    config->config_valid = CONFIG_MAGIC;
+  }
+  return change;
+}
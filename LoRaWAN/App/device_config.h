@@ -0,0 +1,97 @@
+/*
+ * device_config.h
+ * Device configuration set by downlink (port 85): the commands, the stored
+ * structure and their validation. Applying a command only changes the
+ * structure; saving it and acting on the change (timer, reset) is left to
+ * lora_app.c, so the parsing can be checked and fuzzed on the host (test/).
+ * This file is outside CubeMX-managed files so it won't be overwritten.
+ */
+#ifndef __DEVICE_CONFIG_H__
+#define __DEVICE_CONFIG_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Command IDs (big-endian in the payload) */
+#define CMD_SET_REPORTING_INTERVAL  0xFF03
+#define CMD_SET_BATCH_SIZE          0xFF04
+#define CMD_SET_PAYLOAD_FORMAT      0xFF05
+#define CMD_SET_REPORT_REFRESH      0xFF06
+#define CMD_RESET                   0xFF10
+#define CMD_FACTORY_RESET_LORAWAN   0xFF99  // Factory reset LoRaWAN NVM
+
+/* Command payload sizes */
+#define CMD_0xFF03_SIZE  4  // FF 03 + 2 bytes (LSB, MSB)
+#define CMD_0xFF04_SIZE  3  // FF 04 + 1 byte (readings per uplink)
+#define CMD_0xFF05_SIZE  3  // FF 05 + 1 byte (PAYLOAD_FORMAT_*)
+#define CMD_0xFF06_SIZE  3  // FF 06 + 1 byte (uplinks between full reports)
+#define CMD_0xFF10_SIZE  3  // FF 10 + 1 byte (0xFF)
+#define CMD_0xFF99_SIZE  3  // FF 99 FF
+
+/* Shortest reporting interval accepted by 0xFF03 (s); 0 still selects APP_TX_DUTYCYCLE */
+#define MIN_REPORTING_INTERVAL  60U
+/* Longest reporting interval 0xFF03 can set (s) */
+#define MAX_REPORTING_INTERVAL  0xFFFFU
+/* A stored interval above this (ms) marks the Flash copy as invalid */
+#define MAX_REPORTING_INTERVAL_MS  86400000U
+
+/* Most uplinks between full reports accepted by 0xFF06: a field whose change stays
+   within its deadband is refreshed at least once a day at a 15 min interval */
+#define MAX_REPORT_REFRESH  96U
+
+/* Batch mode: several readings per uplink (TLV 0x07). METER_BATCH_MAX bounds the readings
+   held in RAM, the batch size set by downlink (0xFF04) is at most this */
+#define METER_BATCH_MAX 8U
+
+/* Configuration magic byte */
+#define CONFIG_MAGIC  0xC5
+
+/**
+  * @brief Encoding of the meter registers in single-reading uplinks
+  */
+typedef enum PayloadFormat_e
+{
+  PAYLOAD_FORMAT_TLV = 0,      /* One TLV per register, absolute values */
+  PAYLOAD_FORMAT_COMPACT = 1,  /* TLV 0x08: varint keyframe, then zigzag varint deltas */
+  PAYLOAD_FORMAT_COUNT
+} PayloadFormat_t;
+
+/**
+  * @brief Device configuration structure
+  */
+typedef struct
+{
+  uint32_t reporting_interval_ms;  /* 0 = use APP_TX_DUTYCYCLE */
+  uint8_t config_valid;             /* CONFIG_MAGIC if valid */
+  uint8_t batch_size;               /* Readings per uplink, 0 = METER_BATCH_DEFAULT */
+  uint8_t payload_format;           /* PayloadFormat_t */
+  uint8_t report_refresh;           /* Report-by-exception: full report every N uplinks, 0 = off */
+} DeviceConfig_t;
+
+/**
+  * @brief What a downlink command changed, for the caller to act on
+  */
+typedef enum DeviceConfig_Change_e
+{
+  DEVICE_CONFIG_NONE = 0,        /* Invalid, unknown or rejected command */
+  DEVICE_CONFIG_INTERVAL,        /* reporting_interval_ms: save and restart the TX timer */
+  DEVICE_CONFIG_BATCH_SIZE,      /* batch_size: save */
+  DEVICE_CONFIG_PAYLOAD_FORMAT,  /* payload_format: save and restart the compact encoder */
+  DEVICE_CONFIG_REPORT_REFRESH,  /* report_refresh: save and start a new refresh cycle */
+  DEVICE_CONFIG_RESET,           /* Restart after the next uplink */
+  DEVICE_CONFIG_FACTORY_RESET,   /* Erase the LoRaWAN and device state, then restart */
+} DeviceConfig_Change_t;
+
+void DeviceConfig_Defaults(DeviceConfig_t *config);
+bool DeviceConfig_Load(DeviceConfig_t *config, const DeviceConfig_t *stored);
+DeviceConfig_Change_t DeviceConfig_ApplyCommand(DeviceConfig_t *config, const uint8_t *payload, uint8_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DEVICE_CONFIG_H__ */
@@ -0,0 +1,121 @@
+/*
+ * event_log.c
+ * Lock-free multi-producer ring of event records, drained to UTIL_ADV_TRACE by
+ * CFG_SEQ_Task_EventLog.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "platform.h"
+#include "sys_app.h"
+#include "stm32_seq.h"
+#include "stm32_systime.h"
+#include "utilities_def.h"
+#include "event_log.h"
+
+#define EVENT_LOG_MASK  (EVENT_LOG_SIZE - 1U)
+
+#if (EVENT_LOG_SIZE & EVENT_LOG_MASK) != 0U
+#error EVENT_LOG_SIZE must be a power of 2
+#endif
+
+typedef struct
+{
+  uint32_t         seconds;     /* SysTime at the event */
+  uint16_t         subseconds;
+  uint8_t          id;          /* EventLog_Id_t */
+  volatile uint8_t ready;       /* set by the producer once the record is written */
+  int32_t          arg[2];
+} EventLog_Record_t;
+
+static EventLog_Record_t event_ring[EVENT_LOG_SIZE];
+static volatile uint32_t event_head = 0;     /* next slot to reserve (producers) */
+static volatile uint32_t event_tail = 0;     /* next slot to print (drain task) */
+static volatile uint32_t event_dropped = 0;
+static uint32_t event_dropped_reported = 0;
+
+#define EVENT_LOG_FMT(id, fmt) fmt,
+static const char *const event_fmt[EVT_COUNT] =
+{
+  EVENT_LOG_EVENTS(EVENT_LOG_FMT)
+};
+
+static void EventLog_Process(void);
+
+void EventLog_Init(void)
+{
+  UTIL_SEQ_RegTask((1 << CFG_SEQ_Task_EventLog), UTIL_SEQ_RFU, EventLog_Process);
+}
+
+void EventLog_Push(EventLog_Id_t id, int32_t arg0, int32_t arg1)
+{
+  EventLog_Record_t *record;
+  SysTime_t now = SysTimeGet();
+  uint32_t slot;
+
+  /* Reserve a slot: an interrupt preempting us between LDREX and STREX makes the
+     store fail, and we retry with the head it left */
+  do
+  {
+    slot = __LDREXW(&event_head);
+    if (slot - event_tail >= EVENT_LOG_SIZE)
+    {
+      uint32_t dropped;
+
+      __CLREX();
+      do
+      {
+        dropped = __LDREXW(&event_dropped);
+      } while (__STREXW(dropped + 1U, &event_dropped) != 0U);
+      return;
+    }
+  } while (__STREXW(slot + 1U, &event_head) != 0U);
+
+  record = &event_ring[slot & EVENT_LOG_MASK];
+  record->seconds = now.Seconds;
+  record->subseconds = (uint16_t)now.SubSeconds;
+  record->id = (uint8_t)id;
+  record->arg[0] = arg0;
+  record->arg[1] = arg1;
+  __DMB();
+  record->ready = 1;
+
+  UTIL_SEQ_SetTask((1 << CFG_SEQ_Task_EventLog), CFG_SEQ_Prio_0);
+}
+
+/**
+  * @brief  Print the pending records, oldest first (sequencer task)
+  * @note   Stops at a slot reserved but not yet written: the task runs again when
+  *         its producer completes it.
+  */
+static void EventLog_Process(void)
+{
+  char msg[96];
+
+  while (event_tail != event_head)
+  {
+    EventLog_Record_t *record = &event_ring[event_tail & EVENT_LOG_MASK];
+    EventLog_Record_t copy;
+
+    if (!record->ready)
+    {
+      break;
+    }
+    copy = *record;
+    record->ready = 0;
+    __DMB();
+    event_tail++;
+
+    if (copy.id < EVT_COUNT)
+    {
+      snprintf(msg, sizeof(msg), event_fmt[copy.id], (int)copy.arg[0], (int)copy.arg[1]);
+      APP_LOG(TS_OFF, VLEVEL_M, "%ds%03d:%s\r\n", (int)copy.seconds, (int)copy.subseconds, msg);
+    }
+  }
+
+  if (event_dropped != event_dropped_reported)
+  {
+    event_dropped_reported = event_dropped;
+    APP_LOG(TS_ON, VLEVEL_M, "Registro de eventos lleno: %u eventos perdidos\r\n", (unsigned int)event_dropped_reported);
+  }
+}
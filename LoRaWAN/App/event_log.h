@@ -0,0 +1,70 @@
+/*
+ * event_log.h
+ * Deferred logging for interrupt context: handlers push fixed-size binary
+ * records, a sequencer task formats them to the trace later.
+ * This file is outside CubeMX-managed files so it won't be overwritten.
+ */
+#ifndef __EVENT_LOG_H__
+#define __EVENT_LOG_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+  * @brief Records kept until the task drains them (power of 2). Newer records are
+  *        dropped (and counted) when the ring is full.
+  */
+#define EVENT_LOG_SIZE  32U
+
+/**
+  * @brief Events: id and message, printf format taking the two record arguments
+  */
+#define EVENT_LOG_EVENTS(X) \
+  X(EVT_METER_FRAME,           "Trama de medidor completa: %u bytes (estado %u)")           \
+  X(EVT_METER_REQUEST,         "[APP] Solicitando lectura del medidor... Intento %u")       \
+  X(EVT_METER_TIMEOUT,         "Timeout lectura medidor. Reintentando (%u/%u)...")          \
+  X(EVT_METER_GIVE_UP,         "Timeout lectura medidor. Maximos reintentos alcanzados. Enviando datos parciales.") \
+  X(EVT_METER_RETRY,           "Reintento %u en %u ms")                                     \
+  X(EVT_POWER_SENSE,           "Network state changed to %u! Triggering read...")           \
+  X(EVT_BUTTON_PRESSED,        "Pulsador presionado")                                       \
+  X(EVT_BUTTON_RELEASED,       "Pulsador soltado - Esperando doble pulsación")              \
+  X(EVT_BUTTON_SHORT,          "Pulsación corta - Iniciando lectura + envío LoRaWAN")       \
+  X(EVT_BUTTON_DOUBLE,         "Doble pulsación detectada - Test de alcance LoRaWAN")       \
+  X(EVT_BUTTON_LONG,           "Pulsación larga detectada (>1s)")                           \
+  X(EVT_BUTTON_LONG_RELEASED,  "Pulsación larga (1-5s) - Reservado")                        \
+  X(EVT_TIME_SYNC_REQUEST,     "Requesting time synchronization from network server...")    \
+  X(EVT_TIME_SYNC_REQ_FAILED,  "Failed to request DeviceTimeReq")                           \
+  X(EVT_TIME_SYNC_SENT,        "Time sync request sent (dummy uplink on port 1)")           \
+  X(EVT_TIME_SYNC_SEND_FAILED, "Failed to send time sync uplink (status=%d)")
+
+#define EVENT_LOG_ENUM(id, fmt) id,
+typedef enum
+{
+  EVENT_LOG_EVENTS(EVENT_LOG_ENUM)
+  EVT_COUNT
+} EventLog_Id_t;
+#undef EVENT_LOG_ENUM
+
+/**
+  * @brief Register the drain task. Call once after UTIL_ADV_TRACE_Init().
+  */
+void EventLog_Init(void);
+
+/**
+  * @brief  Record an event (any context, including interrupts of any priority)
+  * @note   Constant time: reserves a slot, copies the arguments and schedules the
+  *         drain task. No formatting or I/O is done here.
+  * @param  id event
+  * @param  arg0 first argument of the message
+  * @param  arg1 second argument of the message
+  */
+void EventLog_Push(EventLog_Id_t id, int32_t arg0, int32_t arg1);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __EVENT_LOG_H__ */
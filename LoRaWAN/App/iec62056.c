@@ -0,0 +1,299 @@
+/*
+ * iec62056.c
+ * IEC 62056-21 mode C message helpers: identification parsing, baud rate
+ * identification and acknowledgement/option select message.
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "iec62056.h"
+
+/* IEC62056_Check_t states */
+#define BCC_IDLE     0U  /* waiting for SOH/STX */
+#define BCC_BLOCK    1U  /* accumulating up to ETX/EOT */
+#define BCC_CHECK    2U  /* next byte is the BCC */
+
+#define CRC_IDLE     0U  /* waiting for '/' as first char */
+#define CRC_DATA     1U  /* accumulating up to '!' */
+#define CRC_DIGITS   2U  /* reading the 4 hex digits after '!' */
+#define CRC_OFF      3U  /* frame did not start with '/' */
+#define CRC_LINE     4U  /* as CRC_DATA, at the start of a line (where '!' ends the data) */
+
+/**
+  * @brief  Baud rate of a mode C baud rate identification character
+  * @param  baud_id 'Z' character of the identification message
+  * @retval baud rate, 0 if baud_id is not a mode C identifier
+  */
+uint32_t IEC62056_BaudRate(char baud_id)
+{
+  static const uint32_t baud_table[] = { 300U, 600U, 1200U, 2400U, 4800U, 9600U, 19200U };
+
+  if (baud_id < '0' || baud_id > '6')
+  {
+    return 0U;
+  }
+  return baud_table[baud_id - '0'];
+}
+
+/**
+  * @brief  Parse the identification message sent by the meter after the sign-on
+  * @note   Accepts the optional enhanced identification "\W" after the baud rate id.
+  *         Anything else (e.g. the echo of our own "/?!" request) is rejected.
+  * @param  line received line, starting with '/' (CR LF optional)
+  * @param  len length of line
+  * @param  ident output
+  * @retval true if line is a mode C identification message
+  */
+bool IEC62056_ParseIdent(const char *line, uint16_t len, IEC62056_Ident_t *ident)
+{
+  uint16_t pos = 5;
+  uint8_t n = 0;
+
+  while (len > 0 && (line[len - 1] == '\r' || line[len - 1] == '\n'))
+  {
+    len--;
+  }
+  if (len < 5 || line[0] != '/')
+  {
+    return false;
+  }
+
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    char c = line[1 + i];
+    if (!((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')))
+    {
+      return false;
+    }
+    ident->manufacturer[i] = c;
+  }
+  ident->manufacturer[3] = '\0';
+
+  ident->baud_id = line[4];
+  if (IEC62056_BaudRate(ident->baud_id) == 0U)
+  {
+    return false;
+  }
+
+  if (len >= pos + 2 && line[pos] == '\\')
+  {
+    pos += 2;
+  }
+
+  while (pos < len && n < IEC62056_IDENT_MAX)
+  {
+    ident->ident[n++] = line[pos++];
+  }
+  ident->ident[n] = '\0';
+
+  return true;
+}
+
+/**
+  * @brief  Build the acknowledgement/option select message (normal protocol procedure)
+  * @param  buf output, at least IEC62056_ACK_LEN bytes
+  * @param  baud_id baud rate to switch to, same coding as the identification message
+  * @param  mode IEC62056_MODE_READOUT or IEC62056_MODE_PROGRAMMING
+  * @retval number of bytes written
+  */
+uint8_t IEC62056_BuildAck(uint8_t *buf, char baud_id, char mode)
+{
+  buf[0] = IEC62056_ACK;
+  buf[1] = '0';
+  buf[2] = (uint8_t)baud_id;
+  buf[3] = (uint8_t)mode;
+  buf[4] = '\r';
+  buf[5] = '\n';
+  return IEC62056_ACK_LEN;
+}
+
+/**
+  * @brief  Block check character: XOR of the bytes after SOH/STX up to and including ETX
+  * @param  data first byte covered by the BCC
+  * @param  len number of bytes
+  * @retval BCC
+  */
+uint8_t IEC62056_Bcc(const uint8_t *data, uint16_t len)
+{
+  uint8_t bcc = 0;
+
+  for (uint16_t i = 0; i < len; i++)
+  {
+    bcc ^= data[i];
+  }
+  return bcc;
+}
+
+/**
+  * @brief  Build a programming mode command message: SOH C D [STX data] ETX BCC
+  * @param  buf output
+  * @param  size size of buf
+  * @param  command two characters command and command type (e.g. "R5", IEC62056_CMD_BREAK)
+  * @param  data data set (e.g. "1.8.0()"), NULL for commands without data (break)
+  * @retval number of bytes written, 0 if buf is too small
+  */
+uint16_t IEC62056_BuildCommand(uint8_t *buf, uint16_t size, const char *command, const char *data)
+{
+  size_t data_len = (data != NULL) ? strlen(data) : 0U;
+  uint16_t len = 0;
+
+  if ((size_t)size < data_len + 6U)
+  {
+    return 0;
+  }
+
+  buf[len++] = IEC62056_SOH;
+  buf[len++] = (uint8_t)command[0];
+  buf[len++] = (uint8_t)command[1];
+  if (data != NULL)
+  {
+    buf[len++] = IEC62056_STX;
+    memcpy(&buf[len], data, data_len);
+    len += (uint16_t)data_len;
+  }
+  buf[len++] = IEC62056_ETX;
+  buf[len] = IEC62056_Bcc(&buf[1], (uint16_t)(len - 1));
+  len++;
+  return len;
+}
+
+/**
+  * @brief  CRC-16 (polynomial 0x8005 reflected, as used by the "!XXXX" frame trailer)
+  * @param  crc current CRC (0 at frame start)
+  * @param  byte next byte
+  * @retval updated CRC
+  */
+uint16_t IEC62056_Crc16(uint16_t crc, uint8_t byte)
+{
+  crc ^= byte;
+  for (uint8_t bit = 0; bit < 8; bit++)
+  {
+    crc = (crc & 1U) ? (uint16_t)((crc >> 1) ^ 0xA001U) : (uint16_t)(crc >> 1);
+  }
+  return crc;
+}
+
+/**
+  * @brief  Start checking a new frame or message
+  * @param  check checker
+  */
+void IEC62056_CheckReset(IEC62056_Check_t *check)
+{
+  check->bcc_state = BCC_IDLE;
+  check->bcc = 0;
+  check->crc_state = CRC_IDLE;
+  check->crc_digits = 0;
+  check->crc = 0;
+  check->crc_rx = 0;
+}
+
+/**
+  * @brief  Feed one received byte (constant work, safe from the UART interrupt)
+  * @param  check checker
+  * @param  byte received byte (parity removed)
+  * @retval @ref IEC62056_CheckResult_t
+  */
+IEC62056_CheckResult_t IEC62056_CheckFeed(IEC62056_Check_t *check, uint8_t byte)
+{
+  IEC62056_CheckResult_t result = IEC62056_CHECK_PENDING;
+
+  switch (check->bcc_state)
+  {
+    case BCC_IDLE:
+      if (byte == IEC62056_SOH || byte == IEC62056_STX)
+      {
+        check->bcc = 0;
+        check->bcc_state = BCC_BLOCK;
+      }
+      break;
+    case BCC_BLOCK:
+      check->bcc ^= byte;
+      if (byte == IEC62056_ETX || byte == IEC62056_EOT)
+      {
+        check->bcc_state = BCC_CHECK;
+      }
+      break;
+    default:
+      result = (byte == check->bcc) ? IEC62056_CHECK_OK : IEC62056_CHECK_ERROR;
+      check->bcc_state = BCC_IDLE;
+      return result;
+  }
+
+  switch (check->crc_state)
+  {
+    case CRC_IDLE:
+      if (byte == '/')
+      {
+        check->crc = IEC62056_Crc16(0, byte);
+        check->crc_state = CRC_DATA;
+      }
+      else if (byte != '\r' && byte != '\n')
+      {
+        check->crc_state = CRC_OFF;
+      }
+      break;
+    case CRC_DATA:
+    case CRC_LINE:
+      check->crc = IEC62056_Crc16(check->crc, byte);
+      if (byte == '!' && check->crc_state == CRC_LINE)
+      {
+        check->crc_digits = 0;
+        check->crc_rx = 0;
+        check->crc_state = CRC_DIGITS;
+      }
+      else
+      {
+        /* A '!' inside a line (e.g. a corrupted digit) is data */
+        check->crc_state = (byte == '\n') ? CRC_LINE : CRC_DATA;
+      }
+      break;
+    case CRC_DIGITS:
+    {
+      uint8_t nibble;
+
+      if (byte >= '0' && byte <= '9')
+      {
+        nibble = (uint8_t)(byte - '0');
+      }
+      else if (byte >= 'A' && byte <= 'F')
+      {
+        nibble = (uint8_t)(byte - 'A' + 10);
+      }
+      else if (byte >= 'a' && byte <= 'f')
+      {
+        nibble = (uint8_t)(byte - 'a' + 10);
+      }
+      else
+      {
+        /* '!' without CRC */
+        check->crc_state = CRC_OFF;
+        break;
+      }
+      check->crc_rx = (uint16_t)((check->crc_rx << 4) | nibble);
+      if (++check->crc_digits == 4U)
+      {
+        result = (check->crc_rx == check->crc) ? IEC62056_CHECK_OK : IEC62056_CHECK_ERROR;
+        check->crc_state = CRC_OFF;
+      }
+      break;
+    }
+    default:
+      break;
+  }
+
+  return result;
+}
+
+/**
+  * @brief  Tell whether a check is in progress (end of frame must wait for it)
+  * @note   A frame starting with '/' may carry a CRC after its '!', so it stays open
+  *         until then even if the decoder already has its last register.
+  * @param  check checker
+  * @retval true between SOH/STX and the BCC, or between '/' and the last CRC digit
+  */
+bool IEC62056_CheckOpen(const IEC62056_Check_t *check)
+{
+  return (check->bcc_state != BCC_IDLE) || (check->crc_state == CRC_DATA) || (check->crc_state == CRC_LINE) ||
+         (check->crc_state == CRC_DIGITS);
+}
@@ -0,0 +1,104 @@
+/*
+ * iec62056.h
+ * IEC 62056-21 (mode C) message helpers used by the meter session in meter_link.c.
+ * This file is outside CubeMX-managed files so it won't be overwritten.
+ */
+#ifndef __IEC62056_H__
+#define __IEC62056_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Control characters */
+#define IEC62056_SOH  0x01U
+#define IEC62056_STX  0x02U
+#define IEC62056_ETX  0x03U
+#define IEC62056_EOT  0x04U
+#define IEC62056_ACK  0x06U
+#define IEC62056_NAK  0x15U
+
+/**
+  * @brief Sign-on request (no device address), sent at IEC62056_INITIAL_BAUD
+  */
+#define IEC62056_SIGN_ON          "/?!\r\n"
+
+/**
+  * @brief Baud rate of the opening sequence
+  */
+#define IEC62056_INITIAL_BAUD     300U
+
+/* Mode control character of the acknowledgement/option select message */
+#define IEC62056_MODE_READOUT     '0'
+#define IEC62056_MODE_PROGRAMMING '1'
+
+/**
+  * @brief Length of the acknowledgement/option select message: ACK V Z Y CR LF
+  */
+#define IEC62056_ACK_LEN          6U
+
+/**
+  * @brief Break message (programming mode exit): SOH B 0 ETX
+  */
+#define IEC62056_CMD_BREAK        "B0"
+
+/**
+  * @brief Longest identification accepted (without manufacturer and baud rate id)
+  */
+#define IEC62056_IDENT_MAX        16U
+
+/**
+  * @brief Result of IEC62056_CheckFeed()
+  */
+typedef enum
+{
+  IEC62056_CHECK_PENDING,  /* no block closed by this byte */
+  IEC62056_CHECK_OK,       /* BCC (or CRC) of the block just closed matches */
+  IEC62056_CHECK_ERROR,    /* BCC (or CRC) mismatch */
+} IEC62056_CheckResult_t;
+
+/**
+  * @brief Incremental integrity check of received messages
+  * @note  BCC: XOR from the char after the first SOH/STX up to ETX/EOT, compared with
+  *        the next byte. CRC (optional): CRC-16 from '/' up to the '!' that starts a
+  *        line, followed by 4 hex digits; frames whose '!' is not followed by hex
+  *        digits carry no CRC.
+  */
+typedef struct
+{
+  uint8_t  bcc_state;
+  uint8_t  bcc;
+  uint8_t  crc_state;
+  uint8_t  crc_digits;
+  uint16_t crc;
+  uint16_t crc_rx;
+} IEC62056_Check_t;
+
+/**
+  * @brief Identification message "/XXXZ<ident>CR LF" sent by the meter after the sign-on
+  */
+typedef struct
+{
+  char manufacturer[4];              /* XXX, NUL terminated */
+  char baud_id;                      /* Z, '0'..'6' in mode C */
+  char ident[IEC62056_IDENT_MAX + 1];
+} IEC62056_Ident_t;
+
+uint32_t IEC62056_BaudRate(char baud_id);
+bool IEC62056_ParseIdent(const char *line, uint16_t len, IEC62056_Ident_t *ident);
+uint8_t IEC62056_BuildAck(uint8_t *buf, char baud_id, char mode);
+uint8_t IEC62056_Bcc(const uint8_t *data, uint16_t len);
+uint16_t IEC62056_BuildCommand(uint8_t *buf, uint16_t size, const char *command, const char *data);
+uint16_t IEC62056_Crc16(uint16_t crc, uint8_t byte);
+void IEC62056_CheckReset(IEC62056_Check_t *check);
+IEC62056_CheckResult_t IEC62056_CheckFeed(IEC62056_Check_t *check, uint8_t byte);
+bool IEC62056_CheckOpen(const IEC62056_Check_t *check);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IEC62056_H__ */
@@ -41,11 +41,49 @@
 #include <string.h>
 #include "stm32_timer.h"  // Necesario para UTIL_TIMER_Object_t
 #include "stm32_systime.h" // Para SysTimeGet() - timestamp sincronizado
-#include "obis_helpers.h"
+#include "meter_timing.h"
+#include "utilities.h"     // randr(): jitter del backoff
+#include "event_log.h"     // Registro de eventos desde interrupciones (callbacks de timers y EXTI)
+#include "meter_store.h"   // Lecturas no enviadas guardadas en Flash
+#include "LoRaMac.h"        // LoRaMacQueryTxPossible(): payload maximo con el DR actual
+#include "power_profile.h"  // Consumo por estado (TLV 0x09)
+#include "clock_profile.h"  // Velocidad completa para cifrado y radio
+#include "meter_payload.h"  // Tabla de registros y codificacion TLV del payload
+#include "device_config.h"  // Comandos de configuracion por downlink
 
 #define METER_MAX_RETRIES 8
+/* Read timeout until the meter timing is learned, and upper bound of the learned one */
 #define METER_READ_TIMEOUT 7000
-#define METER_EXPECTED_BYTES 276
+/* Learned timing is written to Flash every this many successful reads */
+#define METER_TIMING_SAVE_EVERY 16U
+/* 1: keep USART1 armed between reports when the meter only pushes its frames, caching the newest one.
+   The armed port allows Stop1 at most: with such a meter Stop2 is never entered */
+#define METER_BACKGROUND_CAPTURE 1
+/* A cached reading younger than this is sent without reading the meter again (ms) */
+#define METER_CACHE_MAX_AGE 300000U
+/* Readings stored while the link was down are resent one frame every this many ms */
+#define METER_BACKLOG_INTERVAL 30000U
+/* TLV id of the capture time (SysTime seconds, 4 bytes) in resent readings */
+#define TLV_ID_TIMESTAMP 0x06
+#define BACKLOG_HEADER_SIZE 5U
+/* Fields of a TLV report that do not fit the current datarate follow in another frame, this many ms
+   after the report */
+#define REPORT_SPILL_DELAY 5000U
+/* FOpts bytes of the LinkCheckReq added to every LINK_CHECK_INTERVAL-th report */
+#define LINK_CHECK_REQ_SIZE 1U
+/* Batch size used until one is set by downlink, 1 = one reading per uplink */
+#define METER_BATCH_DEFAULT 1U
+/* TLV id of a batch: count, base time (4 bytes), then per reading offset (2 bytes), mask, values */
+#define TLV_ID_BATCH 0x07
+#define BATCH_HEADER_SIZE 6U
+#define BATCH_MAX_OFFSET 0xFFFFU
+/* Report-by-exception: battery change (%) that must be exceeded to report it again */
+#define REPORT_BATTERY_DEADBAND 5U
+/* Charge accounting (TLV 0x09): accounted time (4 bytes) and charge of each power domain
+   (3 bytes, 10 uAh units) since boot, every this many uplinks in the first one it fits in */
+#define TLV_ID_POWER 0x09
+#define POWER_TLV_SIZE (5U + 3U * POWER_DOMAIN_COUNT)
+#define POWER_REPORT_INTERVAL 96U
 
 /* Button detection timing constants */
 #define BUTTON_DEBOUNCE_MS      50    /* Debounce to avoid bouncing */
@@ -56,23 +94,10 @@
 /* Downlink configuration */
 #define CONFIG_PORT  85
 
-/* Command IDs */
-#define CMD_SET_REPORTING_INTERVAL  0xFF03
-#define CMD_RESET                   0xFF10
-#define CMD_FACTORY_RESET_LORAWAN   0xFF99  // Factory reset LoRaWAN NVM
-
-/* Command payload sizes */
-#define CMD_0xFF03_SIZE  4  // FF 03 + 2 bytes (LSB, MSB)
-#define CMD_0xFF10_SIZE  3  // FF 10 + 1 byte (0xFF)
-#define CMD_0xFF99_SIZE  3  // FF 99 FF
-
 /* Link Check connectivity detection */
 #define LINK_CHECK_INTERVAL         10  // Send Link Check every N uplinks
 #define MAX_LINK_CHECK_FAILURES      5  // Force rejoin after N consecutive failures
 
-/* Configuration magic byte */
-#define CONFIG_MAGIC  0xC5
-
 extern void RequestMeterRead(uint8_t attempt);
 /* USER CODE END Includes */
 
@@ -81,7 +106,6 @@ extern void RequestMeterRead(uint8_t attempt);
 extern volatile uint8_t meter_data_ready;
 extern volatile uint8_t button_pressed;
 extern UTIL_TIMER_Object_t LedTimer;
-extern char uart_rx_buffer[];
 /* USER CODE END EV */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -116,14 +140,24 @@ typedef enum ButtonState_e
 } ButtonState_t;
 
 /**
-  * @brief Device configuration structure
+  * @brief Value of each field as last reported
+  */
+typedef struct ReportedValues_s
+{
+  uint32_t value[REPORT_FIELD_COUNT];
+  uint16_t mask;                       /* Bit n: value[n] is known */
+} ReportedValues_t;
+
+/**
+  * @brief Decoded meter reading with its capture time
   */
-typedef struct
+typedef struct MeterReading_s
 {
-  uint32_t reporting_interval_ms;  /* 0 = use APP_TX_DUTYCYCLE */
-  uint8_t config_valid;             /* CONFIG_MAGIC if valid */
-  uint8_t reserved[3];              /* Padding for alignment */
-} DeviceConfig_t;
+  OBIS_Value_t values[METER_REG_COUNT];
+  uint32_t     timestamp;  /* SysTime seconds at capture */
+  uint32_t     tick;       /* UTIL_TIMER time at capture (ms), for the age */
+  bool         valid;
+} MeterReading_t;
 
 /* USER CODE END PTD */
 
@@ -156,6 +190,14 @@ typedef struct
 /* Device config Flash address - use a separate page from LoRaWAN NVM */
 #define DEVICE_CONFIG_FLASH_ADDRESS ((void *)0x0803E000UL)
 
+/* Meter timing history, same page as the device config (FLASH_IF_Write keeps the rest of the page) */
+#define METER_TIMING_FLASH_ADDRESS ((void *)0x0803E100UL)
+
+/* Unsent meter readings: ring of METER_STORE_PAGES pages right below the device config page.
+   The FLASH region of STM32WLE5JCIX_FLASH.ld ends at the start of the ring: keep both in step */
+#define METER_STORE_PAGES 8U
+#define METER_STORE_FLASH_ADDRESS ((void *)(0x0803E000UL - METER_STORE_PAGES * FLASH_PAGE_SIZE))
+
 #ifndef LED_PERIOD_TIME
 #define LED_PERIOD_TIME 200U
 #endif
@@ -293,14 +335,41 @@ static void OnTxTimerLedEvent(void *context);
 static void OnRxTimerLedEvent(void *context);
 static void OnJoinTimerLedEvent(void *context);
 static void OnMeterTimeoutTimerEvent(void *context);
+static void OnMeterRetryTimerEvent(void *context);
 static void StartMeterReading(void);
+static void StartMeterTimeout(void);
+static void ScheduleMeterRetry(void);
+static void RecordMeterTiming(void);
+static bool GetMeterValue(MeterRegister_t reg, int32_t *value);
+static uint8_t GetMaxPayloadSize(void);
+static uint8_t GetReportPayloadSize(void);
+static LmHandlerErrorStatus_t SendFrame(LmHandlerAppData_t *appData, LmHandlerMsgTypes_t isTxConfirmed);
+static void LmHandlerProcessFullSpeed(void);
+static uint8_t EncodePowerReport(uint8_t *buffer, uint8_t max_len);
+static uint8_t GetBatchSize(void);
+static bool HoldMeterReading(void);
+static uint8_t EncodeMeterBatch(uint8_t *buffer, uint8_t max_len);
+static bool StoreFlashRead(uint32_t address, void *data, uint32_t size);
+static bool StoreFlashProgram(uint32_t address, const void *data, uint32_t size);
+static bool StoreFlashErase(uint32_t page_address);
+static void StoreUnsentReading(void);
+static void SendMeterBacklog(void);
+static void OnMeterBacklogTimerEvent(void *context);
+static void ScheduleMeterBacklog(UTIL_TIMER_Time_t delay);
+static void CacheMeterReading(void);
+static bool UseCachedMeterReading(void);
+static void RearmMeterCapture(void);
 static void SaveDeviceConfig(void);
 static void LoadDeviceConfig(void);
+static void SaveMeterTiming(void);
+static void LoadMeterTiming(void);
 static void OnButtonShortTimerEvent(void *context);
 static void OnButtonVeryLongTimerEvent(void *context);
 static void OnButtonDoubleTimerEvent(void *context);
 static void ProcessDownlinkCommand(uint8_t *payload, uint8_t size);
-static void SetReportingInterval(uint16_t interval_seconds);
+static bool ReportField(uint8_t field, uint32_t value, uint32_t deadband);
+static uint16_t SelectMeterFields(uint32_t *fields, const OBIS_Value_t *values);
+static void SendReportSpill(void);
 static void ApplyReportingInterval(void);
 static void PerformFactoryReset(void);
 static void RequestTimeSync(void);
@@ -414,9 +483,43 @@ static UTIL_TIMER_Object_t JoinLedTimer;
 static const char *slotStrings[] = { "NONE", "RX1", "RX2", "C", "P", "MULTI" };
 
 static UTIL_TIMER_Object_t MeterTimeoutTimer;
+static UTIL_TIMER_Object_t MeterRetryTimer;   // Espera (backoff) antes de un reintento
 static uint8_t meter_retry_count = 0;
-static char meter_data_buffer[512];  // Buffer local para datos del medidor
-static uint16_t meter_data_length = 0;
+
+/* Historial de tiempos de respuesta del medidor (guardado en Flash) */
+static MeterTiming_t meter_timing;
+static uint8_t meter_timing_unsaved = 0;
+
+static OBIS_Value_t meter_stream_values[METER_REG_COUNT];  // Escritos por el decodificador (ISR)
+static OBIS_Value_t meter_values[METER_REG_COUNT];         // Copia de la ultima trama valida
+static MeterReading_t meter_cache;                         // Ultima lectura valida (lectura o captura en segundo plano)
+
+/* Lecturas no enviadas (store-and-forward en Flash) */
+static MeterStore_t meter_store;
+static const MeterStore_Flash_t meter_store_flash =
+{
+  .read = StoreFlashRead,
+  .program = StoreFlashProgram,
+  .erase = StoreFlashErase,
+};
+static MeterReading_t meter_in_flight[METER_BATCH_MAX];    // Lecturas del ultimo uplink, se guardan si no llega
+static uint8_t meter_in_flight_count = 0;
+static MeterReading_t meter_batch[METER_BATCH_MAX];        // Lecturas esperando el uplink del lote (modo lote)
+static uint8_t meter_batch_count = 0;
+static MeterCompact_t meter_compact;                       // Keyframe confirmado (referencia de los deltas) y el que se envia
+
+/* Report-by-exception: ultimo valor de cada campo recibido por la red */
+static ReportedValues_t report_last;
+static ReportedValues_t report_sending;                    // Campos del uplink en curso
+static ReportedValues_t report_spill;                      // Campos del ultimo reporte que no cupieron con el DR
+static uint16_t report_spill_sending = 0;                  // Campos de report_spill en el uplink en curso
+static bool report_full = true;                            // Este uplink lleva todos los campos
+static uint8_t report_cycles = 0;                          // Uplinks desde el ultimo reporte completo
+static UTIL_TIMER_Object_t MeterBacklogTimer;              // Ritmo de reenvio de lecturas guardadas
+static bool backlog_in_flight = false;                     // El uplink en curso es una lectura guardada
+static uint16_t backlog_slot = 0;                          // Slot de la lectura guardada en curso
+static uint8_t backlog_reg = 0;                            // Primer registro aun no enviado de esa lectura
+static uint8_t backlog_next_reg = 0;                       // Primer registro no incluido en el uplink en curso
 
 /* Button state machine variables */
 static ButtonState_t button_state = BTN_IDLE;
@@ -430,7 +533,9 @@ static UTIL_TIMER_Object_t ButtonDoubleTimer;      // 500ms timer
 static DeviceConfig_t device_config = {
   .reporting_interval_ms = 0,  // 0 = use APP_TX_DUTYCYCLE
   .config_valid = 0,
-  .reserved = {0}
+  .batch_size = 0,             // 0 = METER_BATCH_DEFAULT
+  .payload_format = PAYLOAD_FORMAT_TLV,
+  .report_refresh = 0          // 0 = every field in every uplink
 };
 
 /* Pending reset flag: set when reset command is received, executed after next uplink */
@@ -447,6 +552,7 @@ static uint32_t join_failure_count = 0;
 
 /* Link Check connectivity detection */
 static uint8_t uplink_counter_for_link_check = 0;
+static uint8_t power_report_cycles = 0;  // Uplinks desde el ultimo TLV de consumo
 static uint8_t link_check_pending = 0;
 static uint8_t link_check_failures = 0;
 
@@ -468,47 +574,55 @@ void LoRaWAN_NotifyMeterDataReady(void)
   {
     UTIL_TIMER_Stop(&MeterTimeoutTimer);
     
-    // Validar que sean exactamente 276 bytes
-    if (uart_rx_index != METER_EXPECTED_BYTES)
+    // Validar integridad (BCC/CRC verificado al recibir); la longitud de la trama puede variar
+    if (MeterUart_GetFrameCheck() == METER_FRAME_CORRUPT)
     {
-      APP_LOG(TS_ON, VLEVEL_M, "ERROR: Datos incorrectos (%d bytes, esperados %d). Reintentando...\r\n", uart_rx_index, METER_EXPECTED_BYTES);
+      const MeterLineStats_t *line = MeterUart_GetLineStats();
+      APP_LOG(TS_ON, VLEVEL_M, "ERROR: Trama corrupta (%d bytes). Reintentando...\r\n", uart_rx_index);
+      APP_LOG(TS_ON, VLEVEL_M, "Linea medidor: ok=%u corruptas=%u PE=%u FE=%u NE=%u ORE=%u pausa=%u\r\n",
+              (unsigned int)line->good_frames, (unsigned int)line->corrupt_frames,
+              (unsigned int)line->parity_errors, (unsigned int)line->framing_errors,
+              (unsigned int)line->noise_errors, (unsigned int)line->overrun_errors,
+              (unsigned int)line->gap_timeouts);
       
       // Reintentar si no hemos agotado los intentos
       if (meter_retry_count < METER_MAX_RETRIES)
       {
-        meter_retry_count++;
-        RequestMeterRead(meter_retry_count);
-        UTIL_TIMER_Start(&MeterTimeoutTimer);
+        ScheduleMeterRetry();
       }
       else
       {
         // Agoté reintentos con datos incorrectos
         APP_LOG(TS_ON, VLEVEL_M, "Maximos reintentos alcanzados con datos incorrectos.\r\n");
-        HAL_UART_AbortReceive_IT(&huart1);
+        RearmMeterCapture();
         meter_data_ready = 0;
         UTIL_SEQ_SetTask((1 << CFG_SEQ_Task_LoRaSendOnTxTimerOrButtonEvent), CFG_SEQ_Prio_0);
       }
       return;
     }
     
-    // Copiar datos del buffer UART al buffer local antes de que se borren
-    if (uart_rx_index < sizeof(meter_data_buffer))
-    {
-      memcpy(meter_data_buffer, uart_rx_buffer, uart_rx_index);
-      meter_data_buffer[uart_rx_index] = '\0';  // Asegurar terminación
-      meter_data_length = uart_rx_index;
-      meter_data_ready = 1;
-      APP_LOG(TS_ON, VLEVEL_M, "Datos de medidor recibidos (%d bytes). Iniciando envio LoRaWAN.\r\n", meter_data_length);
-      UTIL_SEQ_SetTask((1 << CFG_SEQ_Task_LoRaSendOnTxTimerOrButtonEvent), CFG_SEQ_Prio_0);
-    }
-    else
-    {
-      APP_LOG(TS_ON, VLEVEL_M, "ERROR: Datos del medidor demasiado grandes (%d bytes)\r\n", uart_rx_index);
-    }
+    // Los registros ya fueron decodificados durante la recepcion: solo copiar los valores
+    CacheMeterReading();
+    memcpy(meter_values, meter_cache.values, sizeof(meter_values));
+    meter_data_ready = 1;
+    RecordMeterTiming();
+    APP_LOG(TS_ON, VLEVEL_M, "Datos de medidor recibidos (%d bytes @ %u Bd, %s). Iniciando envio LoRaWAN.\r\n",
+            uart_rx_index, (unsigned int)huart1.Init.BaudRate,
+            (MeterUart_GetFrameCheck() == METER_FRAME_VERIFIED) ? "BCC OK" : "sin BCC");
+    RearmMeterCapture();
+    UTIL_SEQ_SetTask((1 << CFG_SEQ_Task_LoRaSendOnTxTimerOrButtonEvent), CFG_SEQ_Prio_0);
+  }
+  else if (MeterUart_GetFrameCheck() != METER_FRAME_CORRUPT && MeterUart_GetReadMode() == METER_READ_PASSIVE)
+  {
+    // Trama enviada por el medidor entre reportes: guardar la mas reciente
+    CacheMeterReading();
+    APP_LOG(TS_ON, VLEVEL_M, "Trama de medidor en segundo plano guardada (%d bytes).\r\n", uart_rx_index);
+    RearmMeterCapture();
   }
   else
   {
     APP_LOG(TS_ON, VLEVEL_M, "Datos de medidor recibidos inesperadamente (ignorado).\r\n");
+    RearmMeterCapture();
   }
 }
 /* USER CODE END EF */
@@ -558,6 +672,8 @@ void LoRaWAN_Init(void)
   UTIL_TIMER_Create(&RxLedTimer, LED_PERIOD_TIME, UTIL_TIMER_ONESHOT, OnRxTimerLedEvent, NULL);
   UTIL_TIMER_Create(&JoinLedTimer, LED_PERIOD_TIME, UTIL_TIMER_PERIODIC, OnJoinTimerLedEvent, NULL);
   UTIL_TIMER_Create(&MeterTimeoutTimer, METER_READ_TIMEOUT, UTIL_TIMER_ONESHOT, OnMeterTimeoutTimerEvent, NULL);
+  UTIL_TIMER_Create(&MeterRetryTimer, METER_TIMING_BACKOFF_BASE, UTIL_TIMER_ONESHOT, OnMeterRetryTimerEvent, NULL);
+  UTIL_TIMER_Create(&MeterBacklogTimer, METER_BACKLOG_INTERVAL, UTIL_TIMER_ONESHOT, OnMeterBacklogTimerEvent, NULL);
   
   // Button detection timers
   UTIL_TIMER_Create(&ButtonShortTimer, BUTTON_SHORT_MAX_MS, UTIL_TIMER_ONESHOT, OnButtonShortTimerEvent, NULL);
@@ -567,6 +683,13 @@ void LoRaWAN_Init(void)
   // Time sync timer (delay after join to sync clock)
   UTIL_TIMER_Create(&TimeSyncTimer, TIME_SYNC_DELAY_MS, UTIL_TIMER_ONESHOT, OnTimeSyncTimerEvent, NULL);
 
+  // Decodificador OBIS alimentado por la recepcion UART; C.1.0 es el ultimo registro de la trama
+  OBIS_StreamInit(&meter_obis_stream, meter_registers, METER_REG_COUNT, meter_stream_values, "C.1.0");
+  MeterUart_Init();
+
+  // Reenvio de lecturas guardadas en Flash
+  UTIL_SEQ_RegTask((1 << CFG_SEQ_Task_MeterBacklog), UTIL_SEQ_RFU, SendMeterBacklog);
+
   /* USER CODE END LoRaWAN_Init_1 */
 
   UTIL_TIMER_Create(&StopJoinTimer, JOIN_TIME, UTIL_TIMER_ONESHOT, OnStopJoinTimerEvent, NULL);
@@ -586,6 +709,8 @@ void LoRaWAN_Init(void)
   LmHandlerConfigure(&LmHandlerParams);
 
   /* USER CODE BEGIN LoRaWAN_Init_2 */
+  /* The stack runs at full speed, the rest of the application at the low clock profile */
+  UTIL_SEQ_RegTask((1 << CFG_SEQ_Task_LmHandlerProcess), UTIL_SEQ_RFU, LmHandlerProcessFullSpeed);
   UTIL_TIMER_Start(&JoinLedTimer);
   
   /* Initialize Flash interface with RAM buffer for page backup */
@@ -594,6 +719,13 @@ void LoRaWAN_Init(void)
   /* Load device configuration from Flash and apply saved reporting interval */
   LoadDeviceConfig();
   ApplyReportingInterval();
+  LoadMeterTiming();
+
+  /* Rebuild the unsent readings ring from Flash */
+  MeterStore_Init(&meter_store, &meter_store_flash, (uint32_t)METER_STORE_FLASH_ADDRESS,
+                  METER_STORE_PAGES, FLASH_PAGE_SIZE);
+  APP_LOG(TS_ON, VLEVEL_M, "Lecturas pendientes en Flash: %u (capacidad %u)\r\n",
+          (unsigned int)MeterStore_Pending(&meter_store), (unsigned int)MeterStore_Capacity(&meter_store));
 
   /* USER CODE END LoRaWAN_Init_2 */
 
@@ -637,7 +769,7 @@ static void OnButtonShortTimerEvent(void *context)
     // Start very long timer (5s total)
     button_state = BTN_PRESSED;  // Keep state
     UTIL_TIMER_Start(&ButtonVeryLongTimer);
-    APP_LOG(TS_ON, VLEVEL_M, "Pulsación larga detectada (>1s)\r\n");
+    EventLog_Push(EVT_BUTTON_LONG, 0, 0);
   }
 }
 
@@ -666,7 +798,7 @@ static void OnButtonDoubleTimerEvent(void *context)
   // Timer expired without second press = it was a single short press
   if (button_state == BTN_WAIT_DOUBLE)
   {
-    APP_LOG(TS_ON, VLEVEL_M, "Pulsación corta - Iniciando lectura + envío LoRaWAN\r\n");
+    EventLog_Push(EVT_BUTTON_SHORT, 0, 0);
     button_state = BTN_IDLE;
     
     // Trigger meter read + LoRaWAN send cycle
@@ -687,7 +819,7 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
     last_power_sense_time = now;
     
     uint8_t state = HAL_GPIO_ReadPin(POWER_SENSE_GPIO_Port, POWER_SENSE_Pin);
-    APP_LOG(TS_ON, VLEVEL_M, "Network state changed to %d! Triggering read...\r\n", state);
+    EventLog_Push(EVT_POWER_SENSE, state, 0);
     
     UTIL_SEQ_SetTask((1 << CFG_SEQ_Task_LoRaSendOnTxTimerOrButtonEvent), CFG_SEQ_Prio_0);
     return;
@@ -721,14 +853,14 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
       // Start 1-second timer to detect if it becomes a long press
       UTIL_TIMER_Start(&ButtonShortTimer);
       
-      APP_LOG(TS_ON, VLEVEL_M, "Pulsador presionado\r\n");
+      EventLog_Push(EVT_BUTTON_PRESSED, 0, 0);
     }
     else if (button_state == BTN_WAIT_DOUBLE)
     {
       // Second press within double-press window = double press = RANGE TEST!
       UTIL_TIMER_Stop(&ButtonDoubleTimer);
       button_state = BTN_IDLE;
-      APP_LOG(TS_ON, VLEVEL_M, "Doble pulsación detectada - Test de alcance LoRaWAN\r\n");
+      EventLog_Push(EVT_BUTTON_DOUBLE, 0, 0);
       range_test_pending = 1;
       UTIL_SEQ_SetTask((1 << CFG_SEQ_Task_LoRaSendOnTxTimerOrButtonEvent), CFG_SEQ_Prio_0);
     }
@@ -752,13 +884,13 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
         // Wait to see if there's a second press
         button_state = BTN_WAIT_DOUBLE;
         UTIL_TIMER_Start(&ButtonDoubleTimer);
-        APP_LOG(TS_ON, VLEVEL_M, "Pulsador soltado - Esperando doble pulsación\r\n");
+        EventLog_Push(EVT_BUTTON_RELEASED, 0, 0);
       }
       else
       {
         // Between 1-5 seconds = long press
         button_state = BTN_IDLE;
-        APP_LOG(TS_ON, VLEVEL_M, "Pulsación larga (1-5s) - Reservado\r\n");
+        EventLog_Push(EVT_BUTTON_LONG_RELEASED, 0, 0);
       }
     }
   }
@@ -783,6 +915,9 @@ static void PerformFactoryReset(void)
   
   /* Erase LoRaWAN NVM context (one Flash page = 2KB) */
   FLASH_IF_Erase(LORAWAN_NVM_BASE_ADDRESS, FLASH_PAGE_SIZE);
+
+  /* Drop the unsent readings: they belong to the previous installation */
+  FLASH_IF_Erase(METER_STORE_FLASH_ADDRESS, METER_STORE_PAGES * FLASH_PAGE_SIZE);
   
   /* Reset device configuration to defaults */
   device_config.reporting_interval_ms = 0;
@@ -812,13 +947,13 @@ static void RequestTimeSync(void)
   */
 static void OnTimeSyncTimerEvent(void *context)
 {
-  APP_LOG(TS_ON, VLEVEL_M, "Requesting time synchronization from network server...\r\n");
+  EventLog_Push(EVT_TIME_SYNC_REQUEST, 0, 0);
   
   /* Request DeviceTimeReq MAC command - this will be piggybacked on next uplink */
   LmHandlerErrorStatus_t status = LmHandlerDeviceTimeReq();
   if (status != LORAMAC_HANDLER_SUCCESS)
   {
-    APP_LOG(TS_ON, VLEVEL_M, "Failed to request DeviceTimeReq\r\n");
+    EventLog_Push(EVT_TIME_SYNC_REQ_FAILED, 0, 0);
     return;
   }
   
@@ -831,14 +966,14 @@ static void OnTimeSyncTimerEvent(void *context)
   };
   
   /* Send the dummy uplink - the DeviceTimeReq will be included as a MAC command */
-  status = LmHandlerSend(&timeSyncData, LORAMAC_HANDLER_UNCONFIRMED_MSG, false);
+  status = SendFrame(&timeSyncData, LORAMAC_HANDLER_UNCONFIRMED_MSG);
   if (status == LORAMAC_HANDLER_SUCCESS)
   {
-    APP_LOG(TS_ON, VLEVEL_M, "Time sync request sent (dummy uplink on port 1)\r\n");
+    EventLog_Push(EVT_TIME_SYNC_SENT, 0, 0);
   }
   else
   {
-    APP_LOG(TS_ON, VLEVEL_M, "Failed to send time sync uplink (status=%d)\r\n", status);
+    EventLog_Push(EVT_TIME_SYNC_SEND_FAILED, status, 0);
   }
 }
 
@@ -879,93 +1014,106 @@ static void CheckPeriodicTimeSync(void)
   */
 static void ProcessDownlinkCommand(uint8_t *payload, uint8_t size)
 {
-  if (size < 2) 
-  {
-    APP_LOG(TS_ON, VLEVEL_M, "Invalid command size: %d\r\n", size);
-    return;
-  }
-  
-  // Command ID is Big-Endian (FF 03)
-  uint16_t cmd_id = (payload[0] << 8) | payload[1];
-  
-  APP_LOG(TS_ON, VLEVEL_M, "Received command: 0x%04X\r\n", cmd_id);
-  
-  switch (cmd_id)
+  switch (DeviceConfig_ApplyCommand(&device_config, payload, size))
   {
-    case CMD_SET_REPORTING_INTERVAL:
-      if (size >= CMD_0xFF03_SIZE)
+    case DEVICE_CONFIG_INTERVAL:
+      if (device_config.reporting_interval_ms == 0U)
       {
-        // Parameter is Little-Endian (LSB first)
-        uint16_t interval_seconds = (payload[3] << 8) | payload[2];
-        APP_LOG(TS_ON, VLEVEL_M, "Set interval: %d seconds\r\n", interval_seconds);
-        SetReportingInterval(interval_seconds);
+        APP_LOG(TS_ON, VLEVEL_M, "Reset to default interval\r\n");
       }
       else
       {
-        APP_LOG(TS_ON, VLEVEL_M, "Invalid 0xFF03 size: %d\r\n", size);
+        APP_LOG(TS_ON, VLEVEL_M, "New interval: %d ms\r\n", (int)device_config.reporting_interval_ms);
       }
+      // Save to Flash for persistence across resets, then apply immediately
+      SaveDeviceConfig();
+      ApplyReportingInterval();
       break;
-      
-    case CMD_RESET:
-      if (size >= CMD_0xFF10_SIZE && payload[2] == 0xFF)
-      {
-        /* Schedule reset after next uplink completes.
-           This ensures the ACK reaches the server before we reboot,
-           preventing the server from retrying the reset command. */
-        APP_LOG(TS_ON, VLEVEL_M, "RESET command received - Will restart after uplink completes\r\n");
-        pending_reset = 1;
-      }
-      else
-      {
-        APP_LOG(TS_ON, VLEVEL_M, "Invalid 0xFF10 command\r\n");
-      }
+
+    case DEVICE_CONFIG_BATCH_SIZE:
+      /* Readings already held keep waiting: the new size applies from the next report */
+      APP_LOG(TS_ON, VLEVEL_M, "New batch size: %u readings per uplink\r\n", (unsigned int)GetBatchSize());
+      SaveDeviceConfig();
       break;
-      
-    case CMD_FACTORY_RESET_LORAWAN:
-      if (size >= CMD_0xFF99_SIZE && payload[2] == 0xFF)
-      {
-        APP_LOG(TS_ON, VLEVEL_M, "FACTORY RESET command received (0xFF99FF)\r\n");
-        PerformFactoryReset();
-      }
-      else
-      {
-        APP_LOG(TS_ON, VLEVEL_M, "Invalid 0xFF99 command\r\n");
-      }
+
+    case DEVICE_CONFIG_PAYLOAD_FORMAT:
+      /* Switching to the compact format starts with a keyframe */
+      MeterPayload_CompactReset(&meter_compact);
+      SaveDeviceConfig();
       break;
-      
+
+    case DEVICE_CONFIG_REPORT_REFRESH:
+      report_cycles = 0;
+      SaveDeviceConfig();
+      break;
+
+    case DEVICE_CONFIG_RESET:
+      /* Schedule reset after next uplink completes.
+         This ensures the ACK reaches the server before we reboot,
+         preventing the server from retrying the reset command. */
+      pending_reset = 1;
+      break;
+
+    case DEVICE_CONFIG_FACTORY_RESET:
+      PerformFactoryReset();
+      break;
+
     default:
-      APP_LOG(TS_ON, VLEVEL_M, "Unknown command: 0x%04X\r\n", cmd_id);
       break;
   }
 }
 
-
 /**
-  * @brief Set reporting interval
-  * @param interval_seconds Interval in seconds (0 = use default)
+  * @brief Report-by-exception: tell whether a field goes in this uplink
+  * @note  A field is sent in a full report, when the network has not received it
+  *        yet, or when it moved more than its deadband since it was last received.
+  * @param field ReportField_t or MeterRegister_t
+  * @param value value as sent
+  * @param deadband change to exceed
+  * @retval true to send the field
   */
-static void SetReportingInterval(uint16_t interval_seconds)
+static bool ReportField(uint8_t field, uint32_t value, uint32_t deadband)
 {
-  if (interval_seconds == 0)
+  uint16_t bit = (uint16_t)(1U << field);
+  uint32_t change;
+
+  if (!report_full && (report_last.mask & bit) != 0U)
   {
-    // Reset to default
-    device_config.reporting_interval_ms = 0;
-    device_config.config_valid = 0;
-    APP_LOG(TS_ON, VLEVEL_M, "Reset to default interval\r\n");
+    change = (value > report_last.value[field]) ? value - report_last.value[field] : report_last.value[field] - value;
+    if (change <= deadband)
+    {
+      return false;
+    }
   }
-  else
+  return true;
+}
+
+/**
+  * @brief Report-by-exception: registers that go in this uplink
+  * @param fields out: value of each register as sent (REPORT_FIELD_COUNT entries)
+  * @param values decoded registers (METER_REG_COUNT entries)
+  * @retval mask of the registers to send
+  */
+static uint16_t SelectMeterFields(uint32_t *fields, const OBIS_Value_t *values)
+{
+  uint16_t wanted = 0;
+
+  for (uint8_t reg = 0; reg < METER_REG_COUNT; reg++)
   {
-    device_config.reporting_interval_ms = (uint32_t)interval_seconds * 1000;
-    device_config.config_valid = CONFIG_MAGIC;
-    APP_LOG(TS_ON, VLEVEL_M, "New interval: %d ms\r\n", 
-            (int)device_config.reporting_interval_ms);
+    if (MeterPayload_GetEncoded(values, reg, &fields[reg]) && ReportField(reg, fields[reg], meter_tlv[reg].deadband))
+    {
+      wanted |= (uint16_t)(1U << reg);
+    }
   }
-  
-  // Save to Flash for persistence across resets
-  SaveDeviceConfig();
-  
-  // Apply immediately
-  ApplyReportingInterval();
+  return wanted;
+}
+
+/**
+  * @brief Readings per uplink currently configured
+  */
+static uint8_t GetBatchSize(void)
+{
+  return (device_config.batch_size != 0U) ? device_config.batch_size : (uint8_t)METER_BATCH_DEFAULT;
 }
 
 /**
@@ -1007,7 +1155,7 @@ static void SaveDeviceConfig(void)
 {
   FLASH_IF_StatusTypedef status;
   
-  /* DeviceConfig_t is 8 bytes (4+1+3), aligned to 64-bit for Flash write */
+  /* DeviceConfig_t is 8 bytes (4+1+1+1+1), aligned to 64-bit for Flash write */
   status = FLASH_IF_Write(DEVICE_CONFIG_FLASH_ADDRESS, (const void *)&device_config, sizeof(DeviceConfig_t));
   
   if (status == FLASH_IF_OK)
@@ -1029,24 +1177,105 @@ static void LoadDeviceConfig(void)
   
   FLASH_IF_Read((void *)&loaded_config, DEVICE_CONFIG_FLASH_ADDRESS, sizeof(DeviceConfig_t));
   
-  /* Validate loaded config */
-  if (loaded_config.config_valid == CONFIG_MAGIC && 
-      loaded_config.reporting_interval_ms > 0 &&
-      loaded_config.reporting_interval_ms < 86400000) /* Max 24 hours */
+  /* Validate loaded config; out of range fields fall back to their default */
+  if (DeviceConfig_Load(&device_config, &loaded_config))
   {
-    device_config = loaded_config;
-    APP_LOG(TS_ON, VLEVEL_M, "Device config loaded from Flash: interval=%d ms\r\n", 
-            (int)device_config.reporting_interval_ms);
+    APP_LOG(TS_ON, VLEVEL_M, "Device config loaded from Flash: interval=%d ms, batch=%u\r\n", 
+            (int)device_config.reporting_interval_ms, (unsigned int)GetBatchSize());
   }
   else
   {
     /* Invalid or empty config - use defaults */
-    device_config.reporting_interval_ms = 0;
-    device_config.config_valid = 0;
     APP_LOG(TS_ON, VLEVEL_M, "No valid config in Flash, using defaults\r\n");
   }
 }
 
+/**
+  * @brief Save the meter timing history to Flash
+  */
+static void SaveMeterTiming(void)
+{
+  FLASH_IF_StatusTypedef status;
+
+  /* MeterTiming_t is a multiple of 8 bytes, aligned to 64-bit for Flash write */
+  status = FLASH_IF_Write(METER_TIMING_FLASH_ADDRESS, (const void *)&meter_timing, sizeof(MeterTiming_t));
+  if (status == FLASH_IF_OK)
+  {
+    meter_timing_unsaved = 0;
+  }
+  else
+  {
+    APP_LOG(TS_ON, VLEVEL_M, "ERROR: Flash write failed (%d)\r\n", (int)status);
+  }
+}
+
+/**
+  * @brief Load the meter timing history from Flash
+  */
+static void LoadMeterTiming(void)
+{
+  FLASH_IF_Read((void *)&meter_timing, METER_TIMING_FLASH_ADDRESS, sizeof(MeterTiming_t));
+
+  if (MeterTiming_IsValid(&meter_timing))
+  {
+    APP_LOG(TS_ON, VLEVEL_M, "Tiempos del medidor cargados de Flash: %u lecturas, timeout=%u ms\r\n",
+            (unsigned int)MeterTiming_Samples(&meter_timing),
+            (unsigned int)MeterTiming_Timeout(&meter_timing, METER_READ_TIMEOUT));
+  }
+  else
+  {
+    MeterTiming_Reset(&meter_timing, 0);
+  }
+}
+
+/**
+  * @brief Add the timing of the read just completed to the history
+  * @note  Only reads requested by StartMeterReading() count: a frame captured in
+  *        background has no request time. The history restarts when the meter
+  *        serial number changes.
+  */
+static void RecordMeterTiming(void)
+{
+  const MeterReadTiming_t *timing = MeterUart_GetReadTiming();
+  int32_t serial;
+
+  if (timing->first_byte == 0U || timing->end == 0U)
+  {
+    return;
+  }
+
+  if (GetMeterValue(METER_REG_SERIAL, &serial) && (uint32_t)serial != meter_timing.serial)
+  {
+    if (meter_timing.serial != 0U)
+    {
+      APP_LOG(TS_ON, VLEVEL_M, "Medidor cambiado: reiniciando historial de tiempos\r\n");
+      MeterTiming_Reset(&meter_timing, (uint32_t)serial);
+    }
+    meter_timing.serial = (uint32_t)serial;
+  }
+
+  MeterTiming_AddSample(&meter_timing, timing->first_byte - timing->start, timing->end - timing->first_byte);
+  APP_LOG(TS_ON, VLEVEL_M, "Tiempos lectura: primer byte %u ms, trama %u ms\r\n",
+          (unsigned int)(timing->first_byte - timing->start), (unsigned int)(timing->end - timing->first_byte));
+#if (METER_DECODE_PROFILE == 1)
+  {
+    const MeterLineStats_t *line = MeterUart_GetLineStats();
+
+    if (line->decode_bytes > 0U && line->last_frame_cycles > 0U)
+    {
+      APP_LOG(TS_ON, VLEVEL_M, "Decodificacion: %u ciclos/trama, %u ciclos/byte (max %u tramas/s a %u MHz)\r\n",
+              (unsigned int)line->last_frame_cycles, (unsigned int)(line->decode_cycles / line->decode_bytes),
+              (unsigned int)(SystemCoreClock / line->last_frame_cycles), (unsigned int)(SystemCoreClock / 1000000U));
+    }
+  }
+#endif /* METER_DECODE_PROFILE == 1 */
+
+  if (++meter_timing_unsaved >= METER_TIMING_SAVE_EVERY)
+  {
+    SaveMeterTiming();
+  }
+}
+
 static void StartMeterReading(void)
 {
   meter_retry_count = 0;
@@ -1057,25 +1286,530 @@ static void StartMeterReading(void)
   RequestMeterRead(meter_retry_count);
   
   // Iniciar timer de timeout
+  StartMeterTimeout();
+}
+
+/**
+  * @brief Start the timeout of the current read attempt
+  * @note  The first attempt waits the time learned from the meter; every retry
+  *        doubles it, up to METER_READ_TIMEOUT, so a meter slower than usual still
+  *        gets its chance.
+  */
+static void StartMeterTimeout(void)
+{
+  uint32_t timeout = MeterTiming_Timeout(&meter_timing, METER_READ_TIMEOUT);
+
+  for (uint8_t attempt = 1; attempt < meter_retry_count && timeout < METER_READ_TIMEOUT; attempt++)
+  {
+    timeout *= 2U;
+  }
+  if (timeout > METER_READ_TIMEOUT)
+  {
+    timeout = METER_READ_TIMEOUT;
+  }
+
+  UTIL_TIMER_SetPeriod(&MeterTimeoutTimer, timeout);
   UTIL_TIMER_Start(&MeterTimeoutTimer);
 }
 
+/**
+  * @brief Retry the read after a jittered exponential backoff
+  * @note  Reception is stopped while waiting so a late answer to the failed
+  *        attempt is not taken as the answer to the next one.
+  */
+static void ScheduleMeterRetry(void)
+{
+  uint32_t delay = MeterTiming_Backoff(meter_retry_count, (uint32_t)randr(0, METER_TIMING_BACKOFF_MAX));
+
+  MeterUart_StopReceive();
+  meter_retry_count++;
+  EventLog_Push(EVT_METER_RETRY, meter_retry_count, (int32_t)delay);
+  UTIL_TIMER_SetPeriod(&MeterRetryTimer, delay);
+  UTIL_TIMER_Start(&MeterRetryTimer);
+}
+
+static void OnMeterRetryTimerEvent(void *context)
+{
+  RequestMeterRead(meter_retry_count);
+  StartMeterTimeout();
+}
+
+/**
+  * @brief Get a register of the last valid meter frame
+  * @param reg register index
+  * @param value decoded fixed-point value
+  * @retval true if the register was present in the frame
+  */
+static bool GetMeterValue(MeterRegister_t reg, int32_t *value)
+{
+  if (!meter_values[reg].valid)
+  {
+    return false;
+  }
+  *value = meter_values[reg].value;
+  return true;
+}
+
+/**
+  * @brief Largest application payload the next uplink can carry (current datarate
+  *        and pending MAC commands)
+  * @retval 0 if the MAC could not size the uplink (txInfo only filled on OK/LENGTH_ERROR)
+  */
+static uint8_t GetMaxPayloadSize(void)
+{
+  LoRaMacTxInfo_t txInfo = { 0 };
+  LoRaMacStatus_t status = LoRaMacQueryTxPossible(LORAWAN_APP_DATA_BUFFER_MAX_SIZE, &txInfo);
+
+  if (status == LORAMAC_STATUS_OK)
+  {
+    return LORAWAN_APP_DATA_BUFFER_MAX_SIZE;
+  }
+  if (status == LORAMAC_STATUS_LENGTH_ERROR)
+  {
+    return txInfo.MaxPossibleApplicationDataSize;
+  }
+  return 0;
+}
+
+/**
+  * @brief LmHandlerSend() at full speed: the frame is encrypted and the radio set up
+  *        inside the call
+  */
+static LmHandlerErrorStatus_t SendFrame(LmHandlerAppData_t *appData, LmHandlerMsgTypes_t isTxConfirmed)
+{
+  LmHandlerErrorStatus_t status;
+
+  ClockProfile_Request(CLOCK_CLIENT_LORAWAN);
+  status = LmHandlerSend(appData, isTxConfirmed, false);
+  ClockProfile_Release(CLOCK_CLIENT_LORAWAN);
+  return status;
+}
+
+/**
+  * @brief LmHandlerProcess() at full speed (CFG_SEQ_Task_LmHandlerProcess): received
+  *        frames are decrypted and joins and retransmissions are sent from it
+  */
+static void LmHandlerProcessFullSpeed(void)
+{
+  ClockProfile_Request(CLOCK_CLIENT_LORAWAN);
+  LmHandlerProcess();
+  ClockProfile_Release(CLOCK_CLIENT_LORAWAN);
+}
+
+/**
+  * @brief Payload left for the report: GetMaxPayloadSize() without the LinkCheckReq
+  *        added to this uplink when it is due
+  */
+static uint8_t GetReportPayloadSize(void)
+{
+  uint8_t max_payload = GetMaxPayloadSize();
+
+  if (uplink_counter_for_link_check + 1U >= LINK_CHECK_INTERVAL)
+  {
+    max_payload = (max_payload > LINK_CHECK_REQ_SIZE) ? (uint8_t)(max_payload - LINK_CHECK_REQ_SIZE) : 0U;
+  }
+  return max_payload;
+}
+
+/**
+  * @brief Charge accounting (TLV 0x09) every POWER_REPORT_INTERVAL uplinks
+  * @note  The figures are cumulative since boot: a lost frame only delays them, and
+  *        the server gets the average current (and the battery life) from any two.
+  *        If the TLV does not fit it stays due for the next report.
+  * @param buffer output
+  * @param max_len bytes left in the payload
+  * @retval bytes written
+  */
+static uint8_t EncodePowerReport(uint8_t *buffer, uint8_t max_len)
+{
+  PowerProfile_Summary_t summary;
+  uint8_t len = 0;
+
+  if (power_report_cycles < POWER_REPORT_INTERVAL)
+  {
+    power_report_cycles++;
+    return 0;
+  }
+  if (max_len < POWER_TLV_SIZE)
+  {
+    return 0;
+  }
+  power_report_cycles = 0;
+
+  PowerProfile_GetSummary(&summary);
+  PowerProfile_Log();
+
+  buffer[len++] = TLV_ID_POWER;
+  buffer[len++] = (uint8_t)(summary.seconds >> 24);
+  buffer[len++] = (uint8_t)(summary.seconds >> 16);
+  buffer[len++] = (uint8_t)(summary.seconds >> 8);
+  buffer[len++] = (uint8_t)summary.seconds;
+  for (uint8_t domain = 0; domain < POWER_DOMAIN_COUNT; domain++)
+  {
+    uint32_t charge = summary.charge[domain] / 10U;
+
+    if (charge > 0xFFFFFFU)
+    {
+      charge = 0xFFFFFFU;
+    }
+    buffer[len++] = (uint8_t)(charge >> 16);
+    buffer[len++] = (uint8_t)(charge >> 8);
+    buffer[len++] = (uint8_t)charge;
+  }
+  APP_LOG(TS_ON, VLEVEL_M, "TLV: 0x09 Consumo=%u s, %u uA promedio\r\n", (unsigned int)summary.seconds,
+          (unsigned int)summary.average);
+  return len;
+}
+
+/**
+  * @brief Batch mode: add the reading just taken to the batch
+  * @note  The batch is sent once it holds GetBatchSize() readings, or earlier when
+  *        one more reading of the same size would not fit the payload allowed by
+  *        the current datarate, or its time offset would not fit. If the batch is
+  *        full (readings left over by a smaller frame), the oldest one goes to the
+  *        Flash store.
+  * @retval true to hold the reading (no uplink this interval), false to send the batch now
+  */
+static bool HoldMeterReading(void)
+{
+  uint8_t entry[1U + 4U * METER_REG_COUNT];
+  uint32_t size = 4U + BATCH_HEADER_SIZE; /* Bateria y estado de red + cabecera del lote */
+  uint32_t entry_size = 0;
+  MeterReading_t *reading;
+
+  if (GetBatchSize() <= 1U && meter_batch_count == 0U)
+  {
+    return false;
+  }
+
+  if (meter_batch_count == METER_BATCH_MAX)
+  {
+    if (!MeterStore_Push(&meter_store, meter_batch[0].timestamp, meter_batch[0].values, METER_REG_COUNT))
+    {
+      APP_LOG(TS_ON, VLEVEL_M, "ERROR: no se pudo guardar la lectura en Flash\r\n");
+    }
+    memmove(&meter_batch[0], &meter_batch[1], sizeof(meter_batch[0]) * (METER_BATCH_MAX - 1U));
+    meter_batch_count--;
+  }
+  reading = &meter_batch[meter_batch_count++];
+  memcpy(reading->values, meter_values, sizeof(reading->values));
+  reading->timestamp = meter_cache.timestamp;
+  reading->valid = true;
+
+  for (uint8_t i = 0; i < meter_batch_count; i++)
+  {
+    entry_size = 2U + MeterPayload_EncodePacked(entry, meter_batch[i].values);
+    size += entry_size;
+  }
+
+  if (meter_batch_count >= GetBatchSize() || size + entry_size > GetReportPayloadSize() ||
+      reading->timestamp < meter_batch[0].timestamp ||
+      reading->timestamp - meter_batch[0].timestamp > BATCH_MAX_OFFSET)
+  {
+    return false;
+  }
+  APP_LOG(TS_ON, VLEVEL_M, "Lectura %u/%u del lote guardada (%u bytes)\r\n",
+          (unsigned int)meter_batch_count, (unsigned int)GetBatchSize(), (unsigned int)size);
+  return true;
+}
+
+/**
+  * @brief Encode the batch as TLV 0x07, as many readings as fit, oldest first
+  * @note  The readings encoded leave the batch for meter_in_flight; the rest wait
+  *        for the next uplink.
+  * @param buffer output
+  * @param max_len room in buffer
+  * @retval number of bytes written (0 if not even one reading fits)
+  */
+static uint8_t EncodeMeterBatch(uint8_t *buffer, uint8_t max_len)
+{
+  uint32_t base = meter_batch[0].timestamp;
+  uint8_t len = BATCH_HEADER_SIZE;
+  uint8_t count = 0;
+
+  while (count < meter_batch_count)
+  {
+    const MeterReading_t *reading = &meter_batch[count];
+    uint8_t entry[1U + 4U * METER_REG_COUNT];
+    uint8_t entry_size;
+    uint32_t offset = reading->timestamp - base;
+
+    if (reading->timestamp < base || offset > BATCH_MAX_OFFSET)
+    {
+      break;
+    }
+    entry_size = MeterPayload_EncodePacked(entry, reading->values);
+    if (len + 2U + entry_size > max_len)
+    {
+      break;
+    }
+    buffer[len++] = (uint8_t)(offset >> 8);
+    buffer[len++] = (uint8_t)offset;
+    memcpy(&buffer[len], entry, entry_size);
+    len += entry_size;
+    count++;
+  }
+  if (count == 0U)
+  {
+    return 0;
+  }
+
+  buffer[0] = TLV_ID_BATCH;
+  buffer[1] = count;
+  buffer[2] = (uint8_t)(base >> 24);
+  buffer[3] = (uint8_t)(base >> 16);
+  buffer[4] = (uint8_t)(base >> 8);
+  buffer[5] = (uint8_t)base;
+  APP_LOG(TS_ON, VLEVEL_M, "TLV: 0x07 Lote=%u lecturas desde t=%u (%u bytes)\r\n",
+          (unsigned int)count, (unsigned int)base, (unsigned int)len);
+
+  memcpy(meter_in_flight, meter_batch, sizeof(meter_batch[0]) * count);
+  meter_in_flight_count = count;
+  meter_batch_count -= count;
+  memmove(&meter_batch[0], &meter_batch[count], sizeof(meter_batch[0]) * meter_batch_count);
+  return len;
+}
+
+/**
+  * @brief Keep the frame just decoded as the latest meter reading
+  */
+static void CacheMeterReading(void)
+{
+  memcpy(meter_cache.values, meter_stream_values, sizeof(meter_cache.values));
+  meter_cache.timestamp = SysTimeGet().Seconds;
+  meter_cache.tick = UTIL_TIMER_GetCurrentTime();
+  meter_cache.valid = true;
+}
+
+/**
+  * @brief Use the cached reading for this report if it is fresh enough
+  * @retval true if meter_values now holds the cached reading
+  */
+static bool UseCachedMeterReading(void)
+{
+  uint32_t age;
+
+  if (!meter_cache.valid)
+  {
+    return false;
+  }
+  age = UTIL_TIMER_GetElapsedTime(meter_cache.tick);
+  if (age > METER_CACHE_MAX_AGE)
+  {
+    return false;
+  }
+  memcpy(meter_values, meter_cache.values, sizeof(meter_values));
+  APP_LOG(TS_ON, VLEVEL_M, "Usando lectura del medidor en cache (hace %u s)\r\n", (unsigned int)(age / 1000U));
+  return true;
+}
+
+/**
+  * @brief End of a meter read: keep USART1 armed for pushed frames, or stop it
+  * @note  Background capture only applies to a push-only meter: a mode C meter
+  *        sends nothing unless it is asked to, even after a read that fell back to
+  *        passive reception (sign-on missed), so its port is stopped and Stop2 allowed.
+  */
+static void RearmMeterCapture(void)
+{
+#if (METER_BACKGROUND_CAPTURE == 1)
+  if (MeterUart_PushOnly())
+  {
+    MeterUart_StartCapture();
+    return;
+  }
+#endif /* METER_BACKGROUND_CAPTURE == 1 */
+  MeterUart_StopReceive();
+}
+
+static bool StoreFlashRead(uint32_t address, void *data, uint32_t size)
+{
+  return FLASH_IF_Read(data, (const void *)address, size) == FLASH_IF_OK;
+}
+
+static bool StoreFlashProgram(uint32_t address, const void *data, uint32_t size)
+{
+  return FLASH_IF_Program((void *)address, data, size) == FLASH_IF_OK;
+}
+
+static bool StoreFlashErase(uint32_t page_address)
+{
+  return FLASH_IF_Erase((void *)page_address, FLASH_PAGE_SIZE) == FLASH_IF_OK;
+}
+
+/**
+  * @brief Keep the readings of the last uplink in Flash: they did not reach the network
+  */
+static void StoreUnsentReading(void)
+{
+  for (uint8_t i = 0; i < meter_in_flight_count; i++)
+  {
+    if (!MeterStore_Push(&meter_store, meter_in_flight[i].timestamp, meter_in_flight[i].values, METER_REG_COUNT))
+    {
+      APP_LOG(TS_ON, VLEVEL_M, "ERROR: no se pudo guardar la lectura en Flash\r\n");
+    }
+  }
+  if (meter_in_flight_count > 0U)
+  {
+    APP_LOG(TS_ON, VLEVEL_M, "Lecturas no enviadas guardadas en Flash (%u pendientes, %u perdidas)\r\n",
+            (unsigned int)MeterStore_Pending(&meter_store), (unsigned int)meter_store.dropped);
+    report_spill.mask = 0; /* La lectura completa se reenvia desde Flash */
+  }
+  meter_in_flight_count = 0;
+}
+
+static void ScheduleMeterBacklog(UTIL_TIMER_Time_t delay)
+{
+  UTIL_TIMER_Stop(&MeterBacklogTimer);
+  UTIL_TIMER_SetPeriod(&MeterBacklogTimer, delay);
+  UTIL_TIMER_Start(&MeterBacklogTimer);
+}
+
+static void OnMeterBacklogTimerEvent(void *context)
+{
+  UTIL_SEQ_SetTask((1 << CFG_SEQ_Task_MeterBacklog), CFG_SEQ_Prio_0);
+}
+
+/**
+  * @brief Send the fields left out of the last report (CFG_SEQ_Task_MeterBacklog)
+  * @note  Same TLVs as the report, without timestamp: the frame follows the report
+  *        by REPORT_SPILL_DELAY. Fields that still do not fit go in one more frame.
+  */
+static void SendReportSpill(void)
+{
+  LmHandlerErrorStatus_t status;
+  uint16_t packed;
+  uint8_t len;
+
+  len = MeterPayload_PackReport(AppData.Buffer, GetMaxPayloadSize(), report_spill.value, report_spill.mask, &packed);
+  if (len == 0U)
+  {
+    ScheduleMeterBacklog(METER_BACKLOG_INTERVAL); /* Ni un campo cabe con este DR */
+    return;
+  }
+  AppData.Port = LORAWAN_USER_APP_PORT;
+  AppData.BufferSize = len;
+
+  status = SendFrame(&AppData, LORAMAC_HANDLER_UNCONFIRMED_MSG);
+  if (status == LORAMAC_HANDLER_SUCCESS)
+  {
+    report_spill_sending = packed;
+    report_sending = report_spill;
+    report_sending.mask = packed;
+    APP_LOG(TS_ON, VLEVEL_M, "Enviando campos que no cupieron en el reporte (%u bytes)\r\n", (unsigned int)len);
+  }
+  else if (status == LORAMAC_HANDLER_DUTYCYCLE_RESTRICTED)
+  {
+    ScheduleMeterBacklog(MAX(LmHandlerGetDutyCycleWaitTime(), REPORT_SPILL_DELAY));
+  }
+  else
+  {
+    ScheduleMeterBacklog(METER_BACKLOG_INTERVAL);
+  }
+}
+
+/**
+  * @brief Resend the oldest stored reading (sequencer task)
+  * @note  Runs between periodic reports, one frame per METER_BACKLOG_INTERVAL so
+  *        live reports keep their airtime. The frame carries the capture time
+  *        (TLV 0x06) and as many registers as the current datarate allows; a
+  *        reading that does not fit in one frame continues in the next one. The
+  *        reading is marked as sent when the frame with its last register is
+  *        confirmed by the MAC. Fields left out of the last report go first.
+  */
+static void SendMeterBacklog(void)
+{
+  MeterStore_Record_t record;
+  OBIS_Value_t values[METER_REG_COUNT];
+  LmHandlerErrorStatus_t status;
+  uint16_t slot;
+  uint8_t max_len;
+  uint8_t len = 0;
+
+  if (!is_joined || LmHandlerJoinStatus() != LORAMAC_HANDLER_SET)
+  {
+    return; /* Se reanuda con el primer uplink confirmado tras el join */
+  }
+  if (LmHandlerIsBusy() || meter_retry_count > 0 || backlog_in_flight || report_spill_sending != 0U)
+  {
+    ScheduleMeterBacklog(METER_BACKLOG_INTERVAL);
+    return;
+  }
+  if (report_spill.mask != 0U)
+  {
+    SendReportSpill();
+    return;
+  }
+  if (!MeterStore_Peek(&meter_store, &record, &slot))
+  {
+    return;
+  }
+  if (slot != backlog_slot)
+  {
+    backlog_slot = slot; /* Otra lectura: la anterior se envio o se perdio al dar la vuelta el anillo */
+    backlog_reg = 0;
+  }
+
+  for (uint8_t reg = 0; reg < METER_REG_COUNT; reg++)
+  {
+    values[reg].value = (reg < METER_STORE_VALUES) ? record.values[reg] : 0;
+    values[reg].valid = (reg < METER_STORE_VALUES) && ((record.valid_mask & (1U << reg)) != 0U);
+  }
+
+  max_len = GetMaxPayloadSize();
+  if (max_len <= BACKLOG_HEADER_SIZE)
+  {
+    ScheduleMeterBacklog(METER_BACKLOG_INTERVAL); /* Ni la marca de tiempo cabe con este DR */
+    return;
+  }
+
+  AppData.Port = LORAWAN_USER_APP_PORT;
+  AppData.Buffer[len++] = TLV_ID_TIMESTAMP;
+  AppData.Buffer[len++] = (uint8_t)(record.timestamp >> 24);
+  AppData.Buffer[len++] = (uint8_t)(record.timestamp >> 16);
+  AppData.Buffer[len++] = (uint8_t)(record.timestamp >> 8);
+  AppData.Buffer[len++] = (uint8_t)record.timestamp;
+  backlog_next_reg = backlog_reg;
+  len += MeterPayload_EncodeTlv(&AppData.Buffer[len], values, &backlog_next_reg, (uint8_t)(max_len - len));
+  AppData.BufferSize = len;
+
+  if (len == BACKLOG_HEADER_SIZE && backlog_next_reg < METER_REG_COUNT)
+  {
+    ScheduleMeterBacklog(METER_BACKLOG_INTERVAL); /* Ni un registro cabe con este DR */
+    return;
+  }
+
+  status = SendFrame(&AppData, LORAMAC_HANDLER_UNCONFIRMED_MSG);
+  if (status == LORAMAC_HANDLER_SUCCESS)
+  {
+    backlog_in_flight = true;
+    APP_LOG(TS_ON, VLEVEL_M, "Reenviando lectura guardada #%u (t=%u, %u bytes, %u pendientes)\r\n",
+            (unsigned int)record.seq, (unsigned int)record.timestamp, (unsigned int)len,
+            (unsigned int)MeterStore_Pending(&meter_store));
+  }
+  else if (status == LORAMAC_HANDLER_DUTYCYCLE_RESTRICTED)
+  {
+    ScheduleMeterBacklog(MAX(LmHandlerGetDutyCycleWaitTime(), METER_BACKLOG_INTERVAL));
+  }
+  else
+  {
+    ScheduleMeterBacklog(METER_BACKLOG_INTERVAL);
+  }
+}
+
 static void OnMeterTimeoutTimerEvent(void *context)
 {
   if (meter_retry_count < METER_MAX_RETRIES)
   {
-    APP_LOG(TS_ON, VLEVEL_M, "Timeout lectura medidor. Reintentando (%d/%d)...\r\n", meter_retry_count, METER_MAX_RETRIES);
-    meter_retry_count++;
-    RequestMeterRead(meter_retry_count);
-    UTIL_TIMER_Start(&MeterTimeoutTimer);
+    EventLog_Push(EVT_METER_TIMEOUT, meter_retry_count, METER_MAX_RETRIES);
+    ScheduleMeterRetry();
   }
   else
   {
     // Se agotaron los reintentos
-    APP_LOG(TS_ON, VLEVEL_M, "Timeout lectura medidor. Maximos reintentos alcanzados. Enviando datos parciales.\r\n");
+    EventLog_Push(EVT_METER_GIVE_UP, 0, 0);
     
-    // Deshabilitar recepción UART hasta próxima solicitud
-    HAL_UART_AbortReceive_IT(&huart1);
+    // Deshabilitar recepción UART hasta próxima solicitud (salvo captura en segundo plano)
+    RearmMeterCapture();
     
     meter_data_ready = 0; // NO hay datos
     UTIL_SEQ_SetTask((1 << CFG_SEQ_Task_LoRaSendOnTxTimerOrButtonEvent), CFG_SEQ_Prio_0);
@@ -1253,9 +1987,13 @@ static void SendTxData(void)
   }
   
   if (meter_retry_count == 0) {
-      APP_LOG(TS_ON, VLEVEL_M, "Ciclo LoRaWAN: Iniciando lectura de medidor...\r\n");
-      StartMeterReading();
-      return; // Salimos para esperar a que termine la lectura
+      if (UseCachedMeterReading()) {
+          meter_data_ready = 1; // Lectura reciente en cache: no hace falta esperar al medidor
+      } else {
+          APP_LOG(TS_ON, VLEVEL_M, "Ciclo LoRaWAN: Iniciando lectura de medidor...\r\n");
+          StartMeterReading();
+          return; // Salimos para esperar a que termine la lectura
+      }
   }
   
   // Si llegamos aqui, es porque:
@@ -1272,44 +2010,64 @@ static void SendTxData(void)
   UTIL_TIMER_Time_t nextTxIn = 0;
   uint32_t payload_index = 0;
 
+  // Modo lote: la lectura espera en RAM hasta completar el lote
+  if (meter_data_ready && HoldMeterReading())
+  {
+    meter_data_ready = 0;
+    return;
+  }
+
   AppData.Port = LORAWAN_USER_APP_PORT;
 
+  // Una sola medicion ADC (VREFINT, bateria y temperatura) por reporte: el MAC responde
+  // DevStatusReq con la misma
+  SYS_UpdateMeasurement();
+  uint8_t bateria_level_lora = GetBatteryLevel();
+  uint8_t bateria_pct = 0xFF;
+  /* Convert LoRa battery level (1..254) to percentage (0..100).
+   Keep 0xFF as 'not measured' sentinel. */
+  if (bateria_level_lora == 0xFF)
+  {
+    bateria_pct = 0xFF;
+  }
+  else if (bateria_level_lora == 0)
+  {
+    bateria_pct = 0;
+  }
+  else
+  {
+    const uint16_t LORAWAN_MAX_BAT = 254U;
+    bateria_pct = (uint8_t)((((uint32_t)bateria_level_lora) * 100U + (LORAWAN_MAX_BAT/2U)) / LORAWAN_MAX_BAT);
+  }
+
   // Verificar si hay datos del medidor listos (y que no sea un envio forzado por error de lectura)
-  if (meter_data_ready) {
+  // Con lecturas en el lote se envian aunque la lectura de este intervalo haya fallado
+  if (meter_data_ready || meter_batch_count > 0) {
       APP_LOG(TS_ON, VLEVEL_M, "Construyendo payload TLV desde datos OBIS...\r\n");
 
-      // Variables temporales para parseo
-      float valor_float = 0.0f;
-      uint32_t valor_uint32 = 0;
-      bool parse_ok = false;
-
-    // ===== 0x02: Batería (%) - 1 byte =====
-    uint8_t bateria_level_lora = GetBatteryLevel();
-    uint8_t bateria_pct = 0xFF;
-    /* Convert LoRa battery level (1..254) to percentage (0..100).
-     Keep 0xFF as 'not measured' sentinel. */
-    if (bateria_level_lora == 0xFF)
-    {
-      bateria_pct = 0xFF;
-    }
-    else if (bateria_level_lora == 0)
-    {
-      bateria_pct = 0;
-    }
-    else
+    // Report-by-exception (formato TLV): solo los campos que cambiaron, y todo cada N uplinks
+    uint32_t report_values[REPORT_FIELD_COUNT];
+    uint16_t report_wanted = 0;
+    uint16_t report_packed = 0;
+    report_sending.mask = 0;
+    report_spill.mask = 0;  // Una lectura nueva reemplaza los campos pendientes de la anterior
+    report_full = (device_config.report_refresh <= 1U || meter_batch_count > 0 ||
+                   device_config.payload_format != PAYLOAD_FORMAT_TLV);
+    if (!report_full && ++report_cycles >= device_config.report_refresh)
     {
-      const uint16_t LORAWAN_MAX_BAT = 254U;
-      bateria_pct = (uint8_t)((((uint32_t)bateria_level_lora) * 100U + (LORAWAN_MAX_BAT/2U)) / LORAWAN_MAX_BAT);
+      report_full = true;
+      report_cycles = 0;
     }
-    AppData.Buffer[payload_index++] = 0x02;  // ID
-    AppData.Buffer[payload_index++] = bateria_pct;
-    if (bateria_pct == 0xFF)
-    {
-      APP_LOG(TS_ON, VLEVEL_M, "TLV: 0x02 Bateria=NA\r\n");
-    }
-    else
+
+    // Payload que admite el DR actual, descontando los comandos MAC pendientes (FOpts)
+    // y el LinkCheckReq que se agrega a este uplink si toca
+    uint8_t max_payload = GetReportPayloadSize();
+
+    // ===== 0x02: Batería (%) - 1 byte =====
+    report_values[REPORT_FIELD_BATTERY] = bateria_pct;
+    if (ReportField(REPORT_FIELD_BATTERY, bateria_pct, REPORT_BATTERY_DEADBAND))
     {
-      APP_LOG(TS_ON, VLEVEL_M, "TLV: 0x02 Bateria=%u%%\r\n", (unsigned int)bateria_pct);
+      report_wanted |= (uint16_t)(1U << REPORT_FIELD_BATTERY);
     }
 
     /* ===== 0x04: network_state (1 byte) - detect external 3.3V on PB5 ===== */
@@ -1319,129 +2077,81 @@ static void SendTxData(void)
       {
         net_state = 1; /* external 3.3V present */
       }
-      AppData.Buffer[payload_index++] = 0x04; /* ID */
-      AppData.Buffer[payload_index++] = net_state;
-      APP_LOG(TS_ON, VLEVEL_M, "TLV: 0x04 network_state=%u\r\n", (unsigned int)net_state);
-    }
-
-      // ===== 0x0A: Energía activa total (15.8.0) - 4 bytes en Wh =====
-      parse_ok = ParseOBISFloat(meter_data_buffer, "15.8.0(", &valor_float);
-    if (parse_ok && valor_float >= 0.0f && valor_float < 10000000.0f) {
-      uint32_t energia_kwh = (uint32_t)(valor_float);  // kWh a Wh
-      AppData.Buffer[payload_index++] = 0x0A;  // ID
-      AppData.Buffer[payload_index++] = (energia_kwh >> 24) & 0xFF;
-      AppData.Buffer[payload_index++] = (energia_kwh >> 16) & 0xFF;
-      AppData.Buffer[payload_index++] = (energia_kwh >> 8) & 0xFF;
-      AppData.Buffer[payload_index++] = energia_kwh & 0xFF;
-      APP_LOG(TS_ON, VLEVEL_M, "TLV: 0x0A Activa_Total=%u Wh\r\n", (unsigned int)energia_kwh);
-    }
-
-      // ===== 0x0B: Energía reactiva total (130.8.0) - 4 bytes en VArh =====
-      parse_ok = ParseOBISFloat(meter_data_buffer, "130.8.0(", &valor_float);
-    if (parse_ok && valor_float >= 0.0f && valor_float < 10000000.0f) {
-      uint32_t reactiva_kvarh = (uint32_t)(valor_float);  // kVArh a VArh
-      AppData.Buffer[payload_index++] = 0x0B;  // ID
-      AppData.Buffer[payload_index++] = (reactiva_kvarh >> 24) & 0xFF;
-      AppData.Buffer[payload_index++] = (reactiva_kvarh >> 16) & 0xFF;
-      AppData.Buffer[payload_index++] = (reactiva_kvarh >> 8) & 0xFF;
-      AppData.Buffer[payload_index++] = reactiva_kvarh & 0xFF;
-      APP_LOG(TS_ON, VLEVEL_M, "TLV: 0x0B Reactiva_Total=%u VArh\r\n", (unsigned int)reactiva_kvarh);
-    }
-
-      // ===== 0x28: Demanda máxima potencia (1.6.0) - 2 bytes en W =====
-      parse_ok = ParseOBISFloat(meter_data_buffer, "1.6.0(", &valor_float);
-    if (parse_ok && valor_float >= 0.0f && valor_float < 65.535f) {
-      uint16_t peak_demand_kw = (uint16_t)(valor_float);  // kW a W
-      AppData.Buffer[payload_index++] = 0x28;  // ID
-      AppData.Buffer[payload_index++] = (peak_demand_kw >> 8) & 0xFF;
-      AppData.Buffer[payload_index++] = peak_demand_kw & 0xFF;
-      APP_LOG(TS_ON, VLEVEL_M, "TLV: 0x28 Demanda_Max=%u W\r\n", (unsigned int)peak_demand_kw);
-    }
-
-      // ===== 0x3C: Energía activa consumida (1.8.0) - 4 bytes en Wh =====
-      parse_ok = ParseOBISFloat(meter_data_buffer, "1.8.0(", &valor_float);
-    if (parse_ok && valor_float >= 0.0f && valor_float < 10000000.0f) {
-      uint32_t consumida_kwh = (uint32_t)(valor_float);
-      AppData.Buffer[payload_index++] = 0x3C;  // ID
-      AppData.Buffer[payload_index++] = (consumida_kwh >> 24) & 0xFF;
-      AppData.Buffer[payload_index++] = (consumida_kwh >> 16) & 0xFF;
-      AppData.Buffer[payload_index++] = (consumida_kwh >> 8) & 0xFF;
-      AppData.Buffer[payload_index++] = consumida_kwh & 0xFF;
-      APP_LOG(TS_ON, VLEVEL_M, "TLV: 0x3C Activa_Consumida=%u Wh\r\n", (unsigned int)consumida_kwh);
-    }
-
-      // ===== 0x3D: Energía activa generada (2.8.0) - 4 bytes en Wh =====
-      parse_ok = ParseOBISFloat(meter_data_buffer, "2.8.0(", &valor_float);
-    if (parse_ok && valor_float >= 0.0f && valor_float < 10000000.0f) {
-      uint32_t generada_kwh = (uint32_t)(valor_float);
-      AppData.Buffer[payload_index++] = 0x3D;  // ID
-      AppData.Buffer[payload_index++] = (generada_kwh >> 24) & 0xFF;
-      AppData.Buffer[payload_index++] = (generada_kwh >> 16) & 0xFF;
-      AppData.Buffer[payload_index++] = (generada_kwh >> 8) & 0xFF;
-      AppData.Buffer[payload_index++] = generada_kwh & 0xFF;
-      APP_LOG(TS_ON, VLEVEL_M, "TLV: 0x3D Activa_Generada=%u Wh\r\n", (unsigned int)generada_kwh);
-    }
-
-      // ===== 0x3E: Energía reactiva consumida (3.8.0) - 4 bytes en VArh =====
-      parse_ok = ParseOBISFloat(meter_data_buffer, "3.8.0(", &valor_float);
-    if (parse_ok && valor_float >= 0.0f && valor_float < 10000000.0f) {
-      uint32_t reactiva_cons_kvarh = (uint32_t)(valor_float);
-      AppData.Buffer[payload_index++] = 0x3E;  // ID
-      AppData.Buffer[payload_index++] = (reactiva_cons_kvarh >> 24) & 0xFF;
-      AppData.Buffer[payload_index++] = (reactiva_cons_kvarh >> 16) & 0xFF;
-      AppData.Buffer[payload_index++] = (reactiva_cons_kvarh >> 8) & 0xFF;
-      AppData.Buffer[payload_index++] = reactiva_cons_kvarh & 0xFF;
-      APP_LOG(TS_ON, VLEVEL_M, "TLV: 0x3E Reactiva_Consumida=%u VArh\r\n", (unsigned int)reactiva_cons_kvarh);
+      report_values[REPORT_FIELD_NET_STATE] = net_state;
+      if (ReportField(REPORT_FIELD_NET_STATE, net_state, 0))
+      {
+        report_wanted |= (uint16_t)(1U << REPORT_FIELD_NET_STATE);
+      }
     }
 
-      // ===== 0x3F: Energía reactiva generada (4.8.0) - 4 bytes en VArh =====
-      parse_ok = ParseOBISFloat(meter_data_buffer, "4.8.0(", &valor_float);
-    if (parse_ok && valor_float >= 0.0f && valor_float < 10000000.0f) {
-      uint32_t reactiva_gen_kvarh = (uint32_t)(valor_float);
-      AppData.Buffer[payload_index++] = 0x3F;  // ID
-      AppData.Buffer[payload_index++] = (reactiva_gen_kvarh >> 24) & 0xFF;
-      AppData.Buffer[payload_index++] = (reactiva_gen_kvarh >> 16) & 0xFF;
-      AppData.Buffer[payload_index++] = (reactiva_gen_kvarh >> 8) & 0xFF;
-      AppData.Buffer[payload_index++] = reactiva_gen_kvarh & 0xFF;
-      APP_LOG(TS_ON, VLEVEL_M, "TLV: 0x3F Reactiva_Generada=%u VArh\r\n", (unsigned int)reactiva_gen_kvarh);
-    }
+      if (meter_batch_count > 0)
+      {
+        // ===== 0x07: Lote de lecturas (las que caben con el DR actual) =====
+        payload_index = MeterPayload_PackReport(AppData.Buffer, max_payload, report_values, report_wanted, &report_packed);
+        payload_index += EncodeMeterBatch(&AppData.Buffer[payload_index],
+                                          (max_payload > payload_index) ? (uint8_t)(max_payload - payload_index) : 0U);
+      }
+      else
+      {
+        if (device_config.payload_format == PAYLOAD_FORMAT_COMPACT)
+        {
+          // ===== 0x08: Registros comprimidos (keyframe o deltas), antes que bateria y estado si no cabe todo =====
+          payload_index = MeterPayload_EncodeCompact(&meter_compact, AppData.Buffer, meter_values, max_payload);
+          payload_index += MeterPayload_PackReport(&AppData.Buffer[payload_index],
+                                                   (max_payload > payload_index) ? (uint8_t)(max_payload - payload_index) : 0U,
+                                                   report_values, report_wanted, &report_packed);
+        }
+        else
+        {
+          // ===== Registros del medidor (0x0A..0x5A) por prioridad, los que no caben van en otro frame =====
+          report_wanted |= SelectMeterFields(report_values, meter_values);
+          payload_index = MeterPayload_PackReport(AppData.Buffer, max_payload, report_values, report_wanted, &report_packed);
+          if ((report_wanted & ~report_packed) != 0U)
+          {
+            memcpy(report_spill.value, report_values, sizeof(report_spill.value));
+            report_spill.mask = (uint16_t)(report_wanted & ~report_packed);
+            APP_LOG(TS_ON, VLEVEL_M, "Campos que no caben con el DR actual (%u bytes): se envian en otro frame\r\n",
+                    (unsigned int)max_payload);
+          }
+        }
 
-      // ===== 0x5A: Número de serie (C.1.0) - 4 bytes =====
-    parse_ok = ParseOBISUint32(meter_data_buffer, "C.1.0(", &valor_uint32);
-    if (parse_ok && valor_uint32 != 0) {
-      AppData.Buffer[payload_index++] = 0x5A;  // ID
-      AppData.Buffer[payload_index++] = (valor_uint32 >> 24) & 0xFF;
-      AppData.Buffer[payload_index++] = (valor_uint32 >> 16) & 0xFF;
-      AppData.Buffer[payload_index++] = (valor_uint32 >> 8) & 0xFF;
-      AppData.Buffer[payload_index++] = valor_uint32 & 0xFF;
-      APP_LOG(TS_ON, VLEVEL_M, "TLV: 0x5A Numero_Serie=%u\r\n", (unsigned int)valor_uint32);
-    }
+        // Conservar la lectura hasta saber si el uplink llego (si no, se guarda en Flash)
+        memcpy(meter_in_flight[0].values, meter_values, sizeof(meter_in_flight[0].values));
+        meter_in_flight[0].timestamp = meter_cache.timestamp;
+        meter_in_flight[0].valid = true;
+        meter_in_flight_count = 1;
+      }
 
+      memcpy(report_sending.value, report_values, sizeof(report_sending.value));
+      report_sending.mask = report_packed;
       AppData.BufferSize = payload_index;
       meter_data_ready = 0;
 
       APP_LOG(TS_ON, VLEVEL_M, "Payload TLV construido: %d bytes\r\n", payload_index);
 
+      if (payload_index == 0U)
+      {
+        if (report_wanted != 0U)
+        {
+          // Ni un campo cabe con este DR: la lectura se reenvia desde Flash
+          StoreUnsentReading();
+          ScheduleMeterBacklog(METER_BACKLOG_INTERVAL);
+        }
+        else
+        {
+          // Nada cambio: no hay uplink en este intervalo
+          APP_LOG(TS_ON, VLEVEL_M, "Report by exception: sin cambios, uplink omitido\r\n");
+        }
+        report_sending.mask = 0;
+        meter_in_flight_count = 0;
+        return;
+      }
+
   } else {
       // Sin datos del medidor, enviar solo batería
       APP_LOG(TS_ON, VLEVEL_M, "Sin datos del medidor (o fallo lectura), enviando solo bateria y estado\r\n");
     {
       /* Fallback: send battery + network_state */
-      uint8_t bateria_level_lora = GetBatteryLevel();
-      uint8_t bateria_pct = 0xFF;
-      const uint16_t LORAWAN_MAX_BAT = 254U;
-      if (bateria_level_lora == 0xFF)
-      {
-        bateria_pct = 0xFF;
-      }
-      else if (bateria_level_lora == 0)
-      {
-        bateria_pct = 0;
-      }
-      else
-      {
-        bateria_pct = (uint8_t)((((uint32_t)bateria_level_lora) * 100U + (LORAWAN_MAX_BAT/2U)) / LORAWAN_MAX_BAT);
-      }
       AppData.Buffer[0] = 0x02;  // ID Batería
       AppData.Buffer[1] = bateria_pct;
 
@@ -1467,6 +2177,14 @@ static void SendTxData(void)
     }
   }
 
+  // ===== 0x09: Consumo por estado, cada POWER_REPORT_INTERVAL uplinks si cabe con el DR actual =====
+  {
+    uint8_t max_len = GetReportPayloadSize();
+
+    AppData.BufferSize += EncodePowerReport(&AppData.Buffer[AppData.BufferSize],
+                                            (max_len > AppData.BufferSize) ? (uint8_t)(max_len - AppData.BufferSize) : 0U);
+  }
+
   if ((JoinLedTimer.IsRunning) && (LmHandlerJoinStatus() == LORAMAC_HANDLER_SET))
   {
     UTIL_TIMER_Stop(&JoinLedTimer);
@@ -1510,7 +2228,8 @@ skip_meter_reading:
     LmHandlerParams.IsTxConfirmed = LORAMAC_HANDLER_CONFIRMED_MSG;
   }
 
-  status = LmHandlerSend(&AppData, LmHandlerParams.IsTxConfirmed, false);
+  /* A compact keyframe (or part of one) is only used as reference once the network acknowledges it */
+  status = SendFrame(&AppData, (meter_compact.sending != 0U) ? LORAMAC_HANDLER_CONFIRMED_MSG : LmHandlerParams.IsTxConfirmed);
   if (LORAMAC_HANDLER_SUCCESS == status)
   {
     APP_LOG(TS_ON, VLEVEL_L, "SEND REQUEST\r\n");
@@ -1523,6 +2242,13 @@ skip_meter_reading:
       APP_LOG(TS_ON, VLEVEL_L, "Next Tx in  : ~%d second(s)\r\n", (nextTxIn / 1000));
     }
   }
+  if (LORAMAC_HANDLER_SUCCESS != status)
+  {
+    StoreUnsentReading();
+    MeterPayload_CompactSent(&meter_compact, false);
+    report_sending.mask = 0;
+    report_spill.mask = 0;
+  }
 
   /* Restore ADR, DR and confirmed state after range test */
   if (is_range_test)
@@ -1634,6 +2360,73 @@ static void OnTxData(LmHandlerTxParams_t *params)
           uplink_counter_for_link_check = 0;
           LmHandlerJoin(ActivationType, true);  // Force rejoin
         }
+        StoreUnsentReading(); /* Sin respuesta de la red: la lectura probablemente no llego */
+      }
+
+      if (params->Status != LORAMAC_EVENT_INFO_STATUS_OK ||
+          (params->MsgType == LORAMAC_HANDLER_CONFIRMED_MSG && params->AckReceived == 0))
+      {
+        StoreUnsentReading();
+      }
+      meter_in_flight_count = 0;
+
+      /* Report-by-exception: los campos enviados pasan a ser la referencia si el uplink salio */
+      if (report_sending.mask != 0U)
+      {
+        if (params->Status == LORAMAC_EVENT_INFO_STATUS_OK &&
+            (params->MsgType != LORAMAC_HANDLER_CONFIRMED_MSG || params->AckReceived != 0))
+        {
+          for (uint8_t field = 0; field < REPORT_FIELD_COUNT; field++)
+          {
+            if ((report_sending.mask & (1U << field)) != 0U)
+            {
+              report_last.value[field] = report_sending.value[field];
+            }
+          }
+          report_last.mask |= report_sending.mask;
+        }
+        report_sending.mask = 0;
+      }
+
+      /* Campos que no cupieron en el reporte: siguen en otro frame (si este no salio, se reintenta) */
+      if (report_spill_sending != 0U)
+      {
+        if (params->Status == LORAMAC_EVENT_INFO_STATUS_OK)
+        {
+          report_spill.mask &= (uint16_t)~report_spill_sending;
+        }
+        report_spill_sending = 0;
+      }
+      if (report_spill.mask != 0U)
+      {
+        ScheduleMeterBacklog(REPORT_SPILL_DELAY);
+      }
+
+      MeterPayload_CompactSent(&meter_compact,
+                               params->MsgType == LORAMAC_HANDLER_CONFIRMED_MSG && params->AckReceived != 0);
+
+      /* Lecturas guardadas: avanzar si el frame reenviado salio, y seguir mientras queden */
+      if (backlog_in_flight)
+      {
+        backlog_in_flight = false;
+        if (params->Status == LORAMAC_EVENT_INFO_STATUS_OK)
+        {
+          backlog_reg = backlog_next_reg;
+          if (backlog_reg >= METER_REG_COUNT)
+          {
+            MeterStore_MarkSent(&meter_store, backlog_slot);
+            backlog_reg = 0;
+          }
+        }
+        if (MeterStore_Pending(&meter_store) > 0U && report_spill.mask == 0U)
+        {
+          ScheduleMeterBacklog(METER_BACKLOG_INTERVAL);
+        }
+      }
+      else if (params->Status == LORAMAC_EVENT_INFO_STATUS_OK && link_check_failures == 0U &&
+               MeterStore_Pending(&meter_store) > 0U && !MeterBacklogTimer.IsRunning)
+      {
+        ScheduleMeterBacklog(METER_BACKLOG_INTERVAL);
       }
     }
   }
@@ -1856,7 +2649,9 @@ static void StopJoin(void)
       APP_LOG(TS_OFF, VLEVEL_M, "LmHandler switch to ABP mode\r\n");
     }
     LmHandlerConfigure(&LmHandlerParams);
+    ClockProfile_Request(CLOCK_CLIENT_LORAWAN);
     LmHandlerJoin(ActivationType, true);
+    ClockProfile_Release(CLOCK_CLIENT_LORAWAN);
     UTIL_TIMER_Start(&TxTimer);
   }
   UTIL_TIMER_Start(&StopJoinTimer);
@@ -0,0 +1,643 @@
+/*
+ * meter_link.c
+ * Meter frame reception and IEC 62056-21 mode C session (see meter_link.h).
+ * Called from the USART1 DMA, TX complete and error interrupts and from the
+ * session timer.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include "meter_link.h"
+#include "iec62056.h"
+
+/**
+  * @brief IEC 62056-21 mode C session states
+  */
+typedef enum
+{
+  METER_SESSION_IDLE,       /* passive reception, bytes go to the frame buffer */
+  METER_SESSION_SIGN_ON,    /* "/?!" sent at 300 Bd, waiting for the identification */
+  METER_SESSION_ACK,        /* ACK being sent, baud rate switched on TX complete */
+  METER_SESSION_READOUT,    /* data readout at the negotiated baud rate */
+  METER_SESSION_PROG_OPEN,  /* programming mode, waiting for the operand message (P0) */
+  METER_SESSION_PROG_READ,  /* read command sent, waiting for the data message */
+  METER_SESSION_BREAK,      /* break sent after a refused selective read, restart follows */
+  METER_SESSION_RESTART,    /* waiting for the meter to leave programming mode */
+} MeterSession_t;
+
+char  uart_rx_buffer[UART_BUFFER_SIZE];
+volatile uint16_t uart_rx_index = 0;
+volatile uint8_t uart_rx_complete = 0;
+
+/**
+  * @brief OBIS decoder fed byte by byte from the DMA events (registers set by the application)
+  */
+OBIS_Stream_t meter_obis_stream;
+
+static const MeterLink_Port_t *link_port;
+
+/**
+  * @brief BCC/CRC of the frame, computed as bytes are stored
+  */
+static IEC62056_Check_t meter_frame_check;
+static volatile MeterFrameCheck_t meter_frame_status = METER_FRAME_UNVERIFIED;
+
+static volatile MeterSession_t meter_session = METER_SESSION_IDLE;
+#if (METER_IEC_MODE_C == 1)
+static char meter_ident_line[32];
+static uint8_t meter_ident_len = 0;
+static uint8_t meter_ack_msg[IEC62056_ACK_LEN];
+static uint32_t meter_session_baud = IEC62056_INITIAL_BAUD;
+static char meter_session_mode = IEC62056_MODE_READOUT;
+static MeterReadMode_t meter_read_mode = METER_READ_PASSIVE;
+
+/**
+  * @brief Selective reads: the meter failed programming mode METER_IEC_SELECTIVE_ATTEMPTS times
+  *        in a row, full readouts except every METER_IEC_SELECTIVE_RETRY reads
+  */
+static uint8_t meter_selective_failures = 0; /* programming mode failures in a row */
+static uint8_t meter_readout_reads = 0;      /* full readouts since the last programming mode */
+
+/**
+  * @brief Push-only meter: no identification in METER_IEC_SIGN_ON_ATTEMPTS sign-ons and none
+  *        since boot. The sign-on is skipped, except every METER_IEC_SIGN_ON_RETRY reads
+  */
+static bool meter_push_only = false;
+static bool meter_identified = false;     /* an identification was received since boot */
+static uint8_t meter_sign_on_failures = 0; /* sign-ons in a row without identification */
+static uint8_t meter_push_reads = 0;       /* reads without sign-on since the last one */
+
+/**
+  * @brief Programming mode command being sent (read or break)
+  */
+static uint8_t meter_cmd_msg[32];
+static uint8_t meter_sel_step = 0;  /* register being read */
+static IEC62056_Check_t meter_msg_check; /* BCC of the programming mode message */
+static bool meter_msg_value = false;      /* '(' of the data message reached */
+#endif /* METER_IEC_MODE_C == 1 */
+
+static void MeterLink_ClearFrame(void);
+static void MeterLink_RestartRx(void);
+static bool MeterLink_Store(uint8_t byte);
+#if (METER_IEC_MODE_C == 1)
+static void MeterLink_StartSession(char mode);
+static bool MeterLink_SessionByte(uint8_t byte);
+static bool MeterLink_ProgByte(uint8_t byte);
+static bool MeterLink_SelectiveRead(void);
+static void MeterLink_SelectiveFailed(void);
+static bool MeterLink_SendRead(void);
+static void MeterLink_SendBreak(MeterSession_t next);
+static const char *MeterLink_SelectiveCode(uint8_t step);
+#endif /* METER_IEC_MODE_C == 1 */
+
+/**
+  * @brief  Bind the link to its serial port and timer. Call once at init.
+  * @param  port port operations, kept by reference
+  */
+void MeterLink_Init(const MeterLink_Port_t *port)
+{
+  link_port = port;
+}
+
+/**
+  * @brief  Empty frame: buffer, decoder and BCC/CRC check
+  */
+static void MeterLink_ClearFrame(void)
+{
+  uart_rx_index = 0;
+  uart_rx_buffer[0] = '\0';
+  uart_rx_complete = 0;
+  OBIS_StreamReset(&meter_obis_stream);
+  IEC62056_CheckReset(&meter_frame_check);
+  meter_frame_status = METER_FRAME_UNVERIFIED;
+}
+
+/**
+  * @brief  Start a read: empty frame, then the mode C session (or passive reception)
+  * @note   Clears uart_rx_buffer/uart_rx_index/uart_rx_complete.
+  */
+void MeterLink_StartRead(void)
+{
+  MeterLink_ClearFrame();
+
+#if (METER_IEC_MODE_C == 1)
+  if (meter_push_only && ++meter_push_reads < METER_IEC_SIGN_ON_RETRY)
+  {
+    meter_session = METER_SESSION_IDLE;
+    MeterLink_RestartRx();
+    return;
+  }
+  meter_push_reads = 0;
+  MeterLink_StartSession(MeterLink_SelectiveRead() ? IEC62056_MODE_PROGRAMMING : IEC62056_MODE_READOUT);
+#else
+  MeterLink_RestartRx();
+#endif /* METER_IEC_MODE_C == 1 */
+}
+
+/**
+  * @brief  Background capture between reads: passive reception of the pushed frames at
+  *         METER_PUSH_BAUD, without sign-on and without counting as a read
+  * @note   Clears uart_rx_buffer/uart_rx_index/uart_rx_complete.
+  */
+void MeterLink_StartCapture(void)
+{
+  MeterLink_ClearFrame();
+#if (METER_IEC_MODE_C == 1)
+  link_port->stop_timer();
+  link_port->set_baud(METER_PUSH_BAUD);
+  meter_session = METER_SESSION_IDLE;
+  meter_read_mode = METER_READ_PASSIVE;
+#endif /* METER_IEC_MODE_C == 1 */
+  MeterLink_RestartRx();
+}
+
+/**
+  * @brief  End the session (the caller stops the reception)
+  */
+void MeterLink_Stop(void)
+{
+#if (METER_IEC_MODE_C == 1)
+  link_port->stop_timer();
+#endif /* METER_IEC_MODE_C == 1 */
+  meter_session = METER_SESSION_IDLE;
+  uart_rx_complete = 0;
+}
+
+/**
+  * @brief  Received bytes, into the session or the frame buffer and the OBIS decoder
+  * @note   End of frame is reported by the decoder as soon as the closing byte arrives,
+  *         with every register already decoded.
+  * @param  data first byte of the chunk
+  * @param  size number of bytes
+  * @retval true once the frame is complete (uart_rx_complete)
+  */
+bool MeterLink_Receive(const uint8_t *data, uint16_t size)
+{
+  for (uint16_t i = 0; i < size && !uart_rx_complete; i++)
+  {
+    /* 7E1 (8 bits with parity): in DMA mode bit 7 holds the parity bit, the HAL only
+       masks it in IT mode */
+    uint8_t byte = data[i] & 0x7FU;
+
+#if (METER_IEC_MODE_C == 1)
+    if (MeterLink_SessionByte(byte))
+    {
+      continue;
+    }
+#endif /* METER_IEC_MODE_C == 1 */
+
+    if (MeterLink_Store(byte))
+    {
+      uart_rx_complete = 1;
+    }
+  }
+  uart_rx_buffer[uart_rx_index] = '\0';
+  return uart_rx_complete != 0U;
+}
+
+/**
+  * @brief  Transmission finished: switch the baud rate after the ACK, or wait after a break
+  */
+void MeterLink_TxComplete(void)
+{
+#if (METER_IEC_MODE_C == 1)
+  if (meter_session == METER_SESSION_ACK)
+  {
+    /* ACK fully on the line: the meter answers at the new baud rate */
+    link_port->set_baud(meter_session_baud);
+    if (meter_session_mode == IEC62056_MODE_PROGRAMMING)
+    {
+      IEC62056_CheckReset(&meter_msg_check);
+      meter_session = METER_SESSION_PROG_OPEN;
+      link_port->start_timer(METER_IEC_RESPONSE_TIMEOUT);
+    }
+    else
+    {
+      meter_session = METER_SESSION_READOUT;
+    }
+    MeterLink_RestartRx();
+  }
+  else if (meter_session == METER_SESSION_BREAK)
+  {
+    /* Refused selective read: full readout once the meter is back to 300 Bd */
+    meter_session = METER_SESSION_RESTART;
+    link_port->start_timer(METER_IEC_RESTART_DELAY);
+  }
+#endif /* METER_IEC_MODE_C == 1 */
+}
+
+/**
+  * @brief  Parity, framing, noise or overrun error, or a gap inside the frame
+  * @retval true if it failed the frame in progress (uart_rx_complete set, corrupt),
+  *         false if it came before the frame (reception restarted) or after it
+  */
+bool MeterLink_LineError(void)
+{
+  if (uart_rx_complete)
+  {
+    return false;
+  }
+
+  if (uart_rx_index > 0U)
+  {
+    /* Frame in progress: fail it now instead of waiting for the read timeout */
+#if (METER_IEC_MODE_C == 1)
+    if (meter_session == METER_SESSION_PROG_OPEN || meter_session == METER_SESSION_PROG_READ)
+    {
+      MeterLink_SendBreak(METER_SESSION_IDLE);
+    }
+#endif /* METER_IEC_MODE_C == 1 */
+    meter_frame_status = METER_FRAME_CORRUPT;
+    uart_rx_complete = 1;
+    return true;
+  }
+
+  /* Noise before the frame starts: keep listening */
+  MeterLink_RestartRx();
+  return false;
+}
+
+/**
+  * @brief  A mode C exchange is in progress (sign-on, ACK or command on the line, answer expected)
+  */
+bool MeterLink_SessionActive(void)
+{
+  return meter_session != METER_SESSION_IDLE;
+}
+
+MeterFrameCheck_t MeterLink_GetFrameCheck(void)
+{
+  return meter_frame_status;
+}
+
+/**
+  * @brief  The meter only pushes frames (no mode C, or no identification ever received)
+  */
+bool MeterLink_PushOnly(void)
+{
+#if (METER_IEC_MODE_C == 1)
+  return meter_push_only;
+#else
+  return true;
+#endif /* METER_IEC_MODE_C == 1 */
+}
+
+MeterReadMode_t MeterLink_GetReadMode(void)
+{
+#if (METER_IEC_MODE_C == 1)
+  return meter_read_mode;
+#else
+  return METER_READ_PASSIVE;
+#endif /* METER_IEC_MODE_C == 1 */
+}
+
+/**
+  * @brief  Restart the reception; only a readout streams without pauses, the session
+  *         messages wait for the reaction time of the meter
+  */
+static void MeterLink_RestartRx(void)
+{
+  link_port->start_rx(meter_session == METER_SESSION_IDLE || meter_session == METER_SESSION_READOUT);
+}
+
+/**
+  * @brief  Store one byte of the readout, feed it to the OBIS decoder and the BCC/CRC check
+  * @note   The frame ends on its BCC (or CRC) when it carries one, otherwise when the
+  *         decoder reaches its end code. A mismatch ends it at once as corrupt.
+  * @param  byte received byte
+  * @retval true at the end of the frame (status in meter_frame_status)
+  */
+static bool MeterLink_Store(uint8_t byte)
+{
+  bool decoded;
+
+  // Protección overflow: reiniciar captura, decodificador y verificación
+  if (uart_rx_index >= UART_BUFFER_SIZE - 1)
+  {
+    uart_rx_index = 0;
+    OBIS_StreamReset(&meter_obis_stream);
+    IEC62056_CheckReset(&meter_frame_check);
+  }
+
+  uart_rx_buffer[uart_rx_index++] = (char)byte;
+
+  decoded = OBIS_StreamFeed(&meter_obis_stream, byte);
+
+  switch (IEC62056_CheckFeed(&meter_frame_check, byte))
+  {
+    case IEC62056_CHECK_ERROR:
+      meter_frame_status = METER_FRAME_CORRUPT;
+      return true;
+    case IEC62056_CHECK_OK:
+      meter_frame_status = METER_FRAME_VERIFIED;
+      return true;
+    default:
+      return decoded && !IEC62056_CheckOpen(&meter_frame_check);
+  }
+}
+
+#if (METER_IEC_MODE_C == 1)
+/**
+  * @brief  Send the sign-on at 300 Bd and wait for the identification
+  * @param  mode IEC62056_MODE_READOUT (full readout) or IEC62056_MODE_PROGRAMMING (selective reads)
+  */
+static void MeterLink_StartSession(char mode)
+{
+  static const char sign_on[] = IEC62056_SIGN_ON;
+
+  link_port->stop_timer();
+  link_port->abort_tx();
+  link_port->set_baud(IEC62056_INITIAL_BAUD);
+  meter_session_mode = mode;
+  meter_read_mode = (mode == IEC62056_MODE_PROGRAMMING) ? METER_READ_SELECTIVE : METER_READ_READOUT;
+  meter_ident_len = 0;
+  meter_session = METER_SESSION_SIGN_ON;
+  MeterLink_RestartRx();
+  link_port->transmit((const uint8_t *)sign_on, sizeof(sign_on) - 1);
+  link_port->start_timer(METER_IEC_IDENT_TIMEOUT);
+}
+
+/**
+  * @brief  Mode C session handling of a received byte
+  * @param  byte received byte (parity removed)
+  * @retval true if the byte was consumed by the session (not part of a full readout)
+  */
+static bool MeterLink_SessionByte(uint8_t byte)
+{
+  IEC62056_Ident_t ident;
+  char baud_id;
+
+  switch (meter_session)
+  {
+    case METER_SESSION_SIGN_ON:
+      break;
+    case METER_SESSION_PROG_OPEN:
+    case METER_SESSION_PROG_READ:
+      return MeterLink_ProgByte(byte);
+    case METER_SESSION_IDLE:
+    case METER_SESSION_READOUT:
+      return false;
+    default:
+      return true;
+  }
+
+  if (byte == '/')
+  {
+    meter_ident_len = 0;
+  }
+  if (meter_ident_len < sizeof(meter_ident_line))
+  {
+    meter_ident_line[meter_ident_len++] = (char)byte;
+  }
+  if (byte != '\n')
+  {
+    return true;
+  }
+
+  /* Also discards the echo of "/?!" on half-duplex optical heads */
+  if (!IEC62056_ParseIdent(meter_ident_line, meter_ident_len, &ident))
+  {
+    meter_ident_len = 0;
+    return true;
+  }
+
+  link_port->stop_timer();
+  meter_identified = true;
+  meter_sign_on_failures = 0;
+  meter_push_only = false;
+  baud_id = (ident.baud_id > METER_IEC_MAX_BAUD_ID) ? METER_IEC_MAX_BAUD_ID : ident.baud_id;
+  meter_session_baud = IEC62056_BaudRate(baud_id);
+  IEC62056_BuildAck(meter_ack_msg, baud_id, meter_session_mode);
+  meter_session = METER_SESSION_ACK;
+  if (!link_port->transmit(meter_ack_msg, IEC62056_ACK_LEN))
+  {
+    /* No ACK: the meter keeps sending the readout at 300 Bd */
+    meter_session = METER_SESSION_READOUT;
+    meter_read_mode = METER_READ_READOUT;
+  }
+  return true;
+}
+
+/**
+  * @brief  Programming mode: operand message, then one data message per read command
+  * @note   The data set is fed to the OBIS decoder with the requested code, so meters
+  *         answering "(value)" only and those answering "code(value)" decode alike.
+  * @param  byte received byte (parity removed)
+  * @retval always true, programming mode bytes are handled here
+  */
+static bool MeterLink_ProgByte(uint8_t byte)
+{
+  if (byte == IEC62056_NAK)
+  {
+    /* Command refused (a break from the meter ends up in the response timeout) */
+    MeterLink_SelectiveFailed();
+    MeterLink_SendBreak(METER_SESSION_BREAK);
+    return true;
+  }
+
+  switch (IEC62056_CheckFeed(&meter_msg_check, byte))
+  {
+    case IEC62056_CHECK_ERROR:
+      /* Corrupted message: the frame is retried as a whole */
+      meter_frame_status = METER_FRAME_CORRUPT;
+      MeterLink_SendBreak(METER_SESSION_IDLE);
+      uart_rx_complete = 1;
+      return true;
+
+    case IEC62056_CHECK_OK:
+      /* BCC of the message checked: next command */
+      if (meter_session == METER_SESSION_PROG_READ)
+      {
+        meter_sel_step++;
+      }
+      else
+      {
+        meter_sel_step = 0;
+      }
+      if (!MeterLink_SendRead())
+      {
+        /* All registers read: leave programming mode, the frame is complete */
+        meter_frame_status = METER_FRAME_VERIFIED;
+        meter_selective_failures = 0;
+        MeterLink_SendBreak(METER_SESSION_IDLE);
+        uart_rx_complete = 1;
+      }
+      return true;
+
+    default:
+      break;
+  }
+
+  if (byte == IEC62056_ETX)
+  {
+    return true;
+  }
+
+  if (meter_session == METER_SESSION_PROG_READ)
+  {
+    if (!meter_msg_value && byte == '(')
+    {
+      const char *code = MeterLink_SelectiveCode(meter_sel_step);
+
+      meter_msg_value = true;
+      while (*code != '\0')
+      {
+        MeterLink_Store((uint8_t)*code++);
+      }
+    }
+    if (meter_msg_value)
+    {
+      MeterLink_Store(byte);
+    }
+  }
+  return true;
+}
+
+/**
+  * @brief  Whether this read uses programming mode
+  * @retval true for selective reads, false for the full readout
+  */
+static bool MeterLink_SelectiveRead(void)
+{
+#if (METER_IEC_SELECTIVE == 1)
+  if (meter_selective_failures < METER_IEC_SELECTIVE_ATTEMPTS)
+  {
+    return true;
+  }
+  if (++meter_readout_reads < METER_IEC_SELECTIVE_RETRY)
+  {
+    return false;
+  }
+  meter_readout_reads = 0;
+  return true;
+#else
+  return false;
+#endif /* METER_IEC_SELECTIVE == 1 */
+}
+
+/**
+  * @brief  Programming mode refused or not answered: one more failure in a row
+  */
+static void MeterLink_SelectiveFailed(void)
+{
+  if (meter_selective_failures < UINT8_MAX)
+  {
+    meter_selective_failures++;
+  }
+}
+
+/**
+  * @brief  Send the read command of the current register (meter_sel_step)
+  * @retval false if every register has been read
+  */
+static bool MeterLink_SendRead(void)
+{
+  const char *code = MeterLink_SelectiveCode(meter_sel_step);
+  char data[OBIS_STREAM_CODE_MAX + 3];
+  uint16_t len;
+
+  if (code == NULL)
+  {
+    return false;
+  }
+
+  snprintf(data, sizeof(data), "%s()", code);
+  len = IEC62056_BuildCommand(meter_cmd_msg, sizeof(meter_cmd_msg), METER_IEC_READ_COMMAND, data);
+  IEC62056_CheckReset(&meter_msg_check);
+  meter_msg_value = false;
+  meter_session = METER_SESSION_PROG_READ;
+  link_port->transmit(meter_cmd_msg, len);
+  link_port->start_timer(METER_IEC_RESPONSE_TIMEOUT);
+  return true;
+}
+
+/**
+  * @brief  Send the break message to leave programming mode
+  * @param  next METER_SESSION_IDLE when done, METER_SESSION_BREAK to restart with a full readout
+  */
+static void MeterLink_SendBreak(MeterSession_t next)
+{
+  uint16_t len = IEC62056_BuildCommand(meter_cmd_msg, sizeof(meter_cmd_msg), IEC62056_CMD_BREAK, NULL);
+
+  link_port->stop_timer();
+  link_port->abort_tx();
+  meter_session = next;
+  link_port->transmit(meter_cmd_msg, len);
+}
+
+/**
+  * @brief  OBIS code read at a given step of the selective read
+  * @note   The decoder end code (C.1.0) is read last as it completes the frame.
+  * @param  step index of the read command
+  * @retval OBIS code, NULL after the last register
+  */
+static const char *MeterLink_SelectiveCode(uint8_t step)
+{
+  const OBIS_Stream_t *stream = &meter_obis_stream;
+  const char *end_code = NULL;
+  uint8_t n = 0;
+
+  for (uint8_t i = 0; i < stream->register_count; i++)
+  {
+    const char *code = stream->registers[i].code;
+
+    if (stream->end_code != NULL && strcmp(code, stream->end_code) == 0)
+    {
+      end_code = code;
+      continue;
+    }
+    if (n++ == step)
+    {
+      return code;
+    }
+  }
+  return (n == step) ? end_code : NULL;
+}
+#endif /* METER_IEC_MODE_C == 1 */
+
+/**
+  * @brief  Session timer: no identification (fall back to pushed frames), no answer in
+  *         programming mode (fall back to full readout) or restart delay elapsed
+  */
+void MeterLink_Timeout(void)
+{
+#if (METER_IEC_MODE_C == 1)
+  switch (meter_session)
+  {
+    case METER_SESSION_SIGN_ON:
+      /* No identification: passive reception for the rest of this read. A meter that
+         identified once only missed this sign-on (optical head, busy); one that never did
+         after several reads in a row does not speak mode C */
+      link_port->abort_tx();
+      link_port->set_baud(METER_PUSH_BAUD);
+      meter_session = METER_SESSION_IDLE;
+      meter_read_mode = METER_READ_PASSIVE;
+      if (meter_sign_on_failures < UINT8_MAX)
+      {
+        meter_sign_on_failures++;
+      }
+      if (!meter_identified && meter_sign_on_failures >= METER_IEC_SIGN_ON_ATTEMPTS)
+      {
+        meter_push_only = true;
+      }
+      MeterLink_RestartRx();
+      break;
+
+    case METER_SESSION_PROG_OPEN:
+    case METER_SESSION_PROG_READ:
+      MeterLink_SelectiveFailed();
+      MeterLink_SendBreak(METER_SESSION_BREAK);
+      break;
+
+    case METER_SESSION_RESTART:
+      uart_rx_index = 0;
+      OBIS_StreamReset(&meter_obis_stream);
+      IEC62056_CheckReset(&meter_frame_check);
+      MeterLink_StartSession(IEC62056_MODE_READOUT);
+      break;
+
+    default:
+      break;
+  }
+#endif /* METER_IEC_MODE_C == 1 */
+}
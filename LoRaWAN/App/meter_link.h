@@ -0,0 +1,112 @@
+/*
+ * meter_link.h
+ * Meter port protocol without the HAL: frame reception (OBIS decoder and
+ * BCC/CRC check fed byte by byte) and the IEC 62056-21 mode C session
+ * (sign-on, baud rate switch, readout or selective reads in programming mode).
+ * usart_if.c binds it to USART1, its DMA and a UTIL_TIMER through
+ * MeterLink_Port_t; on the host test/meter_sim.c binds it to a pseudo terminal.
+ * This file is outside CubeMX-managed files so it won't be overwritten.
+ */
+#ifndef __METER_LINK_H__
+#define __METER_LINK_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "obis_stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UART_BUFFER_SIZE 512
+/* 1: active IEC 62056-21 mode C session (sign-on at 300 Bd, switch to the meter baud rate)
+   0: passive reception of the frames pushed by the meter at METER_PUSH_BAUD */
+#define METER_IEC_MODE_C 1
+/* Fastest baud rate id accepted in mode C ('0'=300 .. '6'=19200), limit of the optical head */
+#define METER_IEC_MAX_BAUD_ID '6'
+/* Time allowed for the identification message; the rest of the read is passive reception if it never comes */
+#define METER_IEC_IDENT_TIMEOUT 2500
+/* Reads in a row without identification, with none ever received, before the sign-on is skipped
+   (push-only meter); it is tried again every METER_IEC_SIGN_ON_RETRY reads */
+#define METER_IEC_SIGN_ON_ATTEMPTS 3
+#define METER_IEC_SIGN_ON_RETRY 16
+/* 1: read only the decoded registers in programming mode, full readout if the meter refuses */
+#define METER_IEC_SELECTIVE 1
+/* Programming mode failures in a row (NAK or no answer) before the reads fall back to the full
+   readout; programming mode is tried again every METER_IEC_SELECTIVE_RETRY reads */
+#define METER_IEC_SELECTIVE_ATTEMPTS 3
+#define METER_IEC_SELECTIVE_RETRY 16
+/* Read command and command type of the selective reads */
+#define METER_IEC_READ_COMMAND "R5"
+/* Maximum reaction time of the meter in programming mode (IEC 62056-21 tr max 1500 ms) */
+#define METER_IEC_RESPONSE_TIMEOUT 2000
+/* Delay after a break before signing on again */
+#define METER_IEC_RESTART_DELAY 500
+#define METER_PUSH_BAUD 2400
+
+/**
+  * @brief How the last meter frame was acquired
+  */
+typedef enum
+{
+  METER_READ_PASSIVE,    /* frame pushed by the meter */
+  METER_READ_READOUT,    /* mode C full data readout */
+  METER_READ_SELECTIVE,  /* mode C programming mode, one read command per register */
+} MeterReadMode_t;
+
+/**
+  * @brief Integrity of the last meter frame
+  */
+typedef enum
+{
+  METER_FRAME_UNVERIFIED,  /* frame without BCC/CRC, ended on the decoder end code */
+  METER_FRAME_VERIFIED,    /* BCC (or CRC) of every message matched */
+  METER_FRAME_CORRUPT,     /* BCC/CRC mismatch: retry the read */
+} MeterFrameCheck_t;
+
+/**
+  * @brief Serial port and timer of the meter link
+  */
+typedef struct
+{
+  /* Change the line speed; the reception is stopped */
+  void (*set_baud)(uint32_t baud);
+  /* (Re)start the reception from an empty ring. gap_timeout: a silence inside a frame
+     is reported as a line error (MeterLink_LineError()) */
+  void (*start_rx)(bool gap_timeout);
+  /* Send without blocking, MeterLink_TxComplete() once the last byte is on the line.
+     data stays valid until then. false if the transmission could not start */
+  bool (*transmit)(const uint8_t *data, uint16_t len);
+  void (*abort_tx)(void);
+  /* One shot timer, MeterLink_Timeout() when it expires */
+  void (*start_timer)(uint32_t timeout);
+  void (*stop_timer)(void);
+} MeterLink_Port_t;
+
+/**
+  * @brief Frame being received: bytes (NUL terminated), count and completion flag.
+  *        meter_obis_stream decodes the registers set by the application.
+  */
+extern char  uart_rx_buffer[UART_BUFFER_SIZE];
+extern volatile uint16_t uart_rx_index;
+extern volatile uint8_t uart_rx_complete;
+extern OBIS_Stream_t meter_obis_stream;
+
+void MeterLink_Init(const MeterLink_Port_t *port);
+void MeterLink_StartRead(void);
+void MeterLink_StartCapture(void);
+void MeterLink_Stop(void);
+bool MeterLink_Receive(const uint8_t *data, uint16_t size);
+void MeterLink_TxComplete(void);
+void MeterLink_Timeout(void);
+bool MeterLink_LineError(void);
+bool MeterLink_SessionActive(void);
+bool MeterLink_PushOnly(void);
+MeterFrameCheck_t MeterLink_GetFrameCheck(void);
+MeterReadMode_t MeterLink_GetReadMode(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __METER_LINK_H__ */
@@ -0,0 +1,403 @@
+/*
+ * meter_payload.c
+ * Register table and TLV encoders of the meter uplink (see meter_payload.h).
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "meter_payload.h"
+
+/* Trace of the encoded fields. A build without the firmware headers (host) can
+   define METER_PAYLOAD_LOG before compiling this file, empty or to printf */
+#ifndef METER_PAYLOAD_LOG
+#include "sys_app.h"
+#define METER_PAYLOAD_LOG(...) APP_LOG(TS_ON, VLEVEL_M, __VA_ARGS__)
+#endif /* METER_PAYLOAD_LOG */
+
+static void GetReportFieldTlv(uint8_t field, uint8_t *id, uint8_t *width);
+static uint8_t PutVarint(uint8_t *buffer, uint32_t value);
+
+/* Registros OBIS decodificados mientras llega la trama (decimales en punto fijo) */
+#define METER_FIELD_OBIS(reg, code, dec, id, width, div, min, max, band, name, unit) [reg] = { code, dec },
+const OBIS_Register_t meter_registers[METER_REG_COUNT] =
+{
+  METER_FIELDS(METER_FIELD_OBIS)
+};
+
+/* Codificacion TLV de cada registro, en el orden del payload */
+#define METER_FIELD_TLV(reg, code, dec, id, width, div, min, max, band, name, unit) [reg] = { min, max, band, div, id, width, name, unit },
+const MeterTlv_t meter_tlv[METER_REG_COUNT] =
+{
+  METER_FIELDS(METER_FIELD_TLV)
+};
+
+/* Campos del reporte TLV por prioridad: si no caben todos con el DR actual, entran primero estos */
+static const uint8_t report_priority[REPORT_FIELD_COUNT] =
+{
+  METER_REG_ACTIVE_TOTAL, METER_REG_ACTIVE_CONSUMED, METER_REG_ACTIVE_GENERATED,
+  REPORT_FIELD_BATTERY, REPORT_FIELD_NET_STATE,
+  METER_REG_REACTIVE_TOTAL, METER_REG_REACTIVE_CONSUMED, METER_REG_REACTIVE_GENERATED,
+  METER_REG_PEAK_DEMAND, METER_REG_SERIAL
+};
+
+/**
+  * @brief TLV id and value size of a report field
+  */
+static void GetReportFieldTlv(uint8_t field, uint8_t *id, uint8_t *width)
+{
+  if (field == REPORT_FIELD_BATTERY)
+  {
+    *id = 0x02;
+    *width = 1;
+  }
+  else if (field == REPORT_FIELD_NET_STATE)
+  {
+    *id = 0x04;
+    *width = 1;
+  }
+  else
+  {
+    *id = meter_tlv[field].id;
+    *width = meter_tlv[field].width;
+  }
+}
+
+/**
+  * @brief Write the TLVs of a report that fit in max_len
+  * @note  Fields are taken in report_priority order; one that does not fit is
+  *        skipped and smaller ones after it still get in. They are written with
+  *        the battery and network state first and then in meter_tlv order, so a
+  *        report that fits whole has the same layout at every datarate.
+  * @param buffer output
+  * @param max_len room in buffer
+  * @param fields value of each field as sent (REPORT_FIELD_COUNT entries)
+  * @param wanted mask of the fields to send
+  * @param packed out: mask of the fields written
+  * @retval number of bytes written
+  */
+uint8_t MeterPayload_PackReport(uint8_t *buffer, uint8_t max_len, const uint32_t *fields, uint16_t wanted,
+                                uint16_t *packed)
+{
+  uint8_t len = 0;
+  uint8_t size = 0;
+  uint8_t id;
+  uint8_t width;
+
+  *packed = 0;
+  for (uint8_t i = 0; i < REPORT_FIELD_COUNT; i++)
+  {
+    uint8_t field = report_priority[i];
+
+    GetReportFieldTlv(field, &id, &width);
+    if ((wanted & (1U << field)) != 0U && size + 1U + width <= max_len)
+    {
+      size += 1U + width;
+      *packed |= (uint16_t)(1U << field);
+    }
+  }
+
+  for (uint8_t i = 0; i < REPORT_FIELD_COUNT; i++)
+  {
+    /* Bateria y estado de red primero, luego los registros */
+    uint8_t field = (uint8_t)((i + METER_REG_COUNT) % REPORT_FIELD_COUNT);
+
+    if ((*packed & (1U << field)) == 0U)
+    {
+      continue;
+    }
+    GetReportFieldTlv(field, &id, &width);
+    buffer[len++] = id;
+    for (uint8_t shift = (uint8_t)(8U * width); shift > 0U; shift -= 8U)
+    {
+      buffer[len++] = (uint8_t)(fields[field] >> (shift - 8U));
+    }
+
+    if (field == REPORT_FIELD_BATTERY && fields[field] == 0xFFU)
+    {
+      METER_PAYLOAD_LOG("TLV: 0x02 Bateria=NA\r\n");
+    }
+    else if (field == REPORT_FIELD_BATTERY)
+    {
+      METER_PAYLOAD_LOG("TLV: 0x02 Bateria=%u%%\r\n", (unsigned int)fields[field]);
+    }
+    else if (field == REPORT_FIELD_NET_STATE)
+    {
+      METER_PAYLOAD_LOG("TLV: 0x04 network_state=%u\r\n", (unsigned int)fields[field]);
+    }
+    else
+    {
+      METER_PAYLOAD_LOG("TLV: 0x%02X %s=%u%s\r\n", id, meter_tlv[field].name, (unsigned int)fields[field],
+                        meter_tlv[field].unit);
+    }
+  }
+  return len;
+}
+
+/**
+  * @brief Encode meter registers as TLV (meter_tlv order)
+  * @note  Registers missing from the frame or out of range are skipped
+  * @param buffer output
+  * @param values decoded registers (METER_REG_COUNT entries)
+  * @param reg in: first register to encode, out: first register not encoded
+  *            (METER_REG_COUNT once all of them fit)
+  * @param max_len room in buffer
+  * @retval number of bytes written
+  */
+uint8_t MeterPayload_EncodeTlv(uint8_t *buffer, const OBIS_Value_t *values, uint8_t *reg, uint8_t max_len)
+{
+  uint8_t len = 0;
+
+  for (; *reg < METER_REG_COUNT; (*reg)++)
+  {
+    const MeterTlv_t *tlv = &meter_tlv[*reg];
+    uint32_t encoded;
+
+    if (!MeterPayload_GetEncoded(values, *reg, &encoded))
+    {
+      continue;
+    }
+    if (len + 1U + tlv->width > max_len)
+    {
+      break;
+    }
+
+    buffer[len++] = tlv->id;
+    for (uint8_t shift = (uint8_t)(8U * tlv->width); shift > 0U; shift -= 8U)
+    {
+      buffer[len++] = (uint8_t)(encoded >> (shift - 8U));
+    }
+    METER_PAYLOAD_LOG("TLV: 0x%02X %s=%u%s\r\n", tlv->id, tlv->name, (unsigned int)encoded, tlv->unit);
+  }
+  return len;
+}
+
+/**
+  * @brief Value of a register as sent in the payload
+  * @param values decoded registers (METER_REG_COUNT entries)
+  * @param reg register index
+  * @param encoded value divided by the register divisor
+  * @retval false if the register is missing or out of range (not sent)
+  */
+bool MeterPayload_GetEncoded(const OBIS_Value_t *values, uint8_t reg, uint32_t *encoded)
+{
+  const MeterTlv_t *tlv = &meter_tlv[reg];
+  int32_t value = values[reg].value;
+
+  if (!values[reg].valid || value < tlv->min || value > tlv->max)
+  {
+    return false;
+  }
+  *encoded = (uint32_t)value / tlv->divisor;
+  return true;
+}
+
+/**
+  * @brief Encode a reading for a batch: presence mask, then the values without ids
+  * @note  Bit n of the mask is register n of meter_tlv (METER_REG_COUNT <= 8); values
+  *        follow in meter_tlv order with their TLV width.
+  * @param buffer output, room for 1 + every width of meter_tlv
+  * @param values decoded registers (METER_REG_COUNT entries)
+  * @retval number of bytes written
+  */
+uint8_t MeterPayload_EncodePacked(uint8_t *buffer, const OBIS_Value_t *values)
+{
+  uint8_t len = 1;
+
+  buffer[0] = 0;
+  for (uint8_t reg = 0; reg < METER_REG_COUNT; reg++)
+  {
+    uint32_t encoded;
+
+    if (!MeterPayload_GetEncoded(values, reg, &encoded))
+    {
+      continue;
+    }
+    buffer[0] |= (uint8_t)(1U << reg);
+    for (uint8_t shift = (uint8_t)(8U * meter_tlv[reg].width); shift > 0U; shift -= 8U)
+    {
+      buffer[len++] = (uint8_t)(encoded >> (shift - 8U));
+    }
+  }
+  return len;
+}
+
+/**
+  * @brief Write an unsigned LEB128 varint (7 bits per byte, low bits first)
+  * @retval number of bytes written (1..5)
+  */
+static uint8_t PutVarint(uint8_t *buffer, uint32_t value)
+{
+  uint8_t len = 0;
+
+  while (value >= 0x80U)
+  {
+    buffer[len++] = (uint8_t)(value | 0x80U);
+    value >>= 7;
+  }
+  buffer[len++] = (uint8_t)value;
+  return len;
+}
+
+/**
+  * @brief Forget the keyframes: the next compact reading starts a new one
+  * @param compact encoder state
+  */
+void MeterPayload_CompactReset(MeterCompact_t *compact)
+{
+  compact->reference.valid = false;
+  compact->next.valid = false;
+  compact->sending = 0;
+}
+
+/**
+  * @brief Encode a reading as TLV 0x08 (compact format)
+  * @note  Layout: id, version << 4 | kind, keyframe id, register mask, then one
+  *        varint per register of the mask (meter_tlv order).
+  *        A keyframe (kind 0) carries absolute values and is sent confirmed. When
+  *        it does not fit in max_len it is sent in parts with the same id, the
+  *        registers not acknowledged yet that fit in each; once every register of
+  *        the reading is acknowledged it is the reference of the following deltas.
+  *        A delta frame (kind 1) carries the zigzag-coded difference to that
+  *        reference for the registers that changed and fit, so a lost or short
+  *        delta frame costs nothing to the next ones. A keyframe is started every
+  *        COMPACT_KEYFRAME_INTERVAL delta frames, and when the reading has a
+  *        register the reference lacks.
+  * @param compact encoder state
+  * @param buffer output
+  * @param values decoded registers (METER_REG_COUNT entries)
+  * @param max_len room in buffer
+  * @retval number of bytes written, 0 if not even one register of a keyframe fits
+  */
+uint8_t MeterPayload_EncodeCompact(MeterCompact_t *compact, uint8_t *buffer, const OBIS_Value_t *values,
+                                   uint8_t max_len)
+{
+  MeterKeyframe_t *reference = &compact->reference;
+  MeterKeyframe_t *next = &compact->next;
+  uint32_t encoded[METER_REG_COUNT];
+  uint8_t varint[5];
+  uint8_t present = 0;
+  uint8_t mask = 0;
+  uint8_t skipped = 0;
+  uint8_t len = COMPACT_HEADER_SIZE;
+  bool keyframe;
+
+  compact->sending = 0;
+  for (uint8_t reg = 0; reg < METER_REG_COUNT; reg++)
+  {
+    if (MeterPayload_GetEncoded(values, reg, &encoded[reg]))
+    {
+      present |= (uint8_t)(1U << reg);
+    }
+  }
+
+  /* A register missing from the reference can only be sent in a new keyframe */
+  if (!next->valid && (!reference->valid || compact->frames_since_keyframe >= COMPACT_KEYFRAME_INTERVAL ||
+                       (present & ~reference->mask) != 0U))
+  {
+    next->id = (uint8_t)(reference->id + 1U);
+    next->mask = 0;
+    next->valid = true;
+  }
+  if (next->valid && next->mask != 0U && (present & ~next->mask) == 0U)
+  {
+    *reference = *next;
+    next->valid = false;
+    compact->frames_since_keyframe = 0;
+    METER_PAYLOAD_LOG("Keyframe %u confirmado: referencia de los deltas\r\n", (unsigned int)reference->id);
+  }
+  keyframe = next->valid;
+
+  if (max_len < COMPACT_HEADER_SIZE)
+  {
+    return 0;
+  }
+
+  for (uint8_t reg = 0; reg < METER_REG_COUNT; reg++)
+  {
+    uint8_t bit = (uint8_t)(1U << reg);
+    uint8_t size;
+
+    if ((present & bit) == 0U)
+    {
+      continue;
+    }
+    if (keyframe)
+    {
+      if ((next->mask & bit) != 0U)
+      {
+        continue;  /* acknowledged in an earlier part */
+      }
+      size = PutVarint(varint, encoded[reg]);
+    }
+    else if (encoded[reg] != reference->values[reg])
+    {
+      int32_t delta = (int32_t)(encoded[reg] - reference->values[reg]);
+      size = PutVarint(varint, ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+    }
+    else
+    {
+      continue;
+    }
+
+    if (len + size > max_len)
+    {
+      skipped |= bit;
+      continue;
+    }
+    memcpy(&buffer[len], varint, size);
+    len += size;
+    mask |= bit;
+    if (keyframe)
+    {
+      next->values[reg] = encoded[reg];
+    }
+  }
+
+  if (keyframe && mask == 0U)
+  {
+    METER_PAYLOAD_LOG("TLV: 0x08 keyframe %u no cabe (%u bytes)\r\n", (unsigned int)next->id, (unsigned int)max_len);
+    return 0;
+  }
+
+  buffer[0] = TLV_ID_COMPACT;
+  buffer[1] = (uint8_t)((COMPACT_VERSION << 4) | (keyframe ? 0U : 1U));
+  buffer[2] = keyframe ? next->id : reference->id;
+  buffer[3] = mask;
+  if (keyframe)
+  {
+    compact->sending = mask;
+  }
+  else
+  {
+    compact->frames_since_keyframe++;
+  }
+  METER_PAYLOAD_LOG("TLV: 0x08 %s %u, registros 0x%02X (%u bytes)\r\n",
+                    keyframe ? "Keyframe" : "Delta sobre keyframe", (unsigned int)buffer[2], (unsigned int)mask,
+                    (unsigned int)len);
+  if (skipped != 0U)
+  {
+    METER_PAYLOAD_LOG("TLV: 0x08 registros 0x%02X no caben con el DR actual\r\n", (unsigned int)skipped);
+  }
+  return len;
+}
+
+/**
+  * @brief Outcome of the uplink that carried the last compact reading
+  * @param compact encoder state
+  * @param acked true if it went confirmed and the network acknowledged it
+  */
+void MeterPayload_CompactSent(MeterCompact_t *compact, bool acked)
+{
+  if (compact->sending == 0U)
+  {
+    return;
+  }
+  if (acked && compact->next.valid)
+  {
+    compact->next.mask |= compact->sending;
+    METER_PAYLOAD_LOG("Keyframe %u: registros 0x%02X confirmados\r\n", (unsigned int)compact->next.id,
+                      (unsigned int)compact->next.mask);
+  }
+  compact->sending = 0;
+}
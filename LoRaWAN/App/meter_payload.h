@@ -0,0 +1,125 @@
+/*
+ * meter_payload.h
+ * Uplink encoding of the meter registers: the register table (OBIS code, TLV
+ * id, width, range) and the TLV, packed and report encoders built from it.
+ * No HAL dependency, so the payload bytes can be checked on the host (test/).
+ * This file is outside CubeMX-managed files so it won't be overwritten.
+ */
+#ifndef __METER_PAYLOAD_H__
+#define __METER_PAYLOAD_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "obis_stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+  * @brief Meter registers sent in the TLV payload, in payload order. Single source for the
+  *        register enum, the OBIS decoder table and the TLV encoder table.
+  *        X(register, OBIS code, decimals, TLV id, width, divisor, min, max, deadband, log name, log unit)
+  *        min/max bound the decoded fixed-point value, divisor scales it before encoding.
+  *        deadband: change (in sent units) a register must exceed to be reported in
+  *        report-by-exception mode, 0 = any change.
+  */
+#define METER_FIELDS(X) \
+  X(METER_REG_ACTIVE_TOTAL,       "15.8.0",  0, 0x0A, 4, 1,    0, 9999999,   0, "Activa_Total",        " Wh")   \
+  X(METER_REG_REACTIVE_TOTAL,     "130.8.0", 0, 0x0B, 4, 1,    0, 9999999,   0, "Reactiva_Total",      " VArh") \
+  X(METER_REG_PEAK_DEMAND,        "1.6.0",   3, 0x28, 2, 1000, 0, 65534,     0, "Demanda_Max",         " W")    \
+  X(METER_REG_ACTIVE_CONSUMED,    "1.8.0",   0, 0x3C, 4, 1,    0, 9999999,   0, "Activa_Consumida",    " Wh")   \
+  X(METER_REG_ACTIVE_GENERATED,   "2.8.0",   0, 0x3D, 4, 1,    0, 9999999,   0, "Activa_Generada",     " Wh")   \
+  X(METER_REG_REACTIVE_CONSUMED,  "3.8.0",   0, 0x3E, 4, 1,    0, 9999999,   0, "Reactiva_Consumida",  " VArh") \
+  X(METER_REG_REACTIVE_GENERATED, "4.8.0",   0, 0x3F, 4, 1,    0, 9999999,   0, "Reactiva_Generada",   " VArh") \
+  X(METER_REG_SERIAL,             "C.1.0",   0, 0x5A, 4, 1,    1, INT32_MAX, 0, "Numero_Serie",        "")
+
+/**
+  * @brief Meter registers decoded on the fly by meter_obis_stream (index into meter_registers)
+  */
+#define METER_FIELD_ENUM(reg, code, dec, id, width, div, min, max, band, name, unit) reg,
+typedef enum MeterRegister_e
+{
+  METER_FIELDS(METER_FIELD_ENUM)
+  METER_REG_COUNT
+} MeterRegister_t;
+
+/**
+  * @brief Fields tracked by report-by-exception: the meter registers, then the
+  *        status TLVs
+  */
+typedef enum ReportField_e
+{
+  REPORT_FIELD_BATTERY = METER_REG_COUNT,  /* TLV 0x02 */
+  REPORT_FIELD_NET_STATE,                  /* TLV 0x04 */
+  REPORT_FIELD_COUNT
+} ReportField_t;
+
+/**
+  * @brief TLV encoding of a meter register
+  */
+typedef struct MeterTlv_s
+{
+  int32_t     min;      /* valid range of the decoded value */
+  int32_t     max;
+  uint32_t    deadband; /* report-by-exception threshold (sent units) */
+  uint16_t    divisor;  /* decoded value / divisor is sent */
+  uint8_t     id;       /* TLV id */
+  uint8_t     width;    /* bytes, big-endian */
+  const char *name;
+  const char *unit;
+} MeterTlv_t;
+
+/* Compact format (TLV 0x08): version, and a keyframe (absolute values) every this many uplinks */
+#define TLV_ID_COMPACT 0x08
+#define COMPACT_VERSION 1U
+#define COMPACT_KEYFRAME_INTERVAL 24U
+/* id, version << 4 | kind, keyframe id, register mask */
+#define COMPACT_HEADER_SIZE 4U
+
+/**
+  * @brief Register values of a compact keyframe, reference of the deltas
+  */
+typedef struct MeterKeyframe_s
+{
+  uint32_t values[METER_REG_COUNT];  /* As sent (divided by the register divisor) */
+  uint8_t  mask;                     /* Bit n: register n present */
+  uint8_t  id;                       /* Sent in every frame so deltas can be matched */
+  bool     valid;
+} MeterKeyframe_t;
+
+/**
+  * @brief State of the compact format encoder
+  * @note  A keyframe that does not fit in one uplink goes out in parts: same id,
+  *        some registers each. next.mask collects the acknowledged registers;
+  *        once it covers the reading the keyframe becomes the reference.
+  */
+typedef struct MeterCompact_s
+{
+  MeterKeyframe_t reference;              /* Acknowledged keyframe: reference of the deltas */
+  MeterKeyframe_t next;                   /* Keyframe being sent, valid while in progress */
+  uint8_t         sending;                /* Registers of next in the uplink in flight */
+  uint8_t         frames_since_keyframe;
+} MeterCompact_t;
+
+/**
+  * @brief Register tables, in payload order (METER_REG_COUNT entries)
+  */
+extern const OBIS_Register_t meter_registers[METER_REG_COUNT];
+extern const MeterTlv_t meter_tlv[METER_REG_COUNT];
+
+bool MeterPayload_GetEncoded(const OBIS_Value_t *values, uint8_t reg, uint32_t *encoded);
+uint8_t MeterPayload_EncodeTlv(uint8_t *buffer, const OBIS_Value_t *values, uint8_t *reg, uint8_t max_len);
+uint8_t MeterPayload_EncodePacked(uint8_t *buffer, const OBIS_Value_t *values);
+uint8_t MeterPayload_PackReport(uint8_t *buffer, uint8_t max_len, const uint32_t *fields, uint16_t wanted,
+                                uint16_t *packed);
+void MeterPayload_CompactReset(MeterCompact_t *compact);
+uint8_t MeterPayload_EncodeCompact(MeterCompact_t *compact, uint8_t *buffer, const OBIS_Value_t *values,
+                                   uint8_t max_len);
+void MeterPayload_CompactSent(MeterCompact_t *compact, bool acked);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __METER_PAYLOAD_H__ */
@@ -0,0 +1,293 @@
+/*
+ * meter_store.c
+ * Flash ring of meter readings. Slots are appended in erased flash and never
+ * rewritten: a reading is marked as sent by programming its `sent` field, and
+ * a page is only erased when the ring comes back to it, so every page of the
+ * area wears at the same rate. The state is rebuilt by scanning the slots, so
+ * a reset at any point loses at most the reading being written.
+ */
+
+#include <string.h>
+#include <stddef.h>
+#include "meter_store.h"
+
+#define SLOT_SIZE    ((uint32_t)sizeof(MeterStore_Record_t))
+#define SENT_OFFSET  ((uint32_t)offsetof(MeterStore_Record_t, sent))
+#define CRC_LENGTH   ((uint32_t)offsetof(MeterStore_Record_t, crc))
+#define SEQ_EMPTY    0xFFFFFFFFUL
+#define NOT_SENT     0xFFFFFFFFFFFFFFFFULL
+
+static uint16_t Crc16(const uint8_t *data, uint32_t size)
+{
+  uint16_t crc = 0;
+
+  while (size-- > 0U)
+  {
+    crc ^= *data++;
+    for (uint8_t bit = 0; bit < 8; bit++)
+    {
+      crc = (crc & 1U) ? (uint16_t)((crc >> 1) ^ 0xA001U) : (uint16_t)(crc >> 1);
+    }
+  }
+  return crc;
+}
+
+static uint16_t SlotCount(const MeterStore_t *store)
+{
+  return (uint16_t)(store->pages * store->slots_per_page);
+}
+
+static uint32_t SlotAddress(const MeterStore_t *store, uint16_t slot)
+{
+  return store->base + (uint32_t)(slot / store->slots_per_page) * store->page_size
+         + (uint32_t)(slot % store->slots_per_page) * SLOT_SIZE;
+}
+
+static bool ReadSlot(const MeterStore_t *store, uint16_t slot, MeterStore_Record_t *record)
+{
+  return store->flash->read(SlotAddress(store, slot), record, SLOT_SIZE);
+}
+
+static bool IsBlank(const MeterStore_Record_t *record)
+{
+  const uint8_t *bytes = (const uint8_t *)record;
+
+  for (uint32_t i = 0; i < SLOT_SIZE; i++)
+  {
+    if (bytes[i] != 0xFFU)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool IsValid(const MeterStore_Record_t *record)
+{
+  return record->seq != SEQ_EMPTY && record->crc == Crc16((const uint8_t *)record, CRC_LENGTH);
+}
+
+static bool IsPending(const MeterStore_Record_t *record)
+{
+  return IsValid(record) && record->sent == NOT_SENT;
+}
+
+/**
+  * @brief  Make the page starting at slot ready for writing
+  * @note   The page holds the oldest readings of the ring: the unsent ones are lost
+  *         (counted in dropped).
+  */
+static bool PreparePage(MeterStore_t *store, uint16_t first_slot)
+{
+  MeterStore_Record_t record;
+  uint16_t lost = 0;
+  bool blank = true;
+
+  for (uint16_t i = 0; i < store->slots_per_page; i++)
+  {
+    if (!ReadSlot(store, (uint16_t)(first_slot + i), &record))
+    {
+      return false;
+    }
+    if (!IsBlank(&record))
+    {
+      blank = false;
+      if (IsPending(&record))
+      {
+        lost++;
+      }
+    }
+  }
+  if (blank)
+  {
+    return true;
+  }
+
+  if (!store->flash->erase(SlotAddress(store, first_slot)))
+  {
+    return false;
+  }
+  store->dropped += lost;
+  store->pending = (store->pending > lost) ? (uint16_t)(store->pending - lost) : 0U;
+  return true;
+}
+
+/**
+  * @brief  Attach the store to its flash area and rebuild its state
+  * @param  store store
+  * @param  flash flash access
+  * @param  base address of the first page (page aligned)
+  * @param  pages number of pages, at least 2
+  * @param  page_size flash page size
+  */
+void MeterStore_Init(MeterStore_t *store, const MeterStore_Flash_t *flash, uint32_t base,
+                     uint16_t pages, uint32_t page_size)
+{
+  MeterStore_Record_t record;
+  uint32_t last_seq = 0;
+  bool found = false;
+  uint16_t last_slot = 0;
+
+  store->flash = flash;
+  store->base = base;
+  store->pages = pages;
+  store->page_size = page_size;
+  store->slots_per_page = (uint16_t)(page_size / SLOT_SIZE);
+  store->pending = 0;
+  store->dropped = 0;
+
+  for (uint16_t slot = 0; slot < SlotCount(store); slot++)
+  {
+    if (!ReadSlot(store, slot, &record) || !IsValid(&record))
+    {
+      continue;
+    }
+    if (record.sent == NOT_SENT)
+    {
+      store->pending++;
+    }
+    if (!found || record.seq > last_seq)
+    {
+      found = true;
+      last_seq = record.seq;
+      last_slot = slot;
+    }
+  }
+
+  store->head = found ? (uint16_t)((last_slot + 1U) % SlotCount(store)) : 0U;
+  store->next_seq = found ? last_seq + 1U : 1U;
+}
+
+/**
+  * @brief  Append a reading
+  * @param  store store
+  * @param  timestamp capture time
+  * @param  values decoded registers
+  * @param  count number of registers (up to METER_STORE_VALUES are kept)
+  * @retval true if the reading is in flash
+  */
+bool MeterStore_Push(MeterStore_t *store, uint32_t timestamp, const OBIS_Value_t *values, uint8_t count)
+{
+  MeterStore_Record_t record;
+
+  if (count > METER_STORE_VALUES)
+  {
+    count = METER_STORE_VALUES;
+  }
+
+  /* A slot left half-written by a reset is skipped, so try every slot at most once */
+  for (uint16_t tries = 0; tries < SlotCount(store); tries++)
+  {
+    uint16_t slot = store->head;
+
+    store->head = (uint16_t)((slot + 1U) % SlotCount(store));
+
+    if ((slot % store->slots_per_page) == 0U && !PreparePage(store, slot))
+    {
+      return false;
+    }
+    if (!ReadSlot(store, slot, &record) || !IsBlank(&record))
+    {
+      continue;
+    }
+
+    memset(&record, 0xFF, sizeof(record));
+    record.seq = store->next_seq;
+    record.timestamp = timestamp;
+    record.valid_mask = 0;
+    for (uint8_t i = 0; i < METER_STORE_VALUES; i++)
+    {
+      record.values[i] = (i < count) ? values[i].value : 0;
+      if (i < count && values[i].valid)
+      {
+        record.valid_mask |= (uint16_t)(1U << i);
+      }
+    }
+    record.crc = Crc16((const uint8_t *)&record, CRC_LENGTH);
+
+    /* `sent` is left erased so it can be programmed once */
+    if (!store->flash->program(SlotAddress(store, slot), &record, SENT_OFFSET))
+    {
+      continue;
+    }
+    store->next_seq++;
+    store->pending++;
+    return true;
+  }
+  return false;
+}
+
+/**
+  * @brief  Oldest reading not sent yet
+  * @param  store store
+  * @param  record output
+  * @param  slot output, to pass to MeterStore_MarkSent()
+  * @retval false if nothing is pending
+  */
+bool MeterStore_Peek(const MeterStore_t *store, MeterStore_Record_t *record, uint16_t *slot)
+{
+  MeterStore_Record_t candidate;
+  bool found = false;
+
+  if (store->pending == 0U)
+  {
+    return false;
+  }
+
+  for (uint16_t i = 0; i < SlotCount(store); i++)
+  {
+    if (!ReadSlot(store, i, &candidate) || !IsPending(&candidate))
+    {
+      continue;
+    }
+    if (!found || candidate.seq < record->seq)
+    {
+      *record = candidate;
+      *slot = i;
+      found = true;
+    }
+  }
+  return found;
+}
+
+/**
+  * @brief  Mark a reading as delivered
+  * @param  store store
+  * @param  slot slot returned by MeterStore_Peek()
+  * @retval true on success
+  */
+bool MeterStore_MarkSent(MeterStore_t *store, uint16_t slot)
+{
+  MeterStore_Record_t record;
+  const uint64_t sent = 0;
+
+  if (slot >= SlotCount(store) || !ReadSlot(store, slot, &record) || !IsPending(&record))
+  {
+    return false;
+  }
+  if (!store->flash->program(SlotAddress(store, slot) + SENT_OFFSET, &sent, sizeof(sent)))
+  {
+    return false;
+  }
+  if (store->pending > 0U)
+  {
+    store->pending--;
+  }
+  return true;
+}
+
+/**
+  * @brief  Readings waiting to be sent
+  */
+uint16_t MeterStore_Pending(const MeterStore_t *store)
+{
+  return store->pending;
+}
+
+/**
+  * @brief  Number of readings the area holds
+  */
+uint16_t MeterStore_Capacity(const MeterStore_t *store)
+{
+  return SlotCount(store);
+}
@@ -0,0 +1,79 @@
+/*
+ * meter_store.h
+ * Store-and-forward ring of meter readings in internal flash, for readings
+ * that could not be sent (link outage, duty cycle, not joined).
+ * This file is outside CubeMX-managed files so it won't be overwritten.
+ */
+#ifndef __METER_STORE_H__
+#define __METER_STORE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "obis_stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+  * @brief Registers kept per reading
+  */
+#define METER_STORE_VALUES  8U
+
+/**
+  * @brief Flash access used by the store (addresses are absolute)
+  * @note  program() is only called on erased memory, in 8-byte units, so no page
+  *        is erased except when the ring wraps onto it.
+  */
+typedef struct
+{
+  bool (*read)(uint32_t address, void *data, uint32_t size);
+  bool (*program)(uint32_t address, const void *data, uint32_t size);
+  bool (*erase)(uint32_t page_address);
+} MeterStore_Flash_t;
+
+/**
+  * @brief One stored reading (one flash slot)
+  * @note  The slot is written once; `sent` stays erased until the reading is
+  *        delivered and is then programmed to 0. Size is a multiple of 8 bytes.
+  */
+typedef struct
+{
+  uint32_t seq;                          /* write order, 0xFFFFFFFF = empty slot */
+  uint32_t timestamp;                    /* capture time (SysTime seconds) */
+  int32_t  values[METER_STORE_VALUES];
+  uint16_t valid_mask;                   /* bit n: values[n] present */
+  uint16_t crc;                          /* CRC-16 of the bytes above */
+  uint32_t reserved;
+  uint64_t sent;
+} MeterStore_Record_t;
+
+/**
+  * @brief Ring state, rebuilt from flash by MeterStore_Init()
+  */
+typedef struct
+{
+  const MeterStore_Flash_t *flash;
+  uint32_t base;          /* first page */
+  uint32_t page_size;
+  uint16_t pages;
+  uint16_t slots_per_page;
+  uint16_t head;          /* next slot to write */
+  uint16_t pending;       /* readings stored and not sent */
+  uint32_t next_seq;
+  uint32_t dropped;       /* unsent readings overwritten when the ring wrapped */
+} MeterStore_t;
+
+void MeterStore_Init(MeterStore_t *store, const MeterStore_Flash_t *flash, uint32_t base,
+                     uint16_t pages, uint32_t page_size);
+bool MeterStore_Push(MeterStore_t *store, uint32_t timestamp, const OBIS_Value_t *values, uint8_t count);
+bool MeterStore_Peek(const MeterStore_t *store, MeterStore_Record_t *record, uint16_t *slot);
+bool MeterStore_MarkSent(MeterStore_t *store, uint16_t slot);
+uint16_t MeterStore_Pending(const MeterStore_t *store);
+uint16_t MeterStore_Capacity(const MeterStore_t *store);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __METER_STORE_H__ */
@@ -0,0 +1,184 @@
+/*
+ * meter_timing.c
+ * Response time history of the meter: bucketed histograms of the first-byte
+ * latency and of the frame duration, read timeout from their percentiles and
+ * jittered exponential backoff between retries.
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "meter_timing.h"
+
+/* Upper bound of each bucket (ms), the last bucket takes everything above */
+static const uint16_t bucket_limit[METER_TIMING_BUCKETS - 1U] =
+{
+  50, 100, 150, 200, 300, 400, 500, 750, 1000, 1500, 2000, 3000, 4000, 5000, 7000
+};
+
+static void AddToHistogram(uint16_t *histogram, uint32_t ms)
+{
+  uint32_t total = 0;
+  uint8_t bucket = 0;
+
+  while (bucket < METER_TIMING_BUCKETS - 1U && ms > bucket_limit[bucket])
+  {
+    bucket++;
+  }
+
+  for (uint8_t i = 0; i < METER_TIMING_BUCKETS; i++)
+  {
+    total += histogram[i];
+  }
+  if (total >= METER_TIMING_AGE_LIMIT)
+  {
+    /* Halve instead of clearing: recent behaviour weighs more, the shape is kept */
+    for (uint8_t i = 0; i < METER_TIMING_BUCKETS; i++)
+    {
+      histogram[i] = (uint16_t)((histogram[i] + 1U) / 2U);
+    }
+  }
+  histogram[bucket]++;
+}
+
+/**
+  * @brief  Clear the history
+  * @param  timing history
+  * @param  serial meter the new history belongs to
+  */
+void MeterTiming_Reset(MeterTiming_t *timing, uint32_t serial)
+{
+  memset(timing, 0, sizeof(*timing));
+  timing->magic = METER_TIMING_MAGIC;
+  timing->serial = serial;
+}
+
+/**
+  * @brief  Tell whether a history read from flash can be used
+  * @param  timing history
+  * @retval true if the record has the current layout
+  */
+bool MeterTiming_IsValid(const MeterTiming_t *timing)
+{
+  return timing->magic == METER_TIMING_MAGIC;
+}
+
+/**
+  * @brief  Add the timing of a successful read
+  * @param  timing history
+  * @param  latency_ms read request to first byte
+  * @param  duration_ms first byte to end of frame
+  */
+void MeterTiming_AddSample(MeterTiming_t *timing, uint32_t latency_ms, uint32_t duration_ms)
+{
+  AddToHistogram(timing->latency, latency_ms);
+  AddToHistogram(timing->duration, duration_ms);
+}
+
+/**
+  * @brief  Number of reads in the history (after ageing)
+  * @param  timing history
+  * @retval samples
+  */
+uint32_t MeterTiming_Samples(const MeterTiming_t *timing)
+{
+  uint32_t total = 0;
+
+  for (uint8_t i = 0; i < METER_TIMING_BUCKETS; i++)
+  {
+    total += timing->latency[i];
+  }
+  return total;
+}
+
+/**
+  * @brief  Percentile of a histogram, rounded up to the bucket limit
+  * @param  histogram METER_TIMING_BUCKETS counts
+  * @param  percent 1..100
+  * @retval ms, UINT32_MAX if it falls in the open bucket, 0 if the histogram is empty
+  */
+uint32_t MeterTiming_Percentile(const uint16_t *histogram, uint8_t percent)
+{
+  uint32_t total = 0;
+  uint32_t needed;
+  uint32_t count = 0;
+
+  for (uint8_t i = 0; i < METER_TIMING_BUCKETS; i++)
+  {
+    total += histogram[i];
+  }
+  if (total == 0U)
+  {
+    return 0U;
+  }
+
+  needed = (total * percent + 99U) / 100U;
+  for (uint8_t i = 0; i < METER_TIMING_BUCKETS - 1U; i++)
+  {
+    count += histogram[i];
+    if (count >= needed)
+    {
+      return bucket_limit[i];
+    }
+  }
+  return UINT32_MAX;
+}
+
+/**
+  * @brief  Read timeout learned from the history
+  * @note   Percentile of the latency plus percentile of the duration plus
+  *         METER_TIMING_MARGIN, within [METER_TIMING_MIN_TIMEOUT, default_ms].
+  * @param  timing history
+  * @param  default_ms timeout used until METER_TIMING_MIN_SAMPLES reads are known (also the cap)
+  * @retval timeout in ms
+  */
+uint32_t MeterTiming_Timeout(const MeterTiming_t *timing, uint32_t default_ms)
+{
+  uint32_t latency;
+  uint32_t duration;
+  uint32_t timeout;
+
+  if (MeterTiming_Samples(timing) < METER_TIMING_MIN_SAMPLES)
+  {
+    return default_ms;
+  }
+
+  latency = MeterTiming_Percentile(timing->latency, METER_TIMING_PERCENTILE);
+  duration = MeterTiming_Percentile(timing->duration, METER_TIMING_PERCENTILE);
+  if (latency >= default_ms || duration >= default_ms)
+  {
+    return default_ms;
+  }
+
+  timeout = latency + duration + METER_TIMING_MARGIN;
+  if (timeout > default_ms)
+  {
+    timeout = default_ms;
+  }
+  if (timeout < METER_TIMING_MIN_TIMEOUT)
+  {
+    timeout = METER_TIMING_MIN_TIMEOUT;
+  }
+  return timeout;
+}
+
+/**
+  * @brief  Delay before a retry: exponential in the attempt number, with jitter
+  * @param  attempt retry number, 1 for the first retry
+  * @param  random any random value (jitter source)
+  * @retval ms
+  */
+uint32_t MeterTiming_Backoff(uint8_t attempt, uint32_t random)
+{
+  uint32_t delay = METER_TIMING_BACKOFF_BASE;
+
+  for (uint8_t i = 1; i < attempt && delay < METER_TIMING_BACKOFF_MAX; i++)
+  {
+    delay *= 2U;
+  }
+  if (delay > METER_TIMING_BACKOFF_MAX)
+  {
+    delay = METER_TIMING_BACKOFF_MAX;
+  }
+  return delay + random % (delay / 2U + 1U);
+}
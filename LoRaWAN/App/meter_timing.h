@@ -0,0 +1,82 @@
+/*
+ * meter_timing.h
+ * Response time history of the meter, used to size the read timeout and the
+ * delay between retries. Kept in flash by lora_app.c across reboots.
+ * This file is outside CubeMX-managed files so it won't be overwritten.
+ */
+#ifndef __METER_TIMING_H__
+#define __METER_TIMING_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+  * @brief Marks a valid record in flash (bump it when the layout changes)
+  */
+#define METER_TIMING_MAGIC        0x4D540001UL
+
+/**
+  * @brief Histogram buckets: upper bounds in meter_timing.c, the last one is open ended
+  */
+#define METER_TIMING_BUCKETS      16U
+
+/**
+  * @brief Samples needed before the learned timeout replaces the default one
+  */
+#define METER_TIMING_MIN_SAMPLES  8U
+
+/**
+  * @brief Counts are halved when a histogram reaches this total, so old samples fade out
+  */
+#define METER_TIMING_AGE_LIMIT    1000U
+
+/**
+  * @brief Percentile of latency and duration covered by the timeout
+  */
+#define METER_TIMING_PERCENTILE   99U
+
+/**
+  * @brief Added to the percentiles to get the read timeout (ms)
+  */
+#define METER_TIMING_MARGIN       500U
+
+/**
+  * @brief Shortest read timeout allowed (ms)
+  */
+#define METER_TIMING_MIN_TIMEOUT  1500U
+
+/**
+  * @brief Retry backoff: first delay and cap (ms), jitter adds up to half the delay
+  */
+#define METER_TIMING_BACKOFF_BASE 250U
+#define METER_TIMING_BACKOFF_MAX  8000U
+
+/**
+  * @brief Response time history of one meter
+  * @note  Size is a multiple of 8 bytes (64-bit flash writes).
+  */
+typedef struct
+{
+  uint32_t magic;                               /* METER_TIMING_MAGIC if valid */
+  uint32_t serial;                              /* meter the history belongs to, 0 = unknown */
+  uint16_t latency[METER_TIMING_BUCKETS];       /* read request -> first byte */
+  uint16_t duration[METER_TIMING_BUCKETS];      /* first byte -> end of frame */
+} MeterTiming_t;
+
+void MeterTiming_Reset(MeterTiming_t *timing, uint32_t serial);
+bool MeterTiming_IsValid(const MeterTiming_t *timing);
+void MeterTiming_AddSample(MeterTiming_t *timing, uint32_t latency_ms, uint32_t duration_ms);
+uint32_t MeterTiming_Samples(const MeterTiming_t *timing);
+uint32_t MeterTiming_Percentile(const uint16_t *histogram, uint8_t percent);
+uint32_t MeterTiming_Timeout(const MeterTiming_t *timing, uint32_t default_ms);
+uint32_t MeterTiming_Backoff(uint8_t attempt, uint32_t random);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __METER_TIMING_H__ */
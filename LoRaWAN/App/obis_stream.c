@@ -0,0 +1,258 @@
+/*
+ * obis_stream.c
+ * Incremental OBIS decoder: registers are decoded while the meter frame
+ * arrives, so no frame copy and no second parse pass are needed.
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "obis_stream.h"
+
+/* Decoder states */
+#define ST_CODE   0U  /* collecting the OBIS code up to '(' */
+#define ST_VALUE  1U  /* inside "(...", decoding the number */
+#define ST_UNIT   2U  /* after '*', skipping the unit up to ')' */
+
+/* num_flags bits */
+#define NUM_NEGATIVE   0x01U
+#define NUM_DIGIT      0x02U
+#define NUM_FRACTION   0x04U
+#define NUM_ENDED      0x08U  /* a non numeric char ended the number */
+#define NUM_OVERFLOW   0x10U
+#define NUM_STARTED    0x20U  /* first char consumed (sign allowed only before) */
+
+/**
+  * @brief  Compare the collected code with a wanted one, ignoring a "1-0:" prefix
+  */
+static bool CodeMatches(const OBIS_Stream_t *stream, const char *code)
+{
+  size_t len = strlen(code);
+
+  if (stream->code_len < len || stream->code_len > OBIS_STREAM_CODE_MAX)
+  {
+    return false;
+  }
+  uint8_t skip = (uint8_t)(stream->code_len - len);
+  if (skip != 0 && stream->code[skip - 1] != ':')
+  {
+    return false;
+  }
+  return memcmp(&stream->code[skip], code, len) == 0;
+}
+
+/**
+  * @brief  '(' reached: resolve which register (if any) this data set feeds
+  */
+static void StartValue(OBIS_Stream_t *stream)
+{
+  stream->reg = -1;
+  stream->is_end = false;
+  stream->acc = 0;
+  stream->frac_digits = 0;
+  stream->num_flags = 0;
+
+  if (stream->code_len == 0)
+  {
+    return;  /* extra "(..)" group of a multi-value data set */
+  }
+
+  for (uint8_t n = 0; n < stream->register_count; n++)
+  {
+    if (!stream->values[n].valid && CodeMatches(stream, stream->registers[n].code))
+    {
+      stream->reg = (int8_t)n;
+      break;
+    }
+  }
+  stream->is_end = (stream->end_code != NULL) && CodeMatches(stream, stream->end_code);
+}
+
+/**
+  * @brief  Accumulate one char of the value
+  * @note   "001234.56" with decimals=0 gives 1234, with decimals=3 gives 1234560;
+  *         extra decimal places are truncated.
+  */
+static void AccumulateValue(OBIS_Stream_t *stream, char c)
+{
+  uint8_t flags = stream->num_flags;
+
+  if ((flags & (NUM_ENDED | NUM_OVERFLOW)) != 0U || stream->reg < 0)
+  {
+    return;
+  }
+
+  if ((flags & NUM_STARTED) == 0U && (c == '+' || c == '-'))
+  {
+    stream->num_flags = (uint8_t)(flags | NUM_STARTED | ((c == '-') ? NUM_NEGATIVE : 0U));
+    return;
+  }
+  flags |= NUM_STARTED;
+
+  if (c == '.' && (flags & NUM_FRACTION) == 0U)
+  {
+    stream->num_flags = (uint8_t)(flags | NUM_FRACTION);
+    return;
+  }
+  if (c < '0' || c > '9')
+  {
+    stream->num_flags = (uint8_t)(flags | NUM_ENDED);
+    return;
+  }
+
+  flags |= NUM_DIGIT;
+  if ((flags & NUM_FRACTION) != 0U)
+  {
+    if (stream->frac_digits >= stream->registers[stream->reg].decimals)
+    {
+      stream->num_flags = flags;
+      return;  /* truncate */
+    }
+    stream->frac_digits++;
+  }
+
+  uint32_t digit = (uint32_t)(c - '0');
+  if (stream->acc > ((uint32_t)INT32_MAX - digit) / 10U)
+  {
+    flags |= NUM_OVERFLOW;
+  }
+  else
+  {
+    stream->acc = stream->acc * 10U + digit;
+  }
+  stream->num_flags = flags;
+}
+
+/**
+  * @brief  ')' reached: store the decoded value of the current data set
+  */
+static void CommitValue(OBIS_Stream_t *stream)
+{
+  if (stream->reg < 0 || (stream->num_flags & NUM_DIGIT) == 0U || (stream->num_flags & NUM_OVERFLOW) != 0U)
+  {
+    return;
+  }
+
+  uint32_t value = stream->acc;
+  for (uint8_t f = stream->frac_digits; f < stream->registers[stream->reg].decimals; f++)
+  {
+    if (value > (uint32_t)INT32_MAX / 10U)
+    {
+      return;
+    }
+    value *= 10U;
+  }
+
+  OBIS_Value_t *out = &stream->values[stream->reg];
+  out->value = ((stream->num_flags & NUM_NEGATIVE) != 0U) ? -(int32_t)value : (int32_t)value;
+  out->valid = true;
+}
+
+/**
+  * @brief  Configure the decoder
+  * @param  stream decoder to initialize
+  * @param  registers registers to decode
+  * @param  register_count number of entries in registers and values
+  * @param  values output, values[n] receives registers[n]
+  * @param  end_code OBIS code of the last data set of a frame (e.g. "C.1.0"),
+  *         NULL to end on the IEC 62056-21 '!' line
+  */
+void OBIS_StreamInit(OBIS_Stream_t *stream, const OBIS_Register_t *registers, uint8_t register_count,
+                     OBIS_Value_t *values, const char *end_code)
+{
+  stream->registers = registers;
+  stream->register_count = register_count;
+  stream->values = values;
+  stream->end_code = end_code;
+  OBIS_StreamReset(stream);
+}
+
+/**
+  * @brief  Start a new frame: clear decoder state and invalidate all values
+  * @param  stream decoder
+  */
+void OBIS_StreamReset(OBIS_Stream_t *stream)
+{
+  stream->state = ST_CODE;
+  stream->code_len = 0;
+  stream->reg = -1;
+  stream->is_end = false;
+  stream->num_flags = 0;
+  stream->complete = false;
+  for (uint8_t n = 0; n < stream->register_count; n++)
+  {
+    stream->values[n].valid = false;
+    stream->values[n].value = 0;
+  }
+}
+
+/**
+  * @brief  Feed one received byte
+  * @note   Constant work per byte except at '(' (one compare per wanted register).
+  *         Safe to call from the UART reception interrupt.
+  * @param  stream decoder
+  * @param  byte received byte
+  * @retval true once the end of frame has been seen (further bytes are ignored)
+  */
+bool OBIS_StreamFeed(OBIS_Stream_t *stream, uint8_t byte)
+{
+  char c = (char)byte;
+
+  if (stream->complete)
+  {
+    return true;
+  }
+
+  switch (stream->state)
+  {
+    case ST_CODE:
+      if (c == '(')
+      {
+        StartValue(stream);
+        stream->state = ST_VALUE;
+      }
+      else if (c == '!' && stream->code_len == 0 && stream->end_code == NULL)
+      {
+        stream->complete = true;
+      }
+      else if (c == '\r' || c == '\n' || c == '\x02' || c == ')')
+      {
+        stream->code_len = 0;
+      }
+      else if (stream->code_len < OBIS_STREAM_CODE_MAX)
+      {
+        stream->code[stream->code_len++] = c;
+      }
+      else
+      {
+        stream->code_len = OBIS_STREAM_CODE_MAX + 1;  /* too long: matches nothing */
+      }
+      break;
+
+    case ST_VALUE:
+    case ST_UNIT:
+      if (c == ')')
+      {
+        CommitValue(stream);
+        stream->complete = stream->is_end;
+        stream->state = ST_CODE;
+        stream->code_len = 0;
+      }
+      else if (c == '*')
+      {
+        stream->state = ST_UNIT;
+      }
+      else if (stream->state == ST_VALUE)
+      {
+        AccumulateValue(stream, c);
+      }
+      break;
+
+    default:
+      stream->state = ST_CODE;
+      stream->code_len = 0;
+      break;
+  }
+
+  return stream->complete;
+}
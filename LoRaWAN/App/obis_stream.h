@@ -0,0 +1,71 @@
+/*
+ * obis_stream.h
+ * Byte-at-a-time IEC 62056-21 data-set decoder fed from the meter UART path.
+ * This file is outside CubeMX-managed files so it won't be overwritten.
+ */
+#ifndef __OBIS_STREAM_H__
+#define __OBIS_STREAM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+  * @brief Longest OBIS code kept while matching (e.g. "1-0:130.8.0")
+  */
+#define OBIS_STREAM_CODE_MAX  16
+
+/**
+  * @brief Register to decode: OBIS code and number of decimals kept (value * 10^decimals)
+  */
+typedef struct
+{
+  const char *code;
+  uint8_t     decimals;
+} OBIS_Register_t;
+
+/**
+  * @brief Decoded value of a register
+  */
+typedef struct
+{
+  int32_t value;
+  bool    valid;
+} OBIS_Value_t;
+
+/**
+  * @brief Decoder state. Values are ready as soon as OBIS_StreamFeed() returns true
+  */
+typedef struct
+{
+  const OBIS_Register_t *registers;
+  OBIS_Value_t          *values;
+  const char            *end_code;
+  uint8_t                register_count;
+
+  uint8_t  state;
+  char     code[OBIS_STREAM_CODE_MAX];
+  uint8_t  code_len;
+  int8_t   reg;            /* register of the current data set, -1 if not wanted */
+  bool     is_end;         /* current data set is end_code */
+
+  uint32_t acc;            /* fixed-point accumulator of the current value */
+  uint8_t  frac_digits;
+  uint8_t  num_flags;
+
+  bool     complete;
+} OBIS_Stream_t;
+
+void OBIS_StreamInit(OBIS_Stream_t *stream, const OBIS_Register_t *registers, uint8_t register_count,
+                     OBIS_Value_t *values, const char *end_code);
+void OBIS_StreamReset(OBIS_Stream_t *stream);
+bool OBIS_StreamFeed(OBIS_Stream_t *stream, uint8_t byte);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __OBIS_STREAM_H__ */
@@ -0,0 +1,178 @@
+/*
+ * power_profile.c
+ * Time per power state, measured with the RTC ticks of the timer server, and the
+ * charge it represents.
+ */
+
+#include <stdbool.h>
+#include "platform.h"
+#include "sys_app.h"
+#include "timer_if.h"
+#include "utilities_conf.h"
+#include "power_profile.h"
+
+/* RTC ticks per second, as configured for the timer server */
+#define POWER_TICKS_SHIFT  RTC_N_PREDIV_S
+#define NAS_PER_UAH        3600000ULL
+
+typedef struct
+{
+  uint8_t     domain;   /* PowerDomain_t */
+  uint32_t    current;  /* nA */
+  const char *name;
+} PowerState_Info_t;
+
+#define POWER_STATE_INFO(id, domain, current, name) [id] = { domain, current, name },
+static const PowerState_Info_t power_state_info[POWER_STATE_COUNT] =
+{
+  POWER_STATES(POWER_STATE_INFO)
+};
+
+static uint64_t power_ticks[POWER_STATE_COUNT];       /* RTC ticks spent in each state */
+static uint32_t power_since[POWER_DOMAIN_COUNT];      /* RTC tick of the last change of the domain */
+static uint8_t power_state[POWER_DOMAIN_COUNT];       /* current state of the domain */
+static volatile bool power_started = false;
+
+/**
+  * @brief  Charge the time since the last change of a domain to its current state
+  * @note   Called with interrupts disabled. 32-bit tick differences wrap after 48
+  *         days: PowerProfile_GetSummary() folds every domain well before that.
+  */
+static void Accumulate(uint8_t domain, uint32_t now)
+{
+  power_ticks[power_state[domain]] += (uint32_t)(now - power_since[domain]);
+  power_since[domain] = now;
+}
+
+void PowerProfile_Init(void)
+{
+  uint32_t now = TIMER_IF_GetTimerValue();
+
+  for (uint8_t domain = 0; domain < POWER_DOMAIN_COUNT; domain++)
+  {
+    power_since[domain] = now;
+    for (uint8_t state = POWER_STATE_COUNT; state > 0U; state--)
+    {
+      if (power_state_info[state - 1U].domain == domain)
+      {
+        power_state[domain] = state - 1U;
+      }
+    }
+  }
+  power_started = true;
+}
+
+void PowerProfile_Enter(PowerState_t state)
+{
+  uint8_t domain;
+
+  if (!power_started || state >= POWER_STATE_COUNT)
+  {
+    return;
+  }
+  domain = power_state_info[state].domain;
+
+  UTILS_ENTER_CRITICAL_SECTION();
+  Accumulate(domain, TIMER_IF_GetTimerValue());
+  power_state[domain] = (uint8_t)state;
+  UTILS_EXIT_CRITICAL_SECTION();
+}
+
+/**
+  * @brief  Ticks of every state up to now
+  */
+static void Snapshot(uint64_t *ticks)
+{
+  UTILS_ENTER_CRITICAL_SECTION();
+  if (power_started)
+  {
+    uint32_t now = TIMER_IF_GetTimerValue();
+
+    for (uint8_t domain = 0; domain < POWER_DOMAIN_COUNT; domain++)
+    {
+      Accumulate(domain, now);
+    }
+  }
+  for (uint8_t state = 0; state < POWER_STATE_COUNT; state++)
+  {
+    ticks[state] = power_ticks[state];
+  }
+  UTILS_EXIT_CRITICAL_SECTION();
+}
+
+/**
+  * @brief  Charge of a state in nA.s
+  */
+static uint64_t StateCharge(const uint64_t *ticks, uint8_t state)
+{
+  return (ticks[state] * power_state_info[state].current) >> POWER_TICKS_SHIFT;
+}
+
+static void Summarize(const uint64_t *ticks, PowerProfile_Summary_t *summary)
+{
+  uint64_t charge[POWER_DOMAIN_COUNT] = { 0 };
+  uint64_t time = 0;
+  uint64_t total = 0;
+
+  for (uint8_t state = 0; state < POWER_STATE_COUNT; state++)
+  {
+    charge[power_state_info[state].domain] += StateCharge(ticks, state);
+    if (power_state_info[state].domain == POWER_DOMAIN_MCU)
+    {
+      time += ticks[state]; /* Every instant is in exactly one MCU state */
+    }
+  }
+
+  summary->seconds = (uint32_t)(time >> POWER_TICKS_SHIFT);
+  for (uint8_t domain = 0; domain < POWER_DOMAIN_COUNT; domain++)
+  {
+    summary->charge[domain] = (uint32_t)(charge[domain] / NAS_PER_UAH);
+    total += charge[domain];
+  }
+  summary->average = (summary->seconds > 0U) ? (uint32_t)(total / summary->seconds / 1000U) : 0U;
+}
+
+void PowerProfile_GetSummary(PowerProfile_Summary_t *summary)
+{
+  uint64_t ticks[POWER_STATE_COUNT];
+
+  Snapshot(ticks);
+  Summarize(ticks, summary);
+}
+
+void PowerProfile_Log(void)
+{
+  uint64_t ticks[POWER_STATE_COUNT];
+  PowerProfile_Summary_t summary;
+  uint32_t used = 0;
+
+  Snapshot(ticks);
+  Summarize(ticks, &summary);
+
+  APP_LOG(TS_ON, VLEVEL_M, "Consumo en %u s:\r\n", (unsigned int)summary.seconds);
+  for (uint8_t state = 0; state < POWER_STATE_COUNT; state++)
+  {
+    if (ticks[state] == 0U)
+    {
+      continue;
+    }
+    APP_LOG(TS_OFF, VLEVEL_M, "  %s: %u s, %u uAh\r\n", power_state_info[state].name,
+            (unsigned int)(ticks[state] >> POWER_TICKS_SHIFT),
+            (unsigned int)(StateCharge(ticks, state) / NAS_PER_UAH));
+  }
+  for (uint8_t domain = 0; domain < POWER_DOMAIN_COUNT; domain++)
+  {
+    used += summary.charge[domain];
+  }
+
+  if (summary.average == 0U)
+  {
+    APP_LOG(TS_OFF, VLEVEL_M, "  Total: %u uAh\r\n", (unsigned int)used);
+    return;
+  }
+  /* Remaining capacity at the average current so far */
+  APP_LOG(TS_OFF, VLEVEL_M, "  Total: %u uAh, %u uA promedio, bateria de %u mAh para ~%u dias\r\n",
+          (unsigned int)used, (unsigned int)summary.average, (unsigned int)POWER_BATTERY_CAPACITY,
+          (unsigned int)((used < POWER_BATTERY_CAPACITY * 1000U) ?
+                         (POWER_BATTERY_CAPACITY * 1000U - used) / summary.average / 24U : 0U));
+}
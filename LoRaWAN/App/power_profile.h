@@ -0,0 +1,120 @@
+/*
+ * power_profile.h
+ * Charge accounting per power state: the LPM driver, the radio driver, the
+ * meter port and the Flash driver report their state changes, the time spent
+ * in each state is accumulated from the RTC and turned into charge with the
+ * currents below.
+ * This file is outside CubeMX-managed files so it won't be overwritten.
+ */
+#ifndef __POWER_PROFILE_H__
+#define __POWER_PROFILE_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+  * @brief Current drawn in each state (nA). Datasheet figures at 3.3 V: replace them
+  *        with the ones measured on the board.
+  */
+#define POWER_CURRENT_MCU_RUN        3600000U  /* Run, MSI 48 MHz, range 1 */
+#define POWER_CURRENT_MCU_SLEEP      1000000U  /* Sleep, MSI 48 MHz */
+#define POWER_CURRENT_MCU_RUN_LOW    1300000U  /* Run, MSI 16 MHz, range 2 (clock_profile.h) */
+#define POWER_CURRENT_MCU_SLEEP_LOW  400000U   /* Sleep, MSI 16 MHz, range 2 */
+#define POWER_CURRENT_MCU_STOP1      6000U     /* Stop1 with RTC, USART1 wakeup armed */
+#define POWER_CURRENT_MCU_STOP2      1200U     /* Stop2 with RTC */
+#define POWER_CURRENT_RADIO_SLEEP    0U        /* Included in the MCU figures */
+#define POWER_CURRENT_RADIO_STANDBY  600000U   /* Standby RC, between TX and the RX windows */
+#define POWER_CURRENT_RADIO_RX       4800000U  /* LoRa 125 kHz, DC-DC */
+#define POWER_CURRENT_RADIO_TX       90000000U /* RFO_HP at +20 dBm */
+#define POWER_CURRENT_METER_OFF      0U
+#define POWER_CURRENT_METER_LISTEN   150000U   /* Optical head and level shifter while USART1 listens */
+#define POWER_CURRENT_FLASH_IDLE     0U
+#define POWER_CURRENT_FLASH_BUSY     3500000U  /* Page erase or programming, on top of Run */
+
+/**
+  * @brief Battery capacity used for the life estimate (mAh)
+  */
+#define POWER_BATTERY_CAPACITY       2600U
+
+/**
+  * @brief Parts of the board whose states are accounted independently
+  */
+typedef enum
+{
+  POWER_DOMAIN_MCU,
+  POWER_DOMAIN_RADIO,
+  POWER_DOMAIN_METER,
+  POWER_DOMAIN_FLASH,
+  POWER_DOMAIN_COUNT
+} PowerDomain_t;
+
+/**
+  * @brief States: id, domain, current and log name. The first state of each domain
+  *        is the one it starts in.
+  */
+#define POWER_STATES(X) \
+  X(POWER_STATE_MCU_RUN,       POWER_DOMAIN_MCU,   POWER_CURRENT_MCU_RUN,       "MCU activo")          \
+  X(POWER_STATE_MCU_SLEEP,     POWER_DOMAIN_MCU,   POWER_CURRENT_MCU_SLEEP,     "MCU Sleep")           \
+  X(POWER_STATE_MCU_RUN_LOW,   POWER_DOMAIN_MCU,   POWER_CURRENT_MCU_RUN_LOW,   "MCU activo lento")    \
+  X(POWER_STATE_MCU_SLEEP_LOW, POWER_DOMAIN_MCU,   POWER_CURRENT_MCU_SLEEP_LOW, "MCU Sleep lento")     \
+  X(POWER_STATE_MCU_STOP1,     POWER_DOMAIN_MCU,   POWER_CURRENT_MCU_STOP1,     "MCU Stop1")           \
+  X(POWER_STATE_MCU_STOP2,     POWER_DOMAIN_MCU,   POWER_CURRENT_MCU_STOP2,     "MCU Stop2")           \
+  X(POWER_STATE_RADIO_SLEEP,   POWER_DOMAIN_RADIO, POWER_CURRENT_RADIO_SLEEP,   "Radio Sleep")         \
+  X(POWER_STATE_RADIO_STANDBY, POWER_DOMAIN_RADIO, POWER_CURRENT_RADIO_STANDBY, "Radio Standby")       \
+  X(POWER_STATE_RADIO_RX,      POWER_DOMAIN_RADIO, POWER_CURRENT_RADIO_RX,      "Radio RX")            \
+  X(POWER_STATE_RADIO_TX,      POWER_DOMAIN_RADIO, POWER_CURRENT_RADIO_TX,      "Radio TX")            \
+  X(POWER_STATE_METER_OFF,     POWER_DOMAIN_METER, POWER_CURRENT_METER_OFF,     "Puerto medidor off")  \
+  X(POWER_STATE_METER_LISTEN,  POWER_DOMAIN_METER, POWER_CURRENT_METER_LISTEN,  "Puerto medidor RX")   \
+  X(POWER_STATE_FLASH_IDLE,    POWER_DOMAIN_FLASH, POWER_CURRENT_FLASH_IDLE,    "Flash inactiva")      \
+  X(POWER_STATE_FLASH_BUSY,    POWER_DOMAIN_FLASH, POWER_CURRENT_FLASH_BUSY,    "Flash escribiendo")
+
+#define POWER_STATE_ENUM(id, domain, current, name) id,
+typedef enum
+{
+  POWER_STATES(POWER_STATE_ENUM)
+  POWER_STATE_COUNT
+} PowerState_t;
+#undef POWER_STATE_ENUM
+
+/**
+  * @brief Totals since PowerProfile_Init()
+  */
+typedef struct
+{
+  uint32_t seconds;                      /* accounted time */
+  uint32_t charge[POWER_DOMAIN_COUNT];   /* uAh per domain */
+  uint32_t average;                      /* uA over the accounted time, all domains */
+} PowerProfile_Summary_t;
+
+/**
+  * @brief Start accounting. Call once the RTC timer is running (UTIL_TIMER_Init()).
+  */
+void PowerProfile_Init(void);
+
+/**
+  * @brief  Record a state change (any context, including interrupts)
+  * @note   Constant time: charges the time since the last change of the domain to
+  *         the state it leaves. Ignored before PowerProfile_Init().
+  * @param  state state its domain enters
+  */
+void PowerProfile_Enter(PowerState_t state);
+
+/**
+  * @brief  Totals up to now
+  * @param  summary output
+  */
+void PowerProfile_GetSummary(PowerProfile_Summary_t *summary);
+
+/**
+  * @brief  Print the time and charge of every state and the battery life estimate
+  */
+void PowerProfile_Log(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __POWER_PROFILE_H__ */
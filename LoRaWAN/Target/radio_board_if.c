@@ -22,7 +22,7 @@
 #include "radio_board_if.h"
 
 /* USER CODE BEGIN Includes */
-
+#include "power_profile.h"
 /* USER CODE END Includes */
 
 /* External variables ---------------------------------------------------------*/
@@ -111,7 +111,11 @@ int32_t RBI_DeInit(void)
 int32_t RBI_ConfigRFSwitch(RBI_Switch_TypeDef Config)
 {
   /* USER CODE BEGIN RBI_ConfigRFSwitch_1 */
-
+  /* The switch is only turned off when the radio goes to sleep (SUBGRF_SetSleep) */
+  if (Config == RBI_SWITCH_OFF)
+  {
+    PowerProfile_Enter(POWER_STATE_RADIO_SLEEP);
+  }
   /* USER CODE END RBI_ConfigRFSwitch_1 */
 #if defined(USE_BSP_DRIVER)
 
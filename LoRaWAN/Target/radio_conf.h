@@ -35,7 +35,7 @@ extern "C" {
 #include "utilities_def.h"  /* low layer api (bsp) */
 #include "sys_debug.h"
 /* USER CODE BEGIN include */
-
+#include "power_profile.h"
 /* USER CODE END include */
 
 /* Exported types ------------------------------------------------------------*/
@@ -136,7 +136,17 @@ extern "C" {
 #define RADIO_MEMCPY8( dest, src, size )        UTIL_MEM_cpy_8( dest, src, size )
 
 /* USER CODE BEGIN EM */
-
+/**
+  * @brief Radio activity for the charge accounting: the driver sets these when TX or RX
+  *        starts and resets them on done/timeout, leaving the radio in standby
+  * @note override the default (empty) probes of radio.c
+  */
+#define DBG_GPIO_RADIO_TX(set_rst)  PowerProfile_Enter(POWER_RADIO_TX_##set_rst)
+#define DBG_GPIO_RADIO_RX(set_rst)  PowerProfile_Enter(POWER_RADIO_RX_##set_rst)
+#define POWER_RADIO_TX_SET          POWER_STATE_RADIO_TX
+#define POWER_RADIO_TX_RST          POWER_STATE_RADIO_STANDBY
+#define POWER_RADIO_RX_SET          POWER_STATE_RADIO_RX
+#define POWER_RADIO_RX_RST          POWER_STATE_RADIO_STANDBY
 /* USER CODE END EM */
 
 /* Exported functions prototypes ---------------------------------------------*/
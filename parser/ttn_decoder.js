@@ -51,6 +51,15 @@ function encodeDownlink(input) {
         // CMD: 0xFF03 + interval (Little-Endian)
         var interval = data.interval_seconds || 0;
         bytes = [0xFF, 0x03, interval & 0xFF, (interval >> 8) & 0xFF];
+    } else if (data.command === "set_batch_size") {
+        // CMD: 0xFF04 + readings per uplink (0 = default)
+        bytes = [0xFF, 0x04, (data.batch_size || 0) & 0xFF];
+    } else if (data.command === "set_payload_format") {
+        // CMD: 0xFF05 + format (0 = TLV, 1 = compact)
+        bytes = [0xFF, 0x05, data.payload_format === "compact" ? 1 : 0];
+    } else if (data.command === "set_report_refresh") {
+        // CMD: 0xFF06 + uplinks between full reports (0 = report by exception off)
+        bytes = [0xFF, 0x06, (data.refresh_uplinks || 0) & 0xFF];
     } else if (data.command === "reset") {
         // CMD: 0xFF10FF
         bytes = [0xFF, 0x10, 0xFF];
@@ -83,6 +92,106 @@ function readUInt16BE(bytes) {
     return ((bytes[0] << 8) >>> 0) + (bytes[1] >>> 0);
 }
 
+// Registers of a batch (0x07) or compact (0x08) reading, in mask bit order (same names as their TLV)
+var REGISTER_FIELDS = [
+    { name: "active_energy", size: 4 },       // 0x0A
+    { name: "reactive_energy", size: 4 },     // 0x0B
+    { name: "peak_demand", size: 2 },         // 0x28
+    { name: "active_consumed", size: 4 },     // 0x3C
+    { name: "active_generated", size: 4 },    // 0x3D
+    { name: "reactive_consumed", size: 4 },   // 0x3E
+    { name: "reactive_generated", size: 4 },  // 0x3F
+    { name: "serial_number", size: 4 }        // 0x5A
+];
+
+// TLV 0x07: count, base timestamp, then per reading offset (2 bytes), mask and values
+function decodeBatch(bytes, i, decoded) {
+    var count = bytes[i];
+    var base = readUInt32BE(bytes.slice(i + 1, i + 5));
+    i += 5;
+    decoded.readings = [];
+    for (var n = 0; n < count; n++) {
+        var reading = { timestamp: base + readUInt16BE(bytes.slice(i, i + 2)) };
+        var mask = bytes[i + 2];
+        i += 3;
+        for (var b = 0; b < REGISTER_FIELDS.length; b++) {
+            if (mask & (1 << b)) {
+                var f = REGISTER_FIELDS[b];
+                reading[f.name] = (f.size === 4) ? readUInt32BE(bytes.slice(i, i + 4)) : readUInt16BE(bytes.slice(i, i + 2));
+                i += f.size;
+            }
+        }
+        decoded.readings.push(reading);
+    }
+    return i;
+}
+
+function readVarint(bytes, i) {
+    var value = 0;
+    var scale = 1;
+    var b;
+    do {
+        b = bytes[i++];
+        value += (b & 0x7f) * scale;
+        scale *= 128;
+    } while (b & 0x80);
+    return { value: value, next: i };
+}
+
+// TLV 0x08 (compact format): version << 4 | kind, keyframe id, mask, then a varint per register.
+// Keyframe (kind 0): absolute values; one that does not fit the datarate comes in parts with the
+// same id, the keyframe is the union of its parts. Delta (kind 1): zigzag difference to the
+// keyframe with the same id, only for registers that changed; the application adds them to it.
+function decodeCompact(bytes, i, decoded) {
+    var version = bytes[i] >> 4;
+    var kind = bytes[i] & 0x0f;
+    var mask = bytes[i + 2];
+    if (version !== 1) {
+        throw new Error("Unsupported compact payload version: " + version);
+    }
+    decoded.keyframe_id = bytes[i + 1];
+    decoded.keyframe = (kind === 0);
+    var target = decoded;
+    if (kind !== 0) {
+        decoded.delta = {};
+        target = decoded.delta;
+    }
+    i += 3;
+    for (var b = 0; b < REGISTER_FIELDS.length; b++) {
+        if (mask & (1 << b)) {
+            var v = readVarint(bytes, i);
+            i = v.next;
+            target[REGISTER_FIELDS[b].name] = (kind === 0) ? v.value : ((v.value % 2) ? -(v.value + 1) / 2 : v.value / 2);
+        }
+    }
+    return i;
+}
+
+// Battery the life estimate of TLV 0x09 is computed for (mAh), as POWER_BATTERY_CAPACITY in the firmware
+var BATTERY_CAPACITY_MAH = 2600;
+
+// TLV 0x09: accounted seconds, then the charge of each power domain (10 uAh units), cumulative since boot
+function decodePower(bytes, i, decoded) {
+    var domains = ["mcu", "radio", "meter_port", "flash"];
+    var seconds = readUInt32BE(bytes.slice(i, i + 4));
+    var total = 0;
+    var power = { seconds: seconds, charge_mah: {} };
+    i += 4;
+    for (var d = 0; d < domains.length; d++) {
+        var uah = readUInt24BE(bytes.slice(i, i + 3)) * 10;
+        power.charge_mah[domains[d]] = uah / 1000;
+        total += uah;
+        i += 3;
+    }
+    power.total_mah = total / 1000;
+    if (seconds > 0 && total > 0) {
+        power.average_ua = Math.round(total * 3600 / seconds);
+        power.battery_life_days = Math.max(0, Math.round((BATTERY_CAPACITY_MAH * 1000 - total) / (total * 3600 / seconds) / 24));
+    }
+    decoded.power = power;
+    return i;
+}
+
 // ============= Main Decoder =============
 
 function edcEnergy(bytes) {
@@ -94,6 +203,10 @@ function edcEnergy(bytes) {
         else if (channel_id === 0x03) { decoded.read_error = (bytes[i] === 0 ? 0 : 1); i += 1; }
         else if (channel_id === 0x04) { decoded.network_state = (bytes[i] === 0 ? 0 : 1); i += 1; }
         else if (channel_id === 0x05) { decoded.firmware = bytes[i]; i += 1; }
+        else if (channel_id === 0x06) { decoded.timestamp = readUInt32BE(bytes.slice(i, i + 4)); i += 4; }
+        else if (channel_id === 0x07) { i = decodeBatch(bytes, i, decoded); }
+        else if (channel_id === 0x08) { i = decodeCompact(bytes, i, decoded); }
+        else if (channel_id === 0x09) { i = decodePower(bytes, i, decoded); }
 
         else if (channel_id === 0x0a) { decoded.active_energy = readUInt32BE(bytes.slice(i, i + 4)); i += 4; }
         else if (channel_id === 0x0b) { decoded.reactive_energy = readUInt32BE(bytes.slice(i, i + 4)); i += 4; }
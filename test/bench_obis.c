@@ -0,0 +1,129 @@
+/*
+ * bench_obis.c
+ * Frame decode benchmark: the one-pass decoder (OBIS_StreamFeed(), fed byte by
+ * byte as from the UART) against the former per-field strstr() lookups over a
+ * copied, NUL terminated frame (legacy_obis.c). Both must decode the same
+ * values from every frame of test/frames; the timings are printed only.
+ *   bench_obis [iterations]
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+#include "test_util.h"
+#include "obis_stream.h"
+#include "legacy_obis.h"
+
+#define FRAME_MAX  512U
+
+/* Registers of the uplink, as METER_FIELDS in lora_app.c */
+static const OBIS_Register_t registers[] =
+{
+  { "15.8.0", 0 }, { "130.8.0", 0 }, { "1.6.0", 3 }, { "1.8.0", 0 },
+  { "2.8.0", 0 }, { "3.8.0", 0 }, { "4.8.0", 0 }, { "C.1.0", 0 },
+};
+#define REGISTER_COUNT  (sizeof(registers) / sizeof(registers[0]))
+
+static const char *const frame_files[] =
+{
+  "hxe310_readout.txt", "hxe310_push_crc.txt", "hxe310_partial.txt",
+};
+#define FRAME_COUNT  (sizeof(frame_files) / sizeof(frame_files[0]))
+
+static uint8_t frames[FRAME_COUNT][FRAME_MAX];
+static size_t frame_len[FRAME_COUNT];
+
+static double Now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void DecodeStream(const uint8_t *frame, size_t len, OBIS_Value_t *values)
+{
+  OBIS_Stream_t stream;
+
+  OBIS_StreamInit(&stream, registers, REGISTER_COUNT, values, "C.1.0");
+  for (size_t i = 0; i < len; i++)
+  {
+    if (OBIS_StreamFeed(&stream, frame[i]))
+    {
+      break;
+    }
+  }
+}
+
+static void DecodeLegacy(const uint8_t *frame, size_t len, OBIS_Value_t *values)
+{
+  char copy[FRAME_MAX + 1U];
+
+  memcpy(copy, frame, len);
+  copy[len] = '\0';
+  for (uint8_t n = 0; n < REGISTER_COUNT; n++)
+  {
+    values[n].valid = LegacyObis_GetFixed(copy, registers[n].code, registers[n].decimals, &values[n].value);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  long iterations = (argc > 1) ? atol(argv[1]) : 200000L;
+  volatile int32_t sink = 0;
+  double start;
+  double stream_ns;
+  double legacy_ns;
+
+  for (size_t f = 0; f < FRAME_COUNT; f++)
+  {
+    char path[256];
+    OBIS_Value_t a[REGISTER_COUNT];
+    OBIS_Value_t b[REGISTER_COUNT];
+
+    snprintf(path, sizeof(path), "%s/%s", FRAMES_DIR, frame_files[f]);
+    frame_len[f] = ReadFile(path, frames[f], FRAME_MAX);
+    CHECK(frame_len[f] > 0U);
+
+    DecodeStream(frames[f], frame_len[f], a);
+    DecodeLegacy(frames[f], frame_len[f], b);
+    for (uint8_t n = 0; n < REGISTER_COUNT; n++)
+    {
+      CHECK_EQ(a[n].valid, b[n].valid);
+      if (a[n].valid && b[n].valid)
+      {
+        CHECK_EQ(a[n].value, b[n].value);
+      }
+    }
+  }
+
+  start = Now();
+  for (long i = 0; i < iterations; i++)
+  {
+    OBIS_Value_t values[REGISTER_COUNT];
+    size_t f = (size_t)i % FRAME_COUNT;
+
+    DecodeStream(frames[f], frame_len[f], values);
+    sink += values[0].value;
+  }
+  stream_ns = (Now() - start) / (double)iterations;
+
+  start = Now();
+  for (long i = 0; i < iterations; i++)
+  {
+    OBIS_Value_t values[REGISTER_COUNT];
+    size_t f = (size_t)i % FRAME_COUNT;
+
+    DecodeLegacy(frames[f], frame_len[f], values);
+    sink += values[0].value;
+  }
+  legacy_ns = (Now() - start) / (double)iterations;
+
+  printf("%ld frames, %u registers each\n", iterations, (unsigned int)REGISTER_COUNT);
+  printf("  one-pass decoder:      %8.1f ns/frame\n", stream_ns);
+  printf("  per-field strstr():    %8.1f ns/frame (x%.2f)\n", legacy_ns, legacy_ns / stream_ns);
+  (void)sink;
+
+  TEST_DONE();
+}
@@ -0,0 +1,25 @@
+/*
+ * fuzz.h
+ * Entry point of the fuzz targets, in the libFuzzer convention: one call per
+ * input, a broken invariant aborts. Built with clang they link to libFuzzer;
+ * otherwise fuzz_main.c drives them from the seed corpus (test/corpus).
+ */
+#ifndef __FUZZ_H__
+#define __FUZZ_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define FUZZ_CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: FUZZ_CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      abort(); \
+    } \
+  } while (0)
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+#endif /* __FUZZ_H__ */
@@ -0,0 +1,89 @@
+/*
+ * fuzz_downlink.c
+ * Fuzz target of the downlink configuration (device_config.c): the input is
+ * the copy read from Flash at boot followed by a sequence of port 85 commands.
+ *   input: [8 bytes DeviceConfig_t as stored][len][command]...[len][command]
+ * Invariants, after the load and after every command: every setting is in the
+ * range a downlink can set (interval, batch size, payload format, report
+ * refresh), what is saved to Flash loads back unchanged, and a command that
+ * reports no setting change leaves the configuration as it was.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "fuzz.h"
+#include "device_config.h"
+
+static void CheckConfig(const DeviceConfig_t *config)
+{
+  DeviceConfig_t reloaded;
+
+  FUZZ_CHECK(config->reporting_interval_ms == 0U ||
+             (config->reporting_interval_ms >= MIN_REPORTING_INTERVAL * 1000U &&
+              config->reporting_interval_ms <= MAX_REPORTING_INTERVAL * 1000U &&
+              (config->reporting_interval_ms % 1000U) == 0U));
+  FUZZ_CHECK(config->batch_size <= METER_BATCH_MAX);
+  FUZZ_CHECK(config->payload_format < PAYLOAD_FORMAT_COUNT);
+  FUZZ_CHECK(config->report_refresh <= MAX_REPORT_REFRESH);
+
+  /* SaveDeviceConfig() then LoadDeviceConfig() after a reset */
+  FUZZ_CHECK(DeviceConfig_Load(&reloaded, config) == (config->config_valid == CONFIG_MAGIC));
+  FUZZ_CHECK(memcmp(&reloaded, config, sizeof(DeviceConfig_t)) == 0);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  DeviceConfig_t stored;
+  DeviceConfig_t config;
+  size_t pos = sizeof(DeviceConfig_t);
+
+  if (size < sizeof(DeviceConfig_t))
+  {
+    return 0;
+  }
+  memcpy(&stored, data, sizeof(DeviceConfig_t));
+  DeviceConfig_Load(&config, &stored);
+  CheckConfig(&config);
+
+  while (pos < size)
+  {
+    uint8_t len = data[pos++];
+    DeviceConfig_t before = config;
+    DeviceConfig_Change_t change;
+    uint16_t cmd_id;
+    uint8_t *command;
+
+    if (len > size - pos)
+    {
+      len = (uint8_t)(size - pos);
+    }
+    /* A copy of exactly len bytes, so that a read past the command is caught (ASan) */
+    command = (len != 0U) ? malloc(len) : NULL;
+    if (command != NULL)
+    {
+      memcpy(command, &data[pos], len);
+    }
+    change = DeviceConfig_ApplyCommand(&config, command, len);
+    cmd_id = (len >= 2U) ? (uint16_t)((command[0] << 8) | command[1]) : 0U;
+    free(command);
+    pos += len;
+
+    CheckConfig(&config);
+    switch (change)
+    {
+      case DEVICE_CONFIG_NONE:
+      case DEVICE_CONFIG_RESET:
+      case DEVICE_CONFIG_FACTORY_RESET:
+        FUZZ_CHECK(memcmp(&before, &config, sizeof(DeviceConfig_t)) == 0);
+        FUZZ_CHECK(change == DEVICE_CONFIG_NONE || cmd_id == CMD_RESET || cmd_id == CMD_FACTORY_RESET_LORAWAN);
+        break;
+
+      default:
+        FUZZ_CHECK(config.config_valid == CONFIG_MAGIC);
+        FUZZ_CHECK(cmd_id == CMD_SET_REPORTING_INTERVAL + (change - DEVICE_CONFIG_INTERVAL));
+        break;
+    }
+  }
+  return 0;
+}
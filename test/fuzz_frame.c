@@ -0,0 +1,201 @@
+/*
+ * fuzz_frame.c
+ * Fuzz target of the meter reception path: the input bytes arrive as a meter
+ * frame through the OBIS decoder and the BCC/CRC check (end of frame rule of
+ * MeterLink_Store() in meter_link.c), and whatever was decoded is encoded into
+ * the uplink by every encoder of meter_payload.c with the room of the input.
+ *   input: [room][ack bits][frame bytes...]
+ * Invariants: no encoder writes past its room, the TLVs of a reading (over as
+ * many frames as it takes) decode back to the registers that are in range,
+ * and a packed reading is as long as its presence mask says.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "fuzz.h"
+#include "obis_stream.h"
+#include "iec62056.h"
+#include "meter_payload.h"
+
+/* Largest LoRaWAN application payload (AU915 DR4..DR6) */
+#define ROOM_MAX   242U
+#define CANARY     0xA5U
+#define UPLINKS    6U
+
+/**
+  * @brief  Receive the frame as the firmware does, stop at its end
+  */
+static void Receive(const uint8_t *data, size_t len, OBIS_Value_t *values)
+{
+  OBIS_Stream_t stream;
+  IEC62056_Check_t check;
+
+  OBIS_StreamInit(&stream, meter_registers, METER_REG_COUNT, values, "C.1.0");
+  IEC62056_CheckReset(&check);
+  for (size_t i = 0; i < len; i++)
+  {
+    bool decoded = OBIS_StreamFeed(&stream, data[i]);
+
+    if (IEC62056_CheckFeed(&check, data[i]) != IEC62056_CHECK_PENDING || (decoded && !IEC62056_CheckOpen(&check)))
+    {
+      break;
+    }
+  }
+}
+
+/**
+  * @brief  Bytes past len untouched
+  */
+static bool Untouched(const uint8_t *buffer, size_t len, size_t size)
+{
+  for (size_t i = len; i < size; i++)
+  {
+    if (buffer[i] != CANARY)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+  * @brief  Encode the reading in as many TLV frames as it takes, decode them back
+  */
+static void CheckTlv(const OBIS_Value_t *values, uint8_t room)
+{
+  uint8_t buffer[ROOM_MAX + 16U];
+  uint8_t reg = 0;
+  uint8_t received = 0;
+  uint8_t expected = 0;
+
+  for (uint8_t n = 0; n < METER_REG_COUNT; n++)
+  {
+    uint32_t encoded;
+
+    expected |= MeterPayload_GetEncoded(values, n, &encoded) ? (uint8_t)(1U << n) : 0U;
+  }
+
+  while (reg < METER_REG_COUNT)
+  {
+    uint8_t first = reg;
+    uint8_t len;
+
+    memset(buffer, CANARY, sizeof(buffer));
+    len = MeterPayload_EncodeTlv(buffer, values, &reg, room);
+    FUZZ_CHECK(len <= room && Untouched(buffer, len, sizeof(buffer)));
+    if (reg == first)
+    {
+      /* Not even the next register fits: the firmware leaves it for a larger DR */
+      FUZZ_CHECK(len == 0U && room < 1U + meter_tlv[reg].width);
+      return;
+    }
+
+    for (uint8_t pos = 0; pos < len;)
+    {
+      uint8_t n = 0;
+      uint32_t sent = 0;
+      uint32_t encoded = 0;
+
+      while (n < METER_REG_COUNT && meter_tlv[n].id != buffer[pos])
+      {
+        n++;
+      }
+      FUZZ_CHECK(n < METER_REG_COUNT && (received & (1U << n)) == 0U);
+      FUZZ_CHECK(pos + 1U + meter_tlv[n].width <= len);
+      for (uint8_t b = 0; b < meter_tlv[n].width; b++)
+      {
+        sent = (sent << 8) | buffer[pos + 1U + b];
+      }
+      FUZZ_CHECK(MeterPayload_GetEncoded(values, n, &encoded) && sent == encoded);
+      received |= (uint8_t)(1U << n);
+      pos = (uint8_t)(pos + 1U + meter_tlv[n].width);
+    }
+  }
+  FUZZ_CHECK(received == expected);
+}
+
+static void CheckPacked(const OBIS_Value_t *values)
+{
+  uint8_t buffer[ROOM_MAX + 16U];
+  uint8_t expected = 1;
+  uint8_t len;
+
+  memset(buffer, CANARY, sizeof(buffer));
+  len = MeterPayload_EncodePacked(buffer, values);
+  for (uint8_t n = 0; n < METER_REG_COUNT; n++)
+  {
+    expected = (uint8_t)(expected + (((buffer[0] >> n) & 1U) != 0U ? meter_tlv[n].width : 0U));
+  }
+  FUZZ_CHECK(len == expected && Untouched(buffer, len, sizeof(buffer)));
+}
+
+static void CheckReport(const OBIS_Value_t *values, uint8_t room)
+{
+  uint32_t fields[REPORT_FIELD_COUNT] = { 0 };
+  uint8_t buffer[ROOM_MAX + 16U];
+  uint16_t wanted = (uint16_t)((1U << REPORT_FIELD_BATTERY) | (1U << REPORT_FIELD_NET_STATE));
+  uint16_t packed = 0;
+  uint8_t len;
+
+  for (uint8_t n = 0; n < METER_REG_COUNT; n++)
+  {
+    wanted |= MeterPayload_GetEncoded(values, n, &fields[n]) ? (uint16_t)(1U << n) : 0U;
+  }
+  memset(buffer, CANARY, sizeof(buffer));
+  len = MeterPayload_PackReport(buffer, room, fields, wanted, &packed);
+  FUZZ_CHECK(len <= room && Untouched(buffer, len, sizeof(buffer)));
+  FUZZ_CHECK((packed & ~wanted) == 0U);
+}
+
+/**
+  * @brief  Compact format over several uplinks of the reading (the energy registers
+  *         growing a little each time), acknowledged as the ack bits say
+  */
+static void CheckCompact(OBIS_Value_t *values, uint8_t room, uint8_t acks)
+{
+  MeterCompact_t compact;
+  uint8_t buffer[ROOM_MAX + 16U];
+
+  MeterPayload_CompactReset(&compact);
+  for (uint8_t uplink = 0; uplink < UPLINKS; uplink++)
+  {
+    uint8_t len;
+
+    memset(buffer, CANARY, sizeof(buffer));
+    len = MeterPayload_EncodeCompact(&compact, buffer, values, room);
+    FUZZ_CHECK(len <= room && Untouched(buffer, len, sizeof(buffer)));
+    FUZZ_CHECK(len == 0U || (len >= COMPACT_HEADER_SIZE && buffer[0] == TLV_ID_COMPACT));
+    if (len != 0U)
+    {
+      MeterPayload_CompactSent(&compact, ((acks >> uplink) & 1U) != 0U);
+    }
+
+    for (uint8_t n = 0; n < METER_REG_COUNT; n++)
+    {
+      if (values[n].value >= 0 && values[n].value < INT32_MAX - 1000)
+      {
+        values[n].value += (int32_t)(uplink * n);
+      }
+    }
+  }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  OBIS_Value_t values[METER_REG_COUNT];
+  uint8_t room;
+
+  if (size < 2U)
+  {
+    return 0;
+  }
+  room = (data[0] > ROOM_MAX) ? (uint8_t)ROOM_MAX : data[0];
+
+  Receive(&data[2], size - 2U, values);
+  CheckTlv(values, room);
+  CheckPacked(values);
+  CheckReport(values, room);
+  CheckCompact(values, room, data[1]);
+  return 0;
+}
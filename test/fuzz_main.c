@@ -0,0 +1,190 @@
+/*
+ * fuzz_main.c
+ * Driver of the fuzz targets where libFuzzer is not available (gcc): runs
+ * every file of the corpus given, then -runs=N random mutations of them
+ * (bit flips, byte changes, insertions, deletions, frame delimiters), with the
+ * same command line as a libFuzzer binary so ctest calls both alike.
+ *   fuzz_<target> [-runs=N] [-seed=N] <file or directory>...
+ * Not coverage guided: a smoke test of the invariants on every build. For a
+ * real campaign build with clang (-DCMAKE_C_COMPILER=clang).
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "fuzz.h"
+
+#define INPUT_MAX   1024U
+#define SEEDS_MAX   256U
+
+typedef struct
+{
+  uint8_t data[INPUT_MAX];
+  size_t  len;
+} Input_t;
+
+static Input_t seeds[SEEDS_MAX];
+static size_t seed_count = 0;
+static uint32_t rng = 1;
+
+/* Bytes that change the state of the frame decoder and the check */
+static const uint8_t special[] = { '/', '!', '(', ')', '*', '.', '-', ':', '\r', '\n', 0x02, 0x03, 0x00, 0xFF };
+
+static uint32_t Random(void)
+{
+  /* xorshift32 */
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+static void RunInput(const uint8_t *data, size_t len)
+{
+  /* Exactly len bytes, so that a read past the input is caught (ASan) */
+  uint8_t *copy = malloc((len != 0U) ? len : 1U);
+
+  memcpy(copy, data, len);
+  LLVMFuzzerTestOneInput(copy, len);
+  free(copy);
+}
+
+static void LoadFile(const char *path)
+{
+  FILE *f = fopen(path, "rb");
+  Input_t *seed = &seeds[seed_count];
+
+  if (f == NULL || seed_count >= SEEDS_MAX)
+  {
+    printf("cannot load %s\n", path);
+    if (f != NULL)
+    {
+      fclose(f);
+    }
+    return;
+  }
+  seed->len = fread(seed->data, 1, INPUT_MAX, f);
+  fclose(f);
+  RunInput(seed->data, seed->len);
+  seed_count++;
+}
+
+static void LoadPath(const char *path)
+{
+  struct stat st;
+  DIR *dir;
+  struct dirent *entry;
+
+  if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+  {
+    LoadFile(path);
+    return;
+  }
+  dir = opendir(path);
+  while (dir != NULL && (entry = readdir(dir)) != NULL)
+  {
+    char file[512];
+
+    if (entry->d_name[0] == '.')
+    {
+      continue;
+    }
+    snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+    LoadFile(file);
+  }
+  if (dir != NULL)
+  {
+    closedir(dir);
+  }
+}
+
+static void Mutate(Input_t *input)
+{
+  uint32_t count = 1U + Random() % 4U;
+
+  for (uint32_t n = 0; n < count; n++)
+  {
+    size_t pos = (input->len != 0U) ? Random() % input->len : 0U;
+
+    switch (Random() % 6U)
+    {
+      case 0:  /* bit flip */
+        if (input->len != 0U)
+        {
+          input->data[pos] ^= (uint8_t)(1U << (Random() % 8U));
+        }
+        break;
+      case 1:  /* any byte */
+        if (input->len != 0U)
+        {
+          input->data[pos] = (uint8_t)Random();
+        }
+        break;
+      case 2:  /* delimiter */
+        if (input->len != 0U)
+        {
+          input->data[pos] = special[Random() % sizeof(special)];
+        }
+        break;
+      case 3:  /* insert */
+        if (input->len < INPUT_MAX)
+        {
+          memmove(&input->data[pos + 1U], &input->data[pos], input->len - pos);
+          input->data[pos] = ((Random() & 1U) != 0U) ? special[Random() % sizeof(special)] : (uint8_t)('0' + Random() % 10U);
+          input->len++;
+        }
+        break;
+      case 4:  /* delete */
+        if (input->len != 0U)
+        {
+          memmove(&input->data[pos], &input->data[pos + 1U], input->len - pos - 1U);
+          input->len--;
+        }
+        break;
+      default:  /* truncate */
+        input->len = pos;
+        break;
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  long runs = 0;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (strncmp(argv[i], "-runs=", 6) == 0)
+    {
+      runs = atol(&argv[i][6]);
+    }
+    else if (strncmp(argv[i], "-seed=", 6) == 0)
+    {
+      rng = (uint32_t)strtoul(&argv[i][6], NULL, 0);
+      rng = (rng != 0U) ? rng : 1U;
+    }
+    else if (argv[i][0] != '-')
+    {
+      LoadPath(argv[i]);
+    }
+  }
+  if (seed_count == 0U)
+  {
+    printf("no corpus\n");
+    return 1;
+  }
+
+  for (long r = 0; r < runs; r++)
+  {
+    Input_t input = seeds[Random() % seed_count];
+
+    Mutate(&input);
+    RunInput(input.data, input.len);
+  }
+  printf("%u corpus inputs, %ld mutations: ok\n", (unsigned int)seed_count, runs);
+  return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * legacy_obis.c
+ * Per-field strstr() lookup, fixed-point value (see legacy_obis.h).
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "legacy_obis.h"
+
+/**
+  * @brief  Find "code(" in the frame and parse its value as value * 10^decimals
+  * @param  frame NUL terminated frame
+  * @param  code OBIS code without '(' (e.g. "1.8.0")
+  * @param  decimals decimals kept, extra ones truncated
+  * @param  result scaled value
+  * @retval true if found and numeric within int32 range
+  */
+bool LegacyObis_GetFixed(const char *frame, const char *code, uint8_t decimals, int32_t *result)
+{
+  char marker[24];
+  size_t code_len = strlen(code);
+  const char *pos = frame;
+  bool negative = false;
+  bool digit_seen = false;
+  bool in_fraction = false;
+  uint8_t fraction_digits = 0;
+  uint32_t value = 0;
+
+  if (code_len + 2U > sizeof(marker))
+  {
+    return false;
+  }
+  memcpy(marker, code, code_len);
+  marker[code_len] = '(';
+  marker[code_len + 1U] = '\0';
+
+  /* The code must start the data set or follow the "1-0:" medium/channel prefix */
+  do
+  {
+    pos = strstr(pos, marker);
+    if (pos == NULL)
+    {
+      return false;
+    }
+    if (pos == frame || pos[-1] == '\n' || pos[-1] == ':' || pos[-1] == '\x02' || pos[-1] == ')')
+    {
+      break;
+    }
+    pos++;
+  } while (1);
+  pos += code_len + 1U;
+
+  if (*pos == '+' || *pos == '-')
+  {
+    negative = (*pos == '-');
+    pos++;
+  }
+  for (; *pos != '\0'; pos++)
+  {
+    char c = *pos;
+    if (c == '.' && !in_fraction)
+    {
+      in_fraction = true;
+      continue;
+    }
+    if (c < '0' || c > '9')
+    {
+      break;
+    }
+    digit_seen = true;
+    if (in_fraction)
+    {
+      if (fraction_digits >= decimals)
+      {
+        continue;
+      }
+      fraction_digits++;
+    }
+    uint32_t digit = (uint32_t)(c - '0');
+    if (value > ((uint32_t)INT32_MAX - digit) / 10U)
+    {
+      return false;
+    }
+    value = value * 10U + digit;
+  }
+  if (!digit_seen)
+  {
+    return false;
+  }
+  for (; fraction_digits < decimals; fraction_digits++)
+  {
+    if (value > (uint32_t)INT32_MAX / 10U)
+    {
+      return false;
+    }
+    value *= 10U;
+  }
+
+  *result = negative ? -(int32_t)value : (int32_t)value;
+  return true;
+}
@@ -0,0 +1,16 @@
+/*
+ * legacy_obis.h
+ * Reference copy of the per-field OBIS string lookup the firmware used before
+ * the one-pass decoder (obis_stream.c): one strstr() over the NUL terminated
+ * frame per register. Only built on the host, as the baseline of
+ * bench_obis.c; not part of the firmware.
+ */
+#ifndef __LEGACY_OBIS_H__
+#define __LEGACY_OBIS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+bool LegacyObis_GetFixed(const char *frame, const char *code, uint8_t decimals, int32_t *result);
+
+#endif /* __LEGACY_OBIS_H__ */
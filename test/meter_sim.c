@@ -0,0 +1,1133 @@
+/*
+ * meter_sim.c
+ * The meter acquisition state machine of the firmware (meter_link.c, with the
+ * OBIS decoder and the BCC/CRC check) against a simulated HXE310 across a
+ * pseudo terminal (posix_openpt), with the timing of a real line:
+ *   - every character takes 10 bits (7E1) at the baud rate set on the line,
+ *     parity travels in bit 7 as in the USART1 DMA ring, and bytes sent at a
+ *     baud rate the other side is not listening at arrive as parity errors
+ *   - the meter answers after its reaction time, the reader side raises the
+ *     USART receiver timeout on a gap inside a frame and completes its
+ *     transmissions and session timer like usart_if.c
+ * The meter speaks mode C (data readout, or programming mode with R5 reads)
+ * or only pushes frames at METER_PUSH_BAUD, and injects faults in what it
+ * sends: dropped byte, parity error, truncation, slow lines, late answer,
+ * unanswered sign-on.
+ * Each scenario runs in its own process, so the link starts as after a reset.
+ *   meter_sim [speed]   time scale, 1 = real time (default 8)
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <math.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "test_util.h"
+#include "meter_link.h"
+#include "iec62056.h"
+#include "meter_payload.h"
+
+/* Read timeout of the application (METER_READ_TIMEOUT in lora_app.c) */
+#define HOST_READ_TIMEOUT   7000U
+/* Pause between two reads (the retry backoff of lora_app.c is longer) */
+#define HOST_READ_PAUSE     1000U
+/* Shortest gap timeout the host scheduler resolves reliably (real ms) */
+#define HOST_GAP_MIN_MS     10.0
+/* Meter reaction time (IEC 62056-21 tr, 200 ms min) */
+#define SIM_REACTION        200U
+/* Meter inactivity timeout in programming mode */
+#define SIM_INACTIVITY      5000U
+
+static double speed = 8.0;
+
+/* Line time ---------------------------------------------------------------------*/
+
+/**
+  * @brief  Scaled time (ms), in which every timeout and character time is counted
+  */
+static double LineMs(void)
+{
+  static struct timespec t0;
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  if (t0.tv_sec == 0 && t0.tv_nsec == 0)
+  {
+    t0 = t;
+  }
+  return ((double)(t.tv_sec - t0.tv_sec) * 1000.0 + (double)(t.tv_nsec - t0.tv_nsec) / 1e6) * speed;
+}
+
+/**
+  * @brief  Wait for input on fd until a line time, false on timeout
+  */
+static bool WaitInput(int fd, double until)
+{
+  double left = until - LineMs();
+  struct pollfd p = { fd, POLLIN, 0 };
+
+  if (left <= 0.0)
+  {
+    return poll(&p, 1, 0) > 0;
+  }
+  return poll(&p, 1, (int)ceil(left / speed)) > 0;
+}
+
+static double CharMs(uint32_t baud)
+{
+  return 10000.0 / (double)baud;
+}
+
+/**
+  * @brief  Gap timeout of the reader: METER_GAP_TIMEOUT_CHARS characters, at least HOST_GAP_MIN_MS
+  */
+static double GapMs(uint32_t baud)
+{
+  double gap = 10.0 * CharMs(baud);  /* METER_GAP_TIMEOUT_CHARS */
+
+  return (gap < HOST_GAP_MIN_MS * speed) ? HOST_GAP_MIN_MS * speed : gap;
+}
+
+/**
+  * @brief  Pause of a pushing meter between frames: 1 s, or 8 gap timeouts if longer,
+  *         so a quiet line between two reads tells a frame in progress from the pause
+  */
+static double PushPeriod(void)
+{
+  double period = 8.0 * GapMs(METER_PUSH_BAUD);
+
+  return (period > 1000.0) ? period : 1000.0;
+}
+
+static uint8_t Parity7E1(uint8_t byte)
+{
+  byte &= 0x7FU;
+  return __builtin_parity(byte) ? (uint8_t)(byte | 0x80U) : byte;
+}
+
+static speed_t BaudCode(uint32_t baud)
+{
+  switch (baud)
+  {
+    case 300: return B300;
+    case 600: return B600;
+    case 1200: return B1200;
+    case 2400: return B2400;
+    case 4800: return B4800;
+    case 9600: return B9600;
+    default: return B19200;
+  }
+}
+
+/**
+  * @brief  Baud rate the reader has set on the line (the master side sees the slave termios)
+  */
+static uint32_t LineBaud(int fd)
+{
+  static const uint32_t rates[] = { 300, 600, 1200, 2400, 4800, 9600, 19200 };
+  struct termios t;
+
+  tcgetattr(fd, &t);
+  for (uint8_t n = 0; n < sizeof(rates) / sizeof(rates[0]); n++)
+  {
+    if (cfgetospeed(&t) == BaudCode(rates[n]))
+    {
+      return rates[n];
+    }
+  }
+  return 0;
+}
+
+/* Simulated meter ---------------------------------------------------------------*/
+
+typedef enum
+{
+  SIM_PUSH,       /* no mode C: pushes its frame every PushPeriod() at METER_PUSH_BAUD */
+  SIM_READOUT,    /* mode C data readout, NAK to programming mode */
+  SIM_SELECTIVE,  /* mode C readout and programming mode with R5 reads */
+} SimKind_t;
+
+typedef enum
+{
+  FAULT_NONE,
+  FAULT_DROP,      /* byte at fault_at not sent */
+  FAULT_PARITY,    /* byte at fault_at sent with a wrong parity bit */
+  FAULT_TRUNCATE,  /* frame stops before fault_at */
+  FAULT_SLOW,      /* fault_delay between the lines of the frame */
+  FAULT_LATE,      /* R5 answered after fault_delay instead of the reaction time */
+  FAULT_NO_IDENT,  /* sign-on not answered */
+} SimFault_t;
+
+typedef struct
+{
+  SimKind_t  kind;
+  char       baud_id;      /* baud rate id of the identification */
+  SimFault_t fault;        /* applied to fault_frames frames (readout, push or R5 answer; */
+  uint16_t   fault_at;     /* sign-ons for FAULT_NO_IDENT) once fault_skip have passed */
+  uint32_t   fault_delay;
+  uint8_t    fault_frames;
+  uint8_t    fault_skip;
+
+  /* Meter state, owned by the thread */
+  int        fd;
+  uint32_t   baud;
+  bool       prog;
+  double     last_rx;
+  uint8_t    req[64];
+  uint8_t    req_len;
+  volatile bool stop;
+
+  /* Counters, read once the thread has ended */
+  uint32_t   sign_ons;
+  uint32_t   reads;
+  uint32_t   breaks;
+  uint32_t   naks;
+  uint32_t   frames;
+} Sim_t;
+
+static uint8_t readout_frame[512];
+static size_t readout_len;
+static uint8_t push_frame[512];
+static size_t push_len;
+
+/**
+  * @brief  Wait, returning early (true) if a request comes in
+  */
+static bool Sim_Wait(Sim_t *sim, double ms)
+{
+  double until = LineMs() + ms;
+
+  while (!sim->stop)
+  {
+    if (WaitInput(sim->fd, until))
+    {
+      return true;
+    }
+    if (LineMs() >= until)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+  * @brief  Put a chunk on the line and wait until its last character is out
+  * @retval false if a request came in meanwhile (the meter stops sending)
+  */
+static bool Sim_Put(Sim_t *sim, uint8_t *data, size_t len)
+{
+  if (LineBaud(sim->fd) != sim->baud)
+  {
+    /* The reader listens at another speed: what it gets is garbage */
+    for (size_t i = 0; i < len; i++)
+    {
+      data[i] ^= 0x80U;
+    }
+  }
+  if (write(sim->fd, data, len) != (ssize_t)len)
+  {
+    return false;
+  }
+  return !Sim_Wait(sim, (double)len * CharMs(sim->baud));
+}
+
+/**
+  * @brief  Whether the fault of the scenario applies to this frame (or sign-on)
+  */
+static bool Sim_Faulty(Sim_t *sim)
+{
+  if (sim->fault_skip > 0)
+  {
+    sim->fault_skip--;
+    return false;
+  }
+  if (sim->fault_frames > 0)
+  {
+    sim->fault_frames--;
+    return true;
+  }
+  return false;
+}
+
+/**
+  * @brief  Send a message line by line, with the fault of the scenario if frame is set
+  */
+static void Sim_Send(Sim_t *sim, const uint8_t *raw, size_t len, bool frame)
+{
+  SimFault_t fault = FAULT_NONE;
+  size_t at = 0;
+  uint8_t chunk[128];
+  size_t n = 0;
+  bool first = true;
+
+  if (frame && sim->fault <= FAULT_SLOW && Sim_Faulty(sim))
+  {
+    fault = sim->fault;
+    at = (sim->fault_at < len) ? sim->fault_at : len - 1U;
+  }
+  if (frame)
+  {
+    sim->frames++;
+  }
+
+  for (size_t i = 0; i < len; i++)
+  {
+    bool end = raw[i] == '\n' || (i > 0 && raw[i - 1] == IEC62056_ETX) || i == len - 1U;
+
+    if (fault == FAULT_TRUNCATE && i == at)
+    {
+      Sim_Put(sim, chunk, n);
+      return;
+    }
+    if (!(fault == FAULT_DROP && i == at))
+    {
+      chunk[n] = Parity7E1(raw[i]);
+      if (fault == FAULT_PARITY && i == at)
+      {
+        chunk[n] ^= 0x80U;
+      }
+      n++;
+    }
+    if (end || n == sizeof(chunk))
+    {
+      if ((fault == FAULT_SLOW && !first && Sim_Wait(sim, sim->fault_delay)) || !Sim_Put(sim, chunk, n))
+      {
+        return;
+      }
+      first = false;
+      n = 0;
+    }
+  }
+}
+
+/**
+  * @brief  Message "<head>STX<data>ETX BCC" (head may be empty)
+  */
+static size_t Sim_Block(uint8_t *buf, const char *head, const char *data)
+{
+  size_t len = (size_t)sprintf((char *)buf, "%s\x02%s\x03", head, data);
+
+  buf[len] = IEC62056_Bcc(&buf[1], (uint16_t)(len - 1U));
+  return len + 1U;
+}
+
+/**
+  * @brief  Answer of R5 "<code>()": the first value of the data set in the readout
+  */
+static size_t Sim_ReadAnswer(uint8_t *buf, const uint8_t *cmd, size_t len)
+{
+  char code[OBIS_STREAM_CODE_MAX + 1];
+  char value[32];
+  size_t n = 0;
+
+  while (4U + n < len && cmd[4 + n] != '(' && n < OBIS_STREAM_CODE_MAX)
+  {
+    code[n] = (char)cmd[4 + n];
+    n++;
+  }
+  code[n] = '\0';
+
+  for (size_t i = 0; i + n < readout_len; i++)
+  {
+    if ((i == 0 || readout_frame[i - 1] == '\n' || readout_frame[i - 1] == IEC62056_STX) &&
+        memcmp(&readout_frame[i], code, n) == 0 && readout_frame[i + n] == '(')
+    {
+      const uint8_t *end = memchr(&readout_frame[i + n], ')', readout_len - i - n);
+
+      snprintf(value, sizeof(value), "%.*s", (int)(end - &readout_frame[i + n] + 1), &readout_frame[i + n]);
+      return Sim_Block(buf, "", value);
+    }
+  }
+  buf[0] = IEC62056_NAK;
+  return 1;
+}
+
+/**
+  * @brief  Act on a complete request (sign-on, ACK or command)
+  */
+static void Sim_Request(Sim_t *sim, const uint8_t *msg, size_t len)
+{
+  uint8_t out[64];
+  size_t out_len;
+  double wire = (double)len * CharMs(sim->baud);
+
+  sim->last_rx = LineMs();
+
+  if (msg[0] == '/')
+  {
+    sim->sign_ons++;
+    if (sim->kind == SIM_PUSH || (sim->fault == FAULT_NO_IDENT && Sim_Faulty(sim)) ||
+        Sim_Wait(sim, wire + SIM_REACTION))
+    {
+      return;
+    }
+    out_len = (size_t)sprintf((char *)out, "/HXE%c\\2HXE310\r\n", sim->baud_id);
+    Sim_Send(sim, out, out_len, false);
+    return;
+  }
+
+  if (msg[0] == IEC62056_ACK)
+  {
+    if (Sim_Wait(sim, wire))
+    {
+      return;
+    }
+    sim->baud = IEC62056_BaudRate((char)msg[2]);
+    if (Sim_Wait(sim, SIM_REACTION))
+    {
+      return;
+    }
+    if (msg[3] == IEC62056_MODE_READOUT)
+    {
+      Sim_Send(sim, readout_frame, readout_len, true);
+      sim->baud = IEC62056_INITIAL_BAUD;
+    }
+    else if (sim->kind == SIM_SELECTIVE)
+    {
+      sim->prog = true;
+      out_len = Sim_Block(out, "\x01P0", "(12345678)");
+      Sim_Send(sim, out, out_len, false);
+    }
+    else
+    {
+      sim->prog = true;
+      sim->naks++;
+      out[0] = IEC62056_NAK;
+      Sim_Send(sim, out, 1, false);
+    }
+    return;
+  }
+
+  /* SOH command ETX BCC, in programming mode */
+  if (!sim->prog)
+  {
+    return;
+  }
+  if (msg[1] == 'B')
+  {
+    sim->breaks++;
+    sim->prog = false;
+    if (!Sim_Wait(sim, wire))
+    {
+      sim->baud = IEC62056_INITIAL_BAUD;
+    }
+    return;
+  }
+  if (IEC62056_Bcc(&msg[1], (uint16_t)(len - 2U)) != msg[len - 1] || msg[1] != 'R')
+  {
+    sim->naks++;
+    out[0] = IEC62056_NAK;
+    if (!Sim_Wait(sim, wire + SIM_REACTION))
+    {
+      Sim_Send(sim, out, 1, false);
+    }
+    return;
+  }
+  sim->reads++;
+  if (Sim_Wait(sim, wire + ((sim->fault == FAULT_LATE && Sim_Faulty(sim)) ? sim->fault_delay : SIM_REACTION)))
+  {
+    return;
+  }
+  out_len = Sim_ReadAnswer(out, msg, len);
+  Sim_Send(sim, out, out_len, out_len > 1U);
+}
+
+/**
+  * @brief  Take the received bytes; garbage (wrong speed or parity) drops the request
+  */
+static void Sim_Receive(Sim_t *sim)
+{
+  uint8_t buf[64];
+  ssize_t n = read(sim->fd, buf, sizeof(buf));
+  uint32_t line = LineBaud(sim->fd);
+
+  for (ssize_t i = 0; i < n; i++)
+  {
+    uint8_t byte = buf[i];
+    size_t need = 0;
+
+    if (line != sim->baud || __builtin_parity(byte))
+    {
+      sim->req_len = 0;
+      continue;
+    }
+    byte &= 0x7FU;
+    if (sim->req_len == 0 && byte != '/' && byte != IEC62056_ACK && byte != IEC62056_SOH)
+    {
+      continue;
+    }
+    if (sim->req_len >= sizeof(sim->req))
+    {
+      sim->req_len = 0;
+    }
+    sim->req[sim->req_len++] = byte;
+
+    if (sim->req[0] == '/' && byte == '\n')
+    {
+      need = sim->req_len;
+    }
+    else if (sim->req[0] == IEC62056_ACK && sim->req_len == IEC62056_ACK_LEN)
+    {
+      need = IEC62056_ACK_LEN;
+    }
+    else if (sim->req[0] == IEC62056_SOH && sim->req_len >= 2U && sim->req[sim->req_len - 2U] == IEC62056_ETX)
+    {
+      need = sim->req_len;
+    }
+    if (need > 0U)
+    {
+      uint8_t msg[64];
+
+      memcpy(msg, sim->req, need);
+      sim->req_len = 0;
+      Sim_Request(sim, msg, need);
+    }
+  }
+}
+
+static void *Sim_Thread(void *arg)
+{
+  Sim_t *sim = arg;
+  double next_push = LineMs() + PushPeriod();
+
+  while (!sim->stop)
+  {
+    double now = LineMs();
+    double until = now + 50.0;
+
+    if (sim->kind == SIM_PUSH && next_push < until)
+    {
+      until = next_push;
+    }
+    if (WaitInput(sim->fd, until))
+    {
+      Sim_Receive(sim);
+      continue;
+    }
+    now = LineMs();
+    if (sim->prog && now - sim->last_rx > SIM_INACTIVITY)
+    {
+      sim->prog = false;
+      sim->baud = IEC62056_INITIAL_BAUD;
+    }
+    if (sim->kind == SIM_PUSH && now >= next_push)
+    {
+      /* Pushes only while the reader listens at its speed: partial frames are the truncation fault */
+      if (LineBaud(sim->fd) == METER_PUSH_BAUD)
+      {
+        Sim_Send(sim, push_frame, push_len, true);
+      }
+      next_push = LineMs() + PushPeriod();
+    }
+  }
+  return NULL;
+}
+
+/* Reader side (usart_if.c on the host) -------------------------------------------*/
+
+typedef struct
+{
+  int      fd;
+  uint32_t baud;
+  bool     rx_on;
+  bool     gap_on;
+  bool     rx_seen;    /* character received since the reception started */
+  double   rx_end;     /* end of the last character on the line */
+  bool     tx_busy;
+  double   tx_end;
+  bool     timer_on;
+  double   timer_end;
+  uint32_t parity_errors;
+  uint32_t gap_timeouts;
+  uint32_t aborted_frames;
+  uint32_t tx_count;
+} Host_t;
+
+static Host_t host;
+
+static void Host_SetBaud(uint32_t baud)
+{
+  struct termios t;
+
+  tcgetattr(host.fd, &t);
+  cfsetspeed(&t, BaudCode(baud));
+  tcsetattr(host.fd, TCSANOW, &t);
+  host.baud = baud;
+  host.rx_on = false;
+}
+
+static void Host_StartRx(bool gap_timeout)
+{
+  host.rx_on = true;
+  host.gap_on = gap_timeout;
+  host.rx_seen = false;
+}
+
+static bool Host_Transmit(const uint8_t *data, uint16_t len)
+{
+  uint8_t line[64];
+
+  if (host.tx_busy || len > sizeof(line))
+  {
+    return false;  /* HAL_BUSY */
+  }
+  for (uint16_t i = 0; i < len; i++)
+  {
+    line[i] = Parity7E1(data[i]);
+  }
+  if (write(host.fd, line, len) != (ssize_t)len)
+  {
+    return false;
+  }
+  host.tx_count++;
+  host.tx_busy = true;
+  host.tx_end = LineMs() + (double)len * CharMs(host.baud);
+  return true;
+}
+
+static void Host_AbortTx(void)
+{
+  host.tx_busy = false;
+}
+
+static void Host_StartTimer(uint32_t timeout)
+{
+  host.timer_on = true;
+  host.timer_end = LineMs() + timeout;
+}
+
+static void Host_StopTimer(void)
+{
+  host.timer_on = false;
+}
+
+static const MeterLink_Port_t host_port =
+{
+  Host_SetBaud,
+  Host_StartRx,
+  Host_Transmit,
+  Host_AbortTx,
+  Host_StartTimer,
+  Host_StopTimer,
+};
+
+/**
+  * @brief  Line error: the HAL stops the DMA reception, then HAL_UART_ErrorCallback()
+  */
+static void Host_LineError(void)
+{
+  host.rx_on = false;
+  if (MeterLink_LineError())
+  {
+    host.aborted_frames++;
+  }
+}
+
+/**
+  * @brief  Bytes read from the line, as drained from the DMA ring (parity checked by the USART)
+  */
+static void Host_Receive(const uint8_t *data, size_t len)
+{
+  double now = LineMs();
+  size_t start = 0;
+
+  for (size_t i = 0; i < len; i++)
+  {
+    host.rx_end = ((host.rx_end > now) ? host.rx_end : now) + CharMs(host.baud);
+    if (!host.rx_on)
+    {
+      start = i + 1U;
+      continue;
+    }
+    host.rx_seen = true;
+    if (__builtin_parity(data[i]))
+    {
+      if (i > start)
+      {
+        MeterLink_Receive(&data[start], (uint16_t)(i - start));
+      }
+      host.parity_errors++;
+      Host_LineError();
+      start = i + 1U;
+    }
+  }
+  if (host.rx_on && len > start)
+  {
+    MeterLink_Receive(&data[start], (uint16_t)(len - start));
+  }
+}
+
+/**
+  * @brief  Run the line, the transmissions and the timers until a time or the end of the frame
+  */
+static void Host_Run(double until, bool to_frame)
+{
+  uint8_t buf[256];
+
+  while (!(to_frame && uart_rx_complete))
+  {
+    double now = LineMs();
+    double next = until;
+
+    if (now >= until)
+    {
+      break;
+    }
+    if (host.tx_busy && host.tx_end < next)
+    {
+      next = host.tx_end;
+    }
+    if (host.timer_on && host.timer_end < next)
+    {
+      next = host.timer_end;
+    }
+    if (host.rx_on && host.gap_on && host.rx_seen && host.rx_end + GapMs(host.baud) < next)
+    {
+      next = host.rx_end + GapMs(host.baud);
+    }
+
+    if (WaitInput(host.fd, next))
+    {
+      ssize_t n = read(host.fd, buf, sizeof(buf));
+
+      if (n > 0)
+      {
+        Host_Receive(buf, (size_t)n);
+      }
+    }
+
+    now = LineMs();
+    if (host.tx_busy && now >= host.tx_end)
+    {
+      host.tx_busy = false;
+      MeterLink_TxComplete();
+    }
+    if (host.timer_on && now >= host.timer_end)
+    {
+      host.timer_on = false;
+      MeterLink_Timeout();
+    }
+    if (host.rx_on && host.gap_on && host.rx_seen && now >= host.rx_end + GapMs(host.baud))
+    {
+      host.gap_timeouts++;
+      Host_LineError();
+    }
+  }
+}
+
+/* Scenarios ---------------------------------------------------------------------*/
+
+typedef struct
+{
+  bool              complete;
+  MeterFrameCheck_t check;
+  MeterReadMode_t   mode;
+  OBIS_Value_t      values[METER_REG_COUNT];
+} Read_t;
+
+static OBIS_Value_t stream_values[METER_REG_COUNT];
+
+/* Values of both HXE310 frames in test/frames */
+static const int32_t expected[METER_REG_COUNT] = { 12345, 4567, 3456, 10234, 2111, 3456, 1111, 12345678 };
+
+static pthread_t sim_thread;
+
+static void Sim_Start(Sim_t *sim)
+{
+  struct termios t;
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+
+  memset(&host, 0, sizeof(host));
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0 ||
+      (host.fd = open(ptsname(master), O_RDWR | O_NOCTTY)) < 0)
+  {
+    printf("no pseudo terminal\n");
+    exit(1);
+  }
+  tcgetattr(host.fd, &t);
+  cfmakeraw(&t);
+  tcsetattr(host.fd, TCSANOW, &t);
+
+  sim->fd = master;
+  sim->baud = (sim->kind == SIM_PUSH) ? METER_PUSH_BAUD : IEC62056_INITIAL_BAUD;
+  if (sim->baud_id == 0)
+  {
+    sim->baud_id = '5';
+  }
+  Host_SetBaud(METER_PUSH_BAUD);
+  MeterLink_Init(&host_port);
+  OBIS_StreamInit(&meter_obis_stream, meter_registers, METER_REG_COUNT, stream_values, "C.1.0");
+  pthread_create(&sim_thread, NULL, Sim_Thread, sim);
+}
+
+static void Sim_End(Sim_t *sim)
+{
+  sim->stop = true;
+  pthread_join(sim_thread, NULL);
+  close(host.fd);
+  close(sim->fd);
+}
+
+/**
+  * @brief  One read as lora_app.c does it: start, frame or timeout, stop, then a pause
+  *         until the meter has been quiet for a while (the rest of a failed frame)
+  * @param  start MeterLink_StartRead, or MeterLink_StartCapture for the background capture
+  */
+static void ReadMeterWith(void (*start)(void), Read_t *read)
+{
+  start();
+  Host_Run(LineMs() + HOST_READ_TIMEOUT, true);
+  read->complete = uart_rx_complete;
+  read->check = MeterLink_GetFrameCheck();
+  read->mode = MeterLink_GetReadMode();
+  memcpy(read->values, stream_values, sizeof(read->values));
+  MeterLink_Stop();
+  host.rx_on = false;
+  Host_Run(LineMs() + HOST_READ_PAUSE, false);
+  while (LineMs() - host.rx_end < PushPeriod() / 2.0)
+  {
+    Host_Run(LineMs() + 50.0, false);
+  }
+}
+
+static void ReadMeter(Read_t *read)
+{
+  ReadMeterWith(MeterLink_StartRead, read);
+}
+
+static void CheckValues(const Read_t *read)
+{
+  for (uint8_t n = 0; n < METER_REG_COUNT; n++)
+  {
+    CHECK(read->values[n].valid);
+    CHECK_EQ(read->values[n].value, expected[n]);
+  }
+}
+
+static void CheckRead(const Read_t *read, MeterFrameCheck_t check, MeterReadMode_t mode)
+{
+  CHECK(read->complete);
+  CHECK_EQ(read->check, check);
+  CHECK_EQ(read->mode, mode);
+  if (check == METER_FRAME_VERIFIED)
+  {
+    CheckValues(read);
+  }
+}
+
+/* Mode C meter without programming mode: NAK, break, full readout. Programming mode is skipped
+   after METER_IEC_SELECTIVE_ATTEMPTS reads, then tried every METER_IEC_SELECTIVE_RETRY */
+static void ScenarioReadout(void)
+{
+  Sim_t sim = { .kind = SIM_READOUT };
+  Read_t read;
+
+  Sim_Start(&sim);
+  for (uint8_t n = 1; n <= METER_IEC_SELECTIVE_ATTEMPTS + METER_IEC_SELECTIVE_RETRY; n++)
+  {
+    uint32_t naks = sim.naks;
+
+    ReadMeter(&read);
+    CheckRead(&read, METER_FRAME_VERIFIED, METER_READ_READOUT);
+    CHECK_EQ(host.baud, 9600);
+    CHECK_EQ(sim.naks - naks, (n <= METER_IEC_SELECTIVE_ATTEMPTS ||
+                               n == METER_IEC_SELECTIVE_ATTEMPTS + METER_IEC_SELECTIVE_RETRY) ? 1 : 0);
+  }
+  Sim_End(&sim);
+  CHECK_EQ(sim.naks, METER_IEC_SELECTIVE_ATTEMPTS + 1);
+  CHECK_EQ(sim.breaks, sim.naks);
+  CHECK_EQ(sim.sign_ons, METER_IEC_SELECTIVE_ATTEMPTS + METER_IEC_SELECTIVE_RETRY + sim.naks);
+  CHECK_EQ(sim.frames, METER_IEC_SELECTIVE_ATTEMPTS + METER_IEC_SELECTIVE_RETRY);
+}
+
+/* Mode C meter with programming mode: one R5 per register */
+static void ScenarioSelective(void)
+{
+  Sim_t sim = { .kind = SIM_SELECTIVE };
+  Read_t read;
+
+  Sim_Start(&sim);
+  ReadMeter(&read);
+  CheckRead(&read, METER_FRAME_VERIFIED, METER_READ_SELECTIVE);
+  ReadMeter(&read);
+  CheckRead(&read, METER_FRAME_VERIFIED, METER_READ_SELECTIVE);
+  Sim_End(&sim);
+  CHECK_EQ(sim.reads, 2 * METER_REG_COUNT);
+  CHECK_EQ(sim.breaks, 2);
+}
+
+/* Meter without mode C: no identification, passive reception of the pushed frames. The
+   sign-on is skipped after METER_IEC_SIGN_ON_ATTEMPTS reads, then tried every METER_IEC_SIGN_ON_RETRY */
+static void ScenarioPush(void)
+{
+  Sim_t sim = { .kind = SIM_PUSH };
+  Read_t read;
+
+  Sim_Start(&sim);
+  for (uint8_t n = 1; n <= METER_IEC_SIGN_ON_ATTEMPTS + METER_IEC_SIGN_ON_RETRY; n++)
+  {
+    uint32_t tx_count = host.tx_count;
+
+    ReadMeter(&read);
+    CheckRead(&read, METER_FRAME_VERIFIED, METER_READ_PASSIVE);
+    CHECK_EQ(host.baud, METER_PUSH_BAUD);
+    CHECK_EQ(host.tx_count - tx_count, (n <= METER_IEC_SIGN_ON_ATTEMPTS ||
+                                        n == METER_IEC_SIGN_ON_ATTEMPTS + METER_IEC_SIGN_ON_RETRY) ? 1 : 0);
+  }
+  Sim_End(&sim);
+}
+
+/* Mode C meter missing the first sign-ons (head not in place yet): mode C once it answers */
+static void ScenarioLateSignOn(void)
+{
+  Sim_t sim = { .kind = SIM_SELECTIVE, .fault = FAULT_NO_IDENT, .fault_frames = METER_IEC_SIGN_ON_ATTEMPTS - 1 };
+  Read_t read;
+
+  Sim_Start(&sim);
+  for (uint8_t n = 1; n < METER_IEC_SIGN_ON_ATTEMPTS; n++)
+  {
+    ReadMeter(&read);
+    CHECK(!read.complete);
+    CHECK_EQ(read.mode, METER_READ_PASSIVE);
+  }
+  ReadMeter(&read);
+  CheckRead(&read, METER_FRAME_VERIFIED, METER_READ_SELECTIVE);
+  Sim_End(&sim);
+  CHECK_EQ(sim.sign_ons, METER_IEC_SIGN_ON_ATTEMPTS);
+}
+
+/* Mode C meter that identified once: missed sign-ons never switch it to push only */
+static void ScenarioMissedSignOn(void)
+{
+  Sim_t sim = { .kind = SIM_SELECTIVE, .fault = FAULT_NO_IDENT, .fault_skip = 1,
+                .fault_frames = METER_IEC_SIGN_ON_ATTEMPTS + 1 };
+  Read_t read;
+
+  Sim_Start(&sim);
+  ReadMeter(&read);
+  CheckRead(&read, METER_FRAME_VERIFIED, METER_READ_SELECTIVE);
+  for (uint8_t n = 0; n < METER_IEC_SIGN_ON_ATTEMPTS + 1; n++)
+  {
+    ReadMeter(&read);
+    CHECK(!read.complete);
+  }
+  ReadMeter(&read);
+  CheckRead(&read, METER_FRAME_VERIFIED, METER_READ_SELECTIVE);
+  Sim_End(&sim);
+  CHECK_EQ(sim.sign_ons, METER_IEC_SIGN_ON_ATTEMPTS + 3);
+  CHECK(!MeterLink_PushOnly());
+}
+
+/* Background capture of a push-only meter: passive, no sign-on, and not a read (the sign-on
+   is still retried every METER_IEC_SIGN_ON_RETRY reads) */
+static void ScenarioCapture(void)
+{
+  Sim_t sim = { .kind = SIM_PUSH };
+  Read_t read;
+  uint32_t tx_count;
+
+  Sim_Start(&sim);
+  for (uint8_t n = 0; n < METER_IEC_SIGN_ON_ATTEMPTS; n++)
+  {
+    ReadMeter(&read);
+  }
+  CHECK(MeterLink_PushOnly());
+  tx_count = host.tx_count;
+  for (uint8_t n = 0; n < 2; n++)
+  {
+    ReadMeterWith(MeterLink_StartCapture, &read);
+    CheckRead(&read, METER_FRAME_VERIFIED, METER_READ_PASSIVE);
+    CHECK_EQ(host.baud, METER_PUSH_BAUD);
+  }
+  CHECK_EQ(host.tx_count, tx_count);
+  for (uint8_t n = 1; n <= METER_IEC_SIGN_ON_RETRY; n++)
+  {
+    ReadMeter(&read);
+  }
+  Sim_End(&sim);
+  CHECK_EQ(host.tx_count, tx_count + 1);
+}
+
+/* Baud rates: the meter proposes 2400 or 19200 */
+static void ScenarioBaud(void)
+{
+  static const struct { char id; uint32_t baud; } rates[] = { { '3', 2400 }, { '6', 19200 } };
+
+  for (uint8_t n = 0; n < sizeof(rates) / sizeof(rates[0]); n++)
+  {
+    Sim_t sim = { .kind = SIM_SELECTIVE, .baud_id = rates[n].id };
+    Read_t read;
+
+    Sim_Start(&sim);
+    ReadMeter(&read);
+    CheckRead(&read, METER_FRAME_VERIFIED, METER_READ_SELECTIVE);
+    CHECK_EQ(host.baud, rates[n].baud);
+    Sim_End(&sim);
+  }
+}
+
+/**
+  * @brief  A faulty frame, then a good one
+  */
+static void FaultThenGood(SimKind_t kind, SimFault_t fault, uint16_t at, uint32_t delay, MeterReadMode_t mode)
+{
+  Sim_t sim = { .kind = kind, .fault = fault, .fault_at = at, .fault_delay = delay, .fault_frames = 1 };
+  Read_t read;
+
+  Sim_Start(&sim);
+  ReadMeter(&read);
+  CheckRead(&read, METER_FRAME_CORRUPT, mode);
+  ReadMeter(&read);
+  CheckRead(&read, METER_FRAME_VERIFIED, mode);
+  Sim_End(&sim);
+}
+
+/* Data readout: dropped byte (BCC), parity error, truncation (gap) */
+static void ScenarioReadoutFaults(void)
+{
+  FaultThenGood(SIM_READOUT, FAULT_DROP, 40, 0, METER_READ_READOUT);
+  CHECK_EQ(host.aborted_frames, 0);
+
+  FaultThenGood(SIM_READOUT, FAULT_PARITY, 40, 0, METER_READ_READOUT);
+  CHECK_EQ(host.parity_errors, 1);
+  CHECK_EQ(host.aborted_frames, 1);
+
+  FaultThenGood(SIM_READOUT, FAULT_TRUNCATE, 120, 0, METER_READ_READOUT);
+  CHECK_EQ(host.gap_timeouts, 1);
+  CHECK_EQ(host.aborted_frames, 1);
+}
+
+/* Pushed frame: dropped byte (CRC), parity error, slow lines beyond and within the gap timeout */
+static void ScenarioPushFaults(void)
+{
+  Sim_t sim = { .kind = SIM_PUSH, .fault = FAULT_SLOW, .fault_delay = 0, .fault_frames = 2 };
+  Read_t read;
+
+  FaultThenGood(SIM_PUSH, FAULT_DROP, 60, 0, METER_READ_PASSIVE);
+  FaultThenGood(SIM_PUSH, FAULT_PARITY, 60, 0, METER_READ_PASSIVE);
+  CHECK_EQ(host.parity_errors, 1);
+
+  FaultThenGood(SIM_PUSH, FAULT_SLOW, 0, (uint32_t)(GapMs(METER_PUSH_BAUD) * 2.0), METER_READ_PASSIVE);
+  CHECK(host.gap_timeouts >= 1);
+
+  sim.fault_delay = (uint32_t)(GapMs(METER_PUSH_BAUD) / 4.0);
+  Sim_Start(&sim);
+  ReadMeter(&read);
+  CheckRead(&read, METER_FRAME_VERIFIED, METER_READ_PASSIVE);
+  ReadMeter(&read);
+  CheckRead(&read, METER_FRAME_VERIFIED, METER_READ_PASSIVE);
+  Sim_End(&sim);
+  CHECK_EQ(host.gap_timeouts, 0);
+  CHECK_EQ(sim.fault_frames, 0);  /* both reads got a slow frame */
+}
+
+/* Programming mode: a bad data message ends the read with a break, the next one is selective again */
+static void ScenarioSelectiveFaults(void)
+{
+  FaultThenGood(SIM_SELECTIVE, FAULT_PARITY, 3, 0, METER_READ_SELECTIVE);
+  CHECK_EQ(host.parity_errors, 1);
+  FaultThenGood(SIM_SELECTIVE, FAULT_DROP, 3, 0, METER_READ_SELECTIVE);
+}
+
+/* Programming mode: an answer later than METER_IEC_RESPONSE_TIMEOUT falls back to the full readout
+   for that read, the next ones are selective again */
+static void ScenarioLateAnswer(void)
+{
+  Sim_t sim = { .kind = SIM_SELECTIVE, .fault = FAULT_LATE, .fault_delay = METER_IEC_RESPONSE_TIMEOUT + 1000U,
+                .fault_frames = 1 };
+  Read_t read;
+
+  Sim_Start(&sim);
+  ReadMeter(&read);
+  CheckRead(&read, METER_FRAME_VERIFIED, METER_READ_READOUT);
+  ReadMeter(&read);
+  CheckRead(&read, METER_FRAME_VERIFIED, METER_READ_SELECTIVE);
+  Sim_End(&sim);
+  CHECK_EQ(sim.breaks, 2);
+}
+
+static const struct
+{
+  const char *name;
+  void (*run)(void);
+} scenarios[] =
+{
+  { "readout", ScenarioReadout },
+  { "selective", ScenarioSelective },
+  { "push", ScenarioPush },
+  { "late sign-on", ScenarioLateSignOn },
+  { "missed sign-on", ScenarioMissedSignOn },
+  { "capture", ScenarioCapture },
+  { "baud", ScenarioBaud },
+  { "readout faults", ScenarioReadoutFaults },
+  { "push faults", ScenarioPushFaults },
+  { "selective faults", ScenarioSelectiveFaults },
+  { "late answer", ScenarioLateAnswer },
+};
+
+/**
+  * @brief  Load a frame of test/frames, CR LF line ends kept as they are
+  */
+static size_t LoadFrame(const char *name, uint8_t *buf, size_t size)
+{
+  char path[256];
+
+  snprintf(path, sizeof(path), "%s/%s", FRAMES_DIR, name);
+  return ReadFile(path, buf, size);
+}
+
+int main(int argc, char **argv)
+{
+  int failed = 0;
+
+  if (argc > 1)
+  {
+    speed = atof(argv[1]);
+  }
+  if (!(speed > 0.0))
+  {
+    speed = 1.0;
+  }
+  readout_len = LoadFrame("hxe310_readout.txt", readout_frame, sizeof(readout_frame));
+  push_len = LoadFrame("hxe310_push_crc.txt", push_frame, sizeof(push_frame));
+  CHECK(readout_len > 0 && push_len > 0);
+  if (readout_len == 0 || push_len == 0)
+  {
+    TEST_DONE();
+  }
+  printf("speed x%.1f, gap timeout %.1f ms at %u Bd\n", speed, GapMs(METER_PUSH_BAUD), METER_PUSH_BAUD);
+
+  /* Each scenario in a child process: the link state (push only, selective) starts from a reset */
+  for (size_t n = 0; n < sizeof(scenarios) / sizeof(scenarios[0]); n++)
+  {
+    double start = LineMs();
+    int status;
+    pid_t pid;
+
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0)
+    {
+      scenarios[n].run();
+      fflush(stdout);
+      _exit(test_failures ? 1 : 0);
+    }
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+      failed++;
+    }
+    printf("%-16s %s (%.1f s line time)\n", scenarios[n].name,
+           (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? "OK" : "FAIL", (LineMs() - start) / 1000.0);
+  }
+  test_failures += failed;
+  TEST_DONE();
+}
@@ -0,0 +1,288 @@
+/*
+ * replay_frames.c
+ * Replay of the meter frames of test/frames through the reception path of the
+ * firmware: OBIS decoder and BCC/CRC check fed byte by byte with the end of
+ * frame rule of MeterLink_Store() (meter_link.c), then the TLV encoding of the
+ * uplink (meter_payload.c). Checks, for every frame:
+ *   - good: verified, decoded values and payload bytes as expected
+ *   - truncated at every length: never verified before the check byte, and a
+ *     register is either missing or has its right value
+ *   - every single bit flipped: rejected, or decoded to the right values
+ * then times the good frames (frames/s, ns and host cycles per frame). The
+ * cycles on the target are counted by the firmware itself (METER_DECODE_PROFILE).
+ *   replay_frames [iterations]
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLES  1
+#else
+#define HAVE_CYCLES  0
+#endif
+#include "test_util.h"
+#include "obis_stream.h"
+#include "iec62056.h"
+#include "meter_payload.h"
+
+#define FRAME_MAX  512U
+
+/**
+  * @brief Outcome of a frame, as meter_frame_status in meter_link.c
+  */
+typedef enum
+{
+  FRAME_UNVERIFIED,  /* ended by the inter-character gap, no check seen */
+  FRAME_VERIFIED,
+  FRAME_CORRUPT,
+} FrameStatus_t;
+
+typedef struct
+{
+  const char    *file;
+  int32_t        values[METER_REG_COUNT];
+  uint8_t        valid_mask;
+  const uint8_t *payload;
+  uint8_t        payload_len;
+  uint8_t        data[FRAME_MAX];
+  size_t         len;
+  size_t         check_at;  /* byte that gives the BCC/CRC verdict */
+} ReplayFrame_t;
+
+static const uint8_t readout_payload[] =
+{
+  0x0A, 0x00, 0x00, 0x30, 0x39,  /* 15.8.0   12345 */
+  0x0B, 0x00, 0x00, 0x11, 0xD7,  /* 130.8.0  4567 */
+  0x28, 0x00, 0x03,              /* 1.6.0    3456 W -> 3 kW */
+  0x3C, 0x00, 0x00, 0x27, 0xFA,  /* 1.8.0    10234 */
+  0x3D, 0x00, 0x00, 0x08, 0x3F,  /* 2.8.0    2111 */
+  0x3E, 0x00, 0x00, 0x0D, 0x80,  /* 3.8.0    3456 */
+  0x3F, 0x00, 0x00, 0x04, 0x57,  /* 4.8.0    1111 */
+  0x5A, 0x00, 0xBC, 0x61, 0x4E,  /* C.1.0    12345678 */
+};
+
+static const uint8_t partial_payload[] =
+{
+  0x0A, 0x00, 0x00, 0x00, 0x01,  /* 15.8.0   1 */
+  0x0B, 0x00, 0x00, 0x00, 0x00,  /* 130.8.0  0 */
+                                 /* 1.6.0    70 kW: out of range, not sent */
+  0x3C, 0x00, 0x00, 0x00, 0x01,  /* 1.8.0    1 */
+  0x3E, 0x00, 0x00, 0x00, 0x00,  /* 3.8.0    0 */
+  0x5A, 0x05, 0x39, 0x7F, 0xB1,  /* C.1.0    87654321 */
+};
+
+static ReplayFrame_t frames[] =
+{
+  {
+    "hxe310_readout.txt",
+    { 12345, 4567, 3456, 10234, 2111, 3456, 1111, 12345678 }, 0xFF,
+    readout_payload, sizeof(readout_payload), { 0 }, 0, 0
+  },
+  {
+    "hxe310_push_crc.txt",
+    { 12345, 4567, 3456, 10234, 2111, 3456, 1111, 12345678 }, 0xFF,
+    readout_payload, sizeof(readout_payload), { 0 }, 0, 0
+  },
+  {
+    "hxe310_partial.txt",
+    { 1, 0, 70000, 1, 0, 0, 0, 87654321 },
+    (uint8_t)~((1U << METER_REG_ACTIVE_GENERATED) | (1U << METER_REG_REACTIVE_GENERATED)),
+    partial_payload, sizeof(partial_payload), { 0 }, 0, 0
+  },
+};
+#define FRAME_COUNT  (sizeof(frames) / sizeof(frames[0]))
+
+/**
+  * @brief  Receive bytes until the end of frame (or the end of data, as the gap timeout)
+  * @param  end output, number of bytes consumed
+  */
+static FrameStatus_t Receive(const uint8_t *data, size_t len, OBIS_Value_t *values, size_t *end)
+{
+  OBIS_Stream_t stream;
+  IEC62056_Check_t check;
+  FrameStatus_t status = FRAME_UNVERIFIED;
+  size_t i;
+
+  OBIS_StreamInit(&stream, meter_registers, METER_REG_COUNT, values, "C.1.0");
+  IEC62056_CheckReset(&check);
+  for (i = 0; i < len; i++)
+  {
+    bool decoded = OBIS_StreamFeed(&stream, data[i]);
+    IEC62056_CheckResult_t result = IEC62056_CheckFeed(&check, data[i]);
+
+    if (result != IEC62056_CHECK_PENDING)
+    {
+      status = (result == IEC62056_CHECK_OK) ? FRAME_VERIFIED : FRAME_CORRUPT;
+      i++;
+      break;
+    }
+    if (decoded && !IEC62056_CheckOpen(&check))
+    {
+      i++;
+      break;
+    }
+  }
+  *end = i;
+  return status;
+}
+
+/**
+  * @brief  Registers decoded with a wrong value (a missing one is not counted)
+  */
+static int WrongValues(const ReplayFrame_t *frame, const OBIS_Value_t *values)
+{
+  int wrong = 0;
+
+  for (uint8_t reg = 0; reg < METER_REG_COUNT; reg++)
+  {
+    if (values[reg].valid && ((frame->valid_mask & (1U << reg)) == 0U || values[reg].value != frame->values[reg]))
+    {
+      wrong++;
+    }
+  }
+  return wrong;
+}
+
+static void ReplayGood(ReplayFrame_t *frame)
+{
+  OBIS_Value_t values[METER_REG_COUNT];
+  uint8_t payload[64];
+  uint8_t reg = 0;
+  uint8_t len;
+
+  CHECK_EQ(Receive(frame->data, frame->len, values, &frame->check_at), FRAME_VERIFIED);
+  for (reg = 0; reg < METER_REG_COUNT; reg++)
+  {
+    CHECK_EQ(values[reg].valid, (frame->valid_mask >> reg) & 1U);
+    if (values[reg].valid)
+    {
+      CHECK_EQ(values[reg].value, frame->values[reg]);
+    }
+  }
+
+  reg = 0;
+  len = MeterPayload_EncodeTlv(payload, values, &reg, sizeof(payload));
+  CHECK_EQ(len, frame->payload_len);
+  CHECK_MEM(payload, frame->payload, frame->payload_len);
+}
+
+static void ReplayTruncated(const ReplayFrame_t *frame)
+{
+  OBIS_Value_t values[METER_REG_COUNT];
+  int verified_early = 0;
+  int wrong = 0;
+
+  for (size_t cut = 0; cut < frame->check_at; cut++)
+  {
+    size_t end;
+
+    verified_early += (Receive(frame->data, cut, values, &end) == FRAME_VERIFIED);
+    wrong += WrongValues(frame, values);
+  }
+  CHECK_EQ(verified_early, 0);
+  CHECK_EQ(wrong, 0);
+}
+
+static void ReplayCorrupted(const ReplayFrame_t *frame, int *rejected, int *flips)
+{
+  uint8_t data[FRAME_MAX];
+  OBIS_Value_t values[METER_REG_COUNT];
+  int accepted_wrong = 0;
+
+  for (size_t pos = 0; pos < frame->check_at; pos++)
+  {
+    for (uint8_t bit = 0; bit < 7U; bit++)
+    {
+      size_t end;
+      FrameStatus_t status;
+
+      memcpy(data, frame->data, frame->len);
+      data[pos] ^= (uint8_t)(1U << bit);
+      status = Receive(data, frame->len, values, &end);
+      if (status == FRAME_CORRUPT)
+      {
+        (*rejected)++;
+      }
+      else if (WrongValues(frame, values) != 0)
+      {
+        accepted_wrong++;
+      }
+      (*flips)++;
+    }
+  }
+  CHECK_EQ(accepted_wrong, 0);
+}
+
+static double Now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+  long iterations = (argc > 1) ? atol(argv[1]) : 100000L;
+  volatile uint32_t sink = 0;
+  size_t bytes = 0;
+  double ns;
+#if (HAVE_CYCLES == 1)
+  uint64_t cycles;
+#endif
+
+  for (size_t f = 0; f < FRAME_COUNT; f++)
+  {
+    char path[256];
+    int rejected = 0;
+    int flips = 0;
+
+    snprintf(path, sizeof(path), "%s/%s", FRAMES_DIR, frames[f].file);
+    frames[f].len = ReadFile(path, frames[f].data, FRAME_MAX);
+    CHECK(frames[f].len > 0U);
+    if (frames[f].len == 0U)
+    {
+      continue;
+    }
+
+    ReplayGood(&frames[f]);
+    ReplayTruncated(&frames[f]);
+    ReplayCorrupted(&frames[f], &rejected, &flips);
+    printf("%-22s %3u bytes, check at byte %3u, bit flips rejected %d/%d\n", frames[f].file,
+           (unsigned int)frames[f].len, (unsigned int)frames[f].check_at, rejected, flips);
+    bytes += frames[f].len;
+  }
+
+  ns = Now();
+#if (HAVE_CYCLES == 1)
+  cycles = __rdtsc();
+#endif
+  for (long i = 0; i < iterations; i++)
+  {
+    const ReplayFrame_t *frame = &frames[(size_t)i % FRAME_COUNT];
+    OBIS_Value_t values[METER_REG_COUNT];
+    uint8_t payload[64];
+    uint8_t reg = 0;
+    size_t end;
+
+    sink += (uint32_t)Receive(frame->data, frame->len, values, &end);
+    sink += MeterPayload_EncodeTlv(payload, values, &reg, sizeof(payload));
+  }
+#if (HAVE_CYCLES == 1)
+  cycles = __rdtsc() - cycles;
+#endif
+  ns = Now() - ns;
+
+  printf("%ld frames (%.0f bytes average): %.0f frames/s, %.1f ns/frame\n", iterations,
+         (double)bytes / (double)FRAME_COUNT, (double)iterations * 1e9 / ns, ns / (double)iterations);
+#if (HAVE_CYCLES == 1)
+  printf("  %.0f host cycles/frame, %.1f cycles/byte (TSC)\n", (double)cycles / (double)iterations,
+         (double)cycles * (double)FRAME_COUNT / ((double)iterations * (double)bytes));
+#endif
+  (void)sink;
+
+  TEST_DONE();
+}
@@ -0,0 +1,29 @@
+/*
+ * sys_app.h (host shim)
+ * Stands in for Core/Inc/sys_app.h when the LoRaWAN/App modules are built on
+ * the host: APP_LOG goes to stdout when HOST_LOG is 1, nowhere otherwise.
+ */
+#ifndef __SYS_APP_H__
+#define __SYS_APP_H__
+
+#include <stdio.h>
+
+#ifndef HOST_LOG
+#define HOST_LOG  0
+#endif
+
+#define TS_OFF    0
+#define TS_ON     1
+#define VLEVEL_OFF 0
+#define VLEVEL_L  1
+#define VLEVEL_M  2
+#define VLEVEL_H  3
+
+#define APP_LOG(TS, VL, ...) \
+  do { \
+    if (HOST_LOG) { \
+      printf(__VA_ARGS__); \
+    } \
+  } while (0)
+
+#endif /* __SYS_APP_H__ */
@@ -0,0 +1,49 @@
+/*
+ * test_clock_calc.c
+ * Flash wait states of both voltage ranges at their limits
+ * and MSI range frequencies used by clock_profile.c.
+ */
+
+#include "test_util.h"
+#include "clock_calc.h"
+
+#define MHZ  1000000U
+
+int main(void)
+{
+  /* Range 2: 0 WS up to 6 MHz, 1 WS up to 12 MHz, 2 WS up to 16 MHz, nothing above */
+  CHECK_EQ(ClockProfile_FlashLatency(6U * MHZ, true), 0);
+  CHECK_EQ(ClockProfile_FlashLatency(6U * MHZ + 1U, true), 1);
+  CHECK_EQ(ClockProfile_FlashLatency(12U * MHZ, true), 1);
+  CHECK_EQ(ClockProfile_FlashLatency(12U * MHZ + 1U, true), 2);
+  CHECK_EQ(ClockProfile_FlashLatency(16U * MHZ, true), 2);
+  CHECK_EQ(ClockProfile_FlashLatency(16U * MHZ + 1U, true), CLOCK_LATENCY_INVALID);
+  CHECK_EQ(ClockProfile_FlashLatency(24U * MHZ, true), CLOCK_LATENCY_INVALID);
+
+  /* Range 1: 0 WS up to 18 MHz, 1 WS up to 36 MHz, 2 WS up to 48 MHz */
+  CHECK_EQ(ClockProfile_FlashLatency(16U * MHZ, false), 0);
+  CHECK_EQ(ClockProfile_FlashLatency(18U * MHZ, false), 0);
+  CHECK_EQ(ClockProfile_FlashLatency(18U * MHZ + 1U, false), 1);
+  CHECK_EQ(ClockProfile_FlashLatency(36U * MHZ, false), 1);
+  CHECK_EQ(ClockProfile_FlashLatency(36U * MHZ + 1U, false), 2);
+  CHECK_EQ(ClockProfile_FlashLatency(48U * MHZ, false), 2);
+  CHECK_EQ(ClockProfile_FlashLatency(48U * MHZ + 1U, false), CLOCK_LATENCY_INVALID);
+
+  /* MSI ranges: both profiles of clock_profile.h and the table ends */
+  CHECK_EQ(ClockProfile_MsiFrequency(0), 100000U);
+  CHECK_EQ(ClockProfile_MsiFrequency(8), 16U * MHZ);
+  CHECK_EQ(ClockProfile_MsiFrequency(11), 48U * MHZ);
+  CHECK_EQ(ClockProfile_MsiFrequency(CLOCK_MSI_RANGE_COUNT), 0U);
+  CHECK_EQ(ClockProfile_MsiFrequency(0xFFU), 0U);
+
+  /* Every range usable in range 1, only up to range 8 (16 MHz) in range 2 */
+  for (uint8_t range = 0; range < CLOCK_MSI_RANGE_COUNT; range++)
+  {
+    uint32_t hz = ClockProfile_MsiFrequency(range);
+    CHECK(hz != 0U);
+    CHECK(ClockProfile_FlashLatency(hz, false) != CLOCK_LATENCY_INVALID);
+    CHECK((ClockProfile_FlashLatency(hz, true) != CLOCK_LATENCY_INVALID) == (range <= 8U));
+  }
+
+  TEST_DONE();
+}
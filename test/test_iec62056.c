@@ -0,0 +1,390 @@
+/*
+ * test_iec62056.c
+ * IEC 62056-21 mode C helpers: identification, ACK and command messages with
+ * known BCC values, BCC/CRC checking of readouts, and a readout and a
+ * programming mode session against a simulated meter.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "test_util.h"
+#include "iec62056.h"
+#include "obis_stream.h"
+
+#define STX  "\x02"
+#define ETX  "\x03"
+#define SOH  "\x01"
+
+/* Readout data block, BCC 0x6A (XOR of the bytes after STX up to ETX) */
+static const char readout_block[] =
+  STX "1.8.0(001234.567*kWh)\r\n2.8.0(000000.000*kWh)\r\nC.1.0(12345678)\r\n!\r\n" ETX "\x6A";
+
+/* Pushed frame with CRC-16 trailer (from '/' to '!') */
+static const char crc_frame[] =
+  "/HXE5\\2HXE310\r\n\r\n1-0:1.8.0(001234.567*kWh)\r\n1-0:C.1.0(12345678)\r\n!B55B\r\n";
+
+/**
+  * @brief  Feed a message to a checker, return the first non pending result and where
+  */
+static IEC62056_CheckResult_t CheckMessage(const uint8_t *msg, uint16_t len, uint16_t *at)
+{
+  IEC62056_Check_t check;
+
+  IEC62056_CheckReset(&check);
+  for (uint16_t i = 0; i < len; i++)
+  {
+    IEC62056_CheckResult_t result = IEC62056_CheckFeed(&check, msg[i]);
+    if (result != IEC62056_CHECK_PENDING)
+    {
+      *at = i;
+      return result;
+    }
+  }
+  *at = len;
+  return IEC62056_CHECK_PENDING;
+}
+
+static void TestIdent(void)
+{
+  IEC62056_Ident_t ident;
+  static const char lgz[] = "/LGZ4\\2ZMD3104407.B32\r\n";
+  static const char isk[] = "/ISk5MT174-0001\r\n";
+
+  CHECK(IEC62056_ParseIdent(isk, sizeof(isk) - 1, &ident));
+  CHECK(strcmp(ident.manufacturer, "ISk") == 0);
+  CHECK_EQ(ident.baud_id, '5');
+  CHECK(strcmp(ident.ident, "MT174-0001") == 0);
+
+  /* Enhanced identification "\W" is skipped */
+  CHECK(IEC62056_ParseIdent(lgz, sizeof(lgz) - 1, &ident));
+  CHECK_EQ(ident.baud_id, '4');
+  CHECK(strcmp(ident.ident, "ZMD3104407.B32") == 0);
+
+  /* Echo of the sign-on, mode A/B baud characters, short lines */
+  CHECK(!IEC62056_ParseIdent(IEC62056_SIGN_ON, sizeof(IEC62056_SIGN_ON) - 1, &ident));
+  CHECK(!IEC62056_ParseIdent("/ABCA\r\n", 7, &ident));
+  CHECK(!IEC62056_ParseIdent("/ABC7X\r\n", 8, &ident));
+  CHECK(!IEC62056_ParseIdent("/AB\r\n", 5, &ident));
+
+  CHECK_EQ(IEC62056_BaudRate('0'), 300);
+  CHECK_EQ(IEC62056_BaudRate('5'), 9600);
+  CHECK_EQ(IEC62056_BaudRate('6'), 19200);
+  CHECK_EQ(IEC62056_BaudRate('7'), 0);
+  CHECK_EQ(IEC62056_BaudRate('A'), 0);
+}
+
+static void TestMessages(void)
+{
+  uint8_t buf[32];
+  uint16_t len;
+  static const uint8_t ack[] = { 0x06, '0', '5', '1', '\r', '\n' };
+  static const uint8_t read_cmd[] = SOH "R5" STX "1.8.0()" ETX "\x5E";
+  static const uint8_t break_cmd[] = SOH "B0" ETX "\x71";
+
+  CHECK_EQ(IEC62056_BuildAck(buf, '5', IEC62056_MODE_PROGRAMMING), IEC62056_ACK_LEN);
+  CHECK_MEM(buf, ack, sizeof(ack));
+
+  len = IEC62056_BuildCommand(buf, sizeof(buf), "R5", "1.8.0()");
+  CHECK_EQ(len, sizeof(read_cmd) - 1);
+  CHECK_MEM(buf, read_cmd, sizeof(read_cmd) - 1);
+
+  len = IEC62056_BuildCommand(buf, sizeof(buf), IEC62056_CMD_BREAK, NULL);
+  CHECK_EQ(len, sizeof(break_cmd) - 1);
+  CHECK_MEM(buf, break_cmd, sizeof(break_cmd) - 1);
+
+  /* Too small a buffer is refused rather than truncated */
+  CHECK_EQ(IEC62056_BuildCommand(buf, 12, "R5", "1.8.0()"), 0);
+  CHECK_EQ(IEC62056_BuildCommand(buf, 13, "R5", "1.8.0()"), 13);
+
+  CHECK_EQ(IEC62056_Bcc((const uint8_t *)"B0" ETX, 3), 0x71);
+}
+
+static void TestCheck(void)
+{
+  uint8_t frame[128];
+  uint16_t len = sizeof(readout_block) - 1;
+  uint16_t at;
+  uint16_t crc = 0;
+
+  /* CRC-16/ARC check value */
+  for (const char *p = "123456789"; *p != '\0'; p++)
+  {
+    crc = IEC62056_Crc16(crc, (uint8_t)*p);
+  }
+  CHECK_EQ(crc, 0xBB3D);
+
+  /* BCC: good block, one bit flipped in the data, wrong BCC, truncated block */
+  memcpy(frame, readout_block, len);
+  CHECK_EQ(CheckMessage(frame, len, &at), IEC62056_CHECK_OK);
+  CHECK_EQ(at, len - 1);
+
+  frame[10] ^= 0x01U;
+  CHECK_EQ(CheckMessage(frame, len, &at), IEC62056_CHECK_ERROR);
+  frame[10] ^= 0x01U;
+
+  frame[len - 1] ^= 0x40U;
+  CHECK_EQ(CheckMessage(frame, len, &at), IEC62056_CHECK_ERROR);
+  frame[len - 1] ^= 0x40U;
+
+  CHECK_EQ(CheckMessage(frame, (uint16_t)(len - 1), &at), IEC62056_CHECK_PENDING);
+
+  /* CRC trailer: result on the 4th hex digit; corrupted data; '!' with no CRC */
+  len = sizeof(crc_frame) - 1;
+  memcpy(frame, crc_frame, len);
+  CHECK_EQ(CheckMessage(frame, len, &at), IEC62056_CHECK_OK);
+  CHECK_EQ(frame[at], 'B');
+  CHECK_EQ(frame[at - 4], '!');
+
+  frame[30] = '9';
+  CHECK_EQ(CheckMessage(frame, len, &at), IEC62056_CHECK_ERROR);
+
+  {
+    /* The end code (C.1.0) comes before the CRC: the frame must not end there */
+    const char *end = strstr(crc_frame, "(12345678)") + 10;
+    IEC62056_Check_t check;
+
+    IEC62056_CheckReset(&check);
+    for (const char *p = crc_frame; p < end; p++)
+    {
+      IEC62056_CheckFeed(&check, (uint8_t)*p);
+    }
+    CHECK(IEC62056_CheckOpen(&check));
+  }
+
+  /* A digit corrupted into '!' is not the end of the data: the CRC still catches it */
+  memcpy(frame, crc_frame, len);
+  frame[strstr(crc_frame, "C.1.0(") - crc_frame + 7] = '!';
+  CHECK_EQ(CheckMessage(frame, len, &at), IEC62056_CHECK_ERROR);
+
+  {
+    static const char no_crc[] = "/HXE5\r\n\r\n1-0:C.1.0(12345678)\r\n!\r\n";
+    IEC62056_Check_t check;
+
+    IEC62056_CheckReset(&check);
+    CHECK_EQ(CheckMessage((const uint8_t *)no_crc, sizeof(no_crc) - 1, &at), IEC62056_CHECK_PENDING);
+    for (uint16_t i = 0; i < sizeof(no_crc) - 1; i++)
+    {
+      IEC62056_CheckFeed(&check, (uint8_t)no_crc[i]);
+    }
+    CHECK(!IEC62056_CheckOpen(&check));
+  }
+}
+
+/* Simulated meter --------------------------------------------------------------*/
+
+typedef struct
+{
+  bool     programming;   /* answers read commands (else NAK) */
+  uint32_t baud;          /* line speed the meter currently talks at */
+  char     mode;          /* mode selected by the ACK */
+  uint8_t  out[128];
+  uint16_t out_len;
+} SimMeter_t;
+
+/**
+  * @brief  Meter side of a mode C exchange: reply to one request from the reader
+  */
+static void SimMeter_Request(SimMeter_t *meter, const uint8_t *msg, uint16_t len, uint32_t baud)
+{
+  static const struct { const char *code; const char *value; } registers[] =
+  {
+    { "1.8.0", "001234.567*kWh" }, { "2.8.0", "000000.000*kWh" }, { "C.1.0", "12345678" },
+  };
+
+  meter->out_len = 0;
+  if (baud != meter->baud)
+  {
+    return;  /* wrong speed: the meter sees garbage */
+  }
+
+  if (len == sizeof(IEC62056_SIGN_ON) - 1 && memcmp(msg, IEC62056_SIGN_ON, len) == 0)
+  {
+    meter->out_len = (uint16_t)snprintf((char *)meter->out, sizeof(meter->out), "/ISK5MT174-0001\r\n");
+    return;
+  }
+
+  if (len == IEC62056_ACK_LEN && msg[0] == IEC62056_ACK)
+  {
+    meter->baud = IEC62056_BaudRate((char)msg[2]);
+    meter->mode = (char)msg[3];
+    if (meter->mode == IEC62056_MODE_READOUT)
+    {
+      memcpy(meter->out, readout_block, sizeof(readout_block) - 1);
+      meter->out_len = sizeof(readout_block) - 1;
+    }
+    else if (meter->programming)
+    {
+      meter->out_len = (uint16_t)snprintf((char *)meter->out, sizeof(meter->out), SOH "P0" STX "(12345678)" ETX);
+      meter->out[meter->out_len] = IEC62056_Bcc(&meter->out[1], (uint16_t)(meter->out_len - 1));
+      meter->out_len++;
+    }
+    else
+    {
+      meter->out[meter->out_len++] = IEC62056_NAK;
+    }
+    return;
+  }
+
+  if (len > 4 && msg[0] == IEC62056_SOH && msg[1] == 'R' && msg[3] == IEC62056_STX)
+  {
+    for (uint8_t n = 0; n < sizeof(registers) / sizeof(registers[0]); n++)
+    {
+      size_t code_len = strlen(registers[n].code);
+      if (memcmp(&msg[4], registers[n].code, code_len) == 0 && msg[4 + code_len] == '(')
+      {
+        meter->out_len = (uint16_t)snprintf((char *)meter->out, sizeof(meter->out), STX "(%s)" ETX,
+                                            registers[n].value);
+        meter->out[meter->out_len] = IEC62056_Bcc(&meter->out[1], (uint16_t)(meter->out_len - 1));
+        meter->out_len++;
+        return;
+      }
+    }
+    meter->out[meter->out_len++] = IEC62056_NAK;
+  }
+}
+
+static const OBIS_Register_t session_registers[] =
+{
+  { "1.8.0", 3 }, { "2.8.0", 3 }, { "C.1.0", 0 },
+};
+
+static void TestReadoutSession(void)
+{
+  SimMeter_t meter = { .programming = false, .baud = IEC62056_INITIAL_BAUD };
+  OBIS_Value_t values[3];
+  OBIS_Stream_t stream;
+  IEC62056_Ident_t ident;
+  IEC62056_Check_t check;
+  uint8_t ack[IEC62056_ACK_LEN];
+  uint32_t baud = IEC62056_INITIAL_BAUD;
+  bool checked = false;
+  bool decoded = false;
+
+  SimMeter_Request(&meter, (const uint8_t *)IEC62056_SIGN_ON, sizeof(IEC62056_SIGN_ON) - 1, baud);
+  CHECK(IEC62056_ParseIdent((const char *)meter.out, meter.out_len, &ident));
+  CHECK_EQ(IEC62056_BaudRate(ident.baud_id), 9600);
+
+  IEC62056_BuildAck(ack, ident.baud_id, IEC62056_MODE_READOUT);
+  SimMeter_Request(&meter, ack, IEC62056_ACK_LEN, baud);
+  baud = IEC62056_BaudRate(ident.baud_id);  /* the ACK goes out at 300 Bd, then switch */
+  CHECK_EQ(meter.baud, baud);
+  CHECK(meter.out_len > 0);
+
+  OBIS_StreamInit(&stream, session_registers, 3, values, "C.1.0");
+  IEC62056_CheckReset(&check);
+  for (uint16_t i = 0; i < meter.out_len; i++)
+  {
+    decoded |= OBIS_StreamFeed(&stream, meter.out[i]);
+    checked |= (IEC62056_CheckFeed(&check, meter.out[i]) == IEC62056_CHECK_OK);
+  }
+  CHECK(decoded);
+  CHECK(checked);
+  CHECK(values[0].valid && values[0].value == 1234567);
+  CHECK(values[1].valid && values[1].value == 0);
+  CHECK(values[2].valid && values[2].value == 12345678);
+}
+
+/**
+  * @brief  Programming mode with selective reads, as MeterLink_ProgByte(): the reader
+  *         feeds the requested code in front of each "(value)" data message
+  */
+static bool ProgrammingSession(SimMeter_t *meter, OBIS_Value_t *values)
+{
+  OBIS_Stream_t stream;
+  IEC62056_Check_t check;
+  IEC62056_Ident_t ident;
+  uint8_t msg[32];
+  uint16_t len;
+  bool complete = false;
+
+  SimMeter_Request(meter, (const uint8_t *)IEC62056_SIGN_ON, sizeof(IEC62056_SIGN_ON) - 1, IEC62056_INITIAL_BAUD);
+  if (!IEC62056_ParseIdent((const char *)meter->out, meter->out_len, &ident))
+  {
+    return false;
+  }
+  IEC62056_BuildAck(msg, ident.baud_id, IEC62056_MODE_PROGRAMMING);
+  SimMeter_Request(meter, msg, IEC62056_ACK_LEN, IEC62056_INITIAL_BAUD);
+
+  /* Operand message "P0" with its BCC */
+  IEC62056_CheckReset(&check);
+  for (uint16_t i = 0; i < meter->out_len; i++)
+  {
+    if (meter->out[i] == IEC62056_NAK)
+    {
+      return false;
+    }
+    if (IEC62056_CheckFeed(&check, meter->out[i]) == IEC62056_CHECK_ERROR)
+    {
+      return false;
+    }
+  }
+
+  OBIS_StreamInit(&stream, session_registers, 3, values, "C.1.0");
+  for (uint8_t step = 0; step < 3 && !complete; step++)
+  {
+    const char *code = session_registers[step].code;
+    char data[16];
+    bool value = false;
+
+    snprintf(data, sizeof(data), "%s()", code);
+    len = IEC62056_BuildCommand(msg, sizeof(msg), "R5", data);
+    SimMeter_Request(meter, msg, len, meter->baud);
+
+    IEC62056_CheckReset(&check);
+    for (uint16_t i = 0; i < meter->out_len; i++)
+    {
+      uint8_t byte = meter->out[i];
+
+      if (byte == IEC62056_NAK || IEC62056_CheckFeed(&check, byte) == IEC62056_CHECK_ERROR)
+      {
+        return false;
+      }
+      if (byte == IEC62056_STX || byte == IEC62056_ETX || IEC62056_CheckOpen(&check) == false)
+      {
+        continue;
+      }
+      if (!value && byte == '(')
+      {
+        value = true;
+        for (const char *p = code; *p != '\0'; p++)
+        {
+          OBIS_StreamFeed(&stream, (uint8_t)*p);
+        }
+      }
+      if (value)
+      {
+        complete = OBIS_StreamFeed(&stream, byte);
+      }
+    }
+  }
+
+  len = IEC62056_BuildCommand(msg, sizeof(msg), IEC62056_CMD_BREAK, NULL);
+  SimMeter_Request(meter, msg, len, meter->baud);
+  return complete;
+}
+
+static void TestProgrammingSession(void)
+{
+  SimMeter_t meter = { .programming = true, .baud = IEC62056_INITIAL_BAUD };
+  SimMeter_t readout_only = { .programming = false, .baud = IEC62056_INITIAL_BAUD };
+  OBIS_Value_t values[3];
+
+  CHECK(ProgrammingSession(&meter, values));
+  CHECK_EQ(meter.mode, IEC62056_MODE_PROGRAMMING);
+  CHECK(values[0].valid && values[0].value == 1234567);
+  CHECK(values[1].valid && values[1].value == 0);
+  CHECK(values[2].valid && values[2].value == 12345678);
+
+  /* A meter without programming mode answers NAK: the reader falls back to a readout */
+  CHECK(!ProgrammingSession(&readout_only, values));
+}
+
+int main(void)
+{
+  TestIdent();
+  TestMessages();
+  TestCheck();
+  TestReadoutSession();
+  TestProgrammingSession();
+  TEST_DONE();
+}
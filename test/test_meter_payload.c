@@ -0,0 +1,340 @@
+/*
+ * test_meter_payload.c
+ * Table-driven TLV encoding (meter_payload.c) against a copy of the encoder it
+ * replaced, which had one hand-written block per register: same bytes for
+ * random and edge-of-range readings. Also checks the packed batch layout, that
+ * reports stay inside the payload budget, and that the compact format gets a
+ * keyframe through at AU915 DR2 (11 bytes) by splitting it across uplinks.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "test_util.h"
+#include "meter_payload.h"
+
+#define ITERATIONS  200000
+
+/**
+  * @brief  Former encoder: fixed ids, ranges and widths per register
+  */
+static uint8_t LegacyEncodeTlv(uint8_t *buffer, const OBIS_Value_t *values)
+{
+  static const uint8_t energy_id[] = { 0x0A, 0x0B, 0x00, 0x3C, 0x3D, 0x3E, 0x3F };
+  uint8_t len = 0;
+
+  for (uint8_t reg = 0; reg <= METER_REG_REACTIVE_GENERATED; reg++)
+  {
+    int32_t value = values[reg].value;
+
+    if (!values[reg].valid)
+    {
+      continue;
+    }
+    if (reg == METER_REG_PEAK_DEMAND)
+    {
+      if (value >= 0 && value < 65535)
+      {
+        uint16_t kw = (uint16_t)(value / 1000);
+        buffer[len++] = 0x28;
+        buffer[len++] = (uint8_t)(kw >> 8);
+        buffer[len++] = (uint8_t)kw;
+      }
+      continue;
+    }
+    if (value >= 0 && value < 10000000)
+    {
+      buffer[len++] = energy_id[reg];
+      buffer[len++] = (uint8_t)(value >> 24);
+      buffer[len++] = (uint8_t)(value >> 16);
+      buffer[len++] = (uint8_t)(value >> 8);
+      buffer[len++] = (uint8_t)value;
+    }
+  }
+
+  if (values[METER_REG_SERIAL].valid && values[METER_REG_SERIAL].value > 0)
+  {
+    uint32_t serial = (uint32_t)values[METER_REG_SERIAL].value;
+    buffer[len++] = 0x5A;
+    buffer[len++] = (uint8_t)(serial >> 24);
+    buffer[len++] = (uint8_t)(serial >> 16);
+    buffer[len++] = (uint8_t)(serial >> 8);
+    buffer[len++] = (uint8_t)serial;
+  }
+  return len;
+}
+
+static void RandomReading(OBIS_Value_t *values)
+{
+  static const int32_t edge[] =
+  {
+    -2147483647, -1, 0, 1, 999, 1000, 65534, 65535, 9999999, 10000000, INT32_MAX
+  };
+
+  for (uint8_t reg = 0; reg < METER_REG_COUNT; reg++)
+  {
+    values[reg].valid = (rand() % 5) != 0;
+    if (rand() % 3)
+    {
+      values[reg].value = edge[rand() % (int)(sizeof(edge) / sizeof(edge[0]))];
+    }
+    else
+    {
+      values[reg].value = (int32_t)((uint32_t)rand() * 2654435761U);
+    }
+  }
+}
+
+static void TestTlvMatchesLegacy(void)
+{
+  OBIS_Value_t values[METER_REG_COUNT];
+  uint8_t table[64];
+  uint8_t legacy[64];
+  int mismatches = 0;
+
+  srand(1);
+  for (int n = 0; n < ITERATIONS && mismatches < 5; n++)
+  {
+    uint8_t reg = 0;
+    uint8_t len;
+    uint8_t legacy_len;
+
+    RandomReading(values);
+    len = MeterPayload_EncodeTlv(table, values, &reg, sizeof(table));
+    legacy_len = LegacyEncodeTlv(legacy, values);
+    if (len != legacy_len || memcmp(table, legacy, len) != 0 || reg != METER_REG_COUNT)
+    {
+      printf("reading %d: table %u bytes, legacy %u bytes\n", n, len, legacy_len);
+      mismatches++;
+    }
+  }
+  CHECK_EQ(mismatches, 0);
+}
+
+static void TestTlvSplit(void)
+{
+  OBIS_Value_t values[METER_REG_COUNT];
+  uint8_t whole[64];
+  uint8_t split[64];
+  uint8_t reg = 0;
+  uint8_t len = 0;
+  uint8_t whole_len;
+
+  for (uint8_t n = 0; n < METER_REG_COUNT; n++)
+  {
+    values[n].valid = true;
+    values[n].value = 1000 + n;
+  }
+  whole_len = MeterPayload_EncodeTlv(whole, values, &reg, sizeof(whole));
+  CHECK_EQ(whole_len, 7 * 5 + 3);
+
+  /* 11 bytes (AU915 DR2): two 4-byte registers per uplink, resumed from reg */
+  reg = 0;
+  while (reg < METER_REG_COUNT)
+  {
+    uint8_t part = MeterPayload_EncodeTlv(&split[len], values, &reg, 11);
+    CHECK(part > 0 && part <= 11);
+    if (part == 0)
+    {
+      break;
+    }
+    len += part;
+  }
+  CHECK_EQ(len, whole_len);
+  CHECK_MEM(split, whole, whole_len);
+}
+
+static void TestPacked(void)
+{
+  OBIS_Value_t values[METER_REG_COUNT] = { 0 };
+  uint8_t buffer[64];
+  static const uint8_t expected[] = { 0x05, 0x00, 0x01, 0xE2, 0x40, 0x00, 0x03 };
+
+  values[METER_REG_ACTIVE_TOTAL].value = 123456;
+  values[METER_REG_ACTIVE_TOTAL].valid = true;
+  values[METER_REG_PEAK_DEMAND].value = 3456;
+  values[METER_REG_PEAK_DEMAND].valid = true;
+  values[METER_REG_SERIAL].value = 0;  /* out of range: not sent */
+  values[METER_REG_SERIAL].valid = true;
+
+  CHECK_EQ(MeterPayload_EncodePacked(buffer, values), sizeof(expected));
+  CHECK_MEM(buffer, expected, sizeof(expected));
+}
+
+static void TestReportBudget(void)
+{
+  uint32_t fields[REPORT_FIELD_COUNT];
+  uint8_t buffer[64];
+  uint16_t all = (uint16_t)((1U << REPORT_FIELD_COUNT) - 1U);
+  uint16_t packed;
+  uint8_t len;
+
+  for (uint8_t n = 0; n < REPORT_FIELD_COUNT; n++)
+  {
+    fields[n] = n;
+  }
+
+  /* Battery and network state lead a report that fits whole */
+  len = MeterPayload_PackReport(buffer, sizeof(buffer), fields, all, &packed);
+  CHECK_EQ(packed, all);
+  CHECK_EQ(len, 2 * 2 + 7 * 5 + 3);
+  CHECK_EQ(buffer[0], 0x02);
+  CHECK_EQ(buffer[2], 0x04);
+  CHECK_EQ(buffer[4], 0x0A);
+
+  /* 11 bytes: active total and consumed, then battery (priority order) */
+  len = MeterPayload_PackReport(buffer, 11, fields, all, &packed);
+  CHECK(len <= 11);
+  CHECK_EQ(packed, (1U << METER_REG_ACTIVE_TOTAL) | (1U << METER_REG_ACTIVE_CONSUMED));
+  CHECK_EQ(len, 10);
+
+  for (uint8_t budget = 0; budget < sizeof(buffer); budget++)
+  {
+    CHECK(MeterPayload_PackReport(buffer, budget, fields, all, &packed) <= budget);
+  }
+}
+
+/**
+  * @brief  Network side of the compact format: keyframe parts merged by id, deltas
+  *         added to the keyframe they name
+  */
+typedef struct
+{
+  uint32_t values[256][METER_REG_COUNT];
+  uint8_t  mask[256];
+} CompactServer_t;
+
+static uint8_t GetVarint(const uint8_t *buffer, uint32_t *value)
+{
+  uint8_t len = 0;
+
+  *value = 0;
+  do
+  {
+    *value |= (uint32_t)(buffer[len] & 0x7FU) << (7U * len);
+  } while ((buffer[len++] & 0x80U) != 0U);
+  return len;
+}
+
+/**
+  * @brief  Decode one TLV 0x08, check the values it carries against the reading
+  * @retval true for a keyframe (part)
+  */
+static bool CompactReceive(CompactServer_t *server, const uint8_t *buffer, uint8_t len, const uint32_t *reading)
+{
+  bool keyframe = (buffer[1] & 0x0FU) == 0U;
+  uint8_t id = buffer[2];
+  uint8_t mask = buffer[3];
+  uint8_t pos = COMPACT_HEADER_SIZE;
+
+  CHECK_EQ(buffer[0], TLV_ID_COMPACT);
+  CHECK_EQ(buffer[1] >> 4, COMPACT_VERSION);
+  for (uint8_t reg = 0; reg < METER_REG_COUNT; reg++)
+  {
+    uint32_t value;
+
+    if ((mask & (1U << reg)) == 0U)
+    {
+      continue;
+    }
+    pos += GetVarint(&buffer[pos], &value);
+    if (keyframe)
+    {
+      server->values[id][reg] = value;
+      server->mask[id] |= (uint8_t)(1U << reg);
+    }
+    else
+    {
+      int32_t delta = (int32_t)(value >> 1) ^ -(int32_t)(value & 1U);
+      CHECK(server->mask[id] & (1U << reg));
+      value = server->values[id][reg] + (uint32_t)delta;
+    }
+    CHECK_EQ(value, reading[reg]);
+  }
+  CHECK_EQ(pos, len);
+  return keyframe;
+}
+
+static void TestCompactSplitKeyframe(void)
+{
+  static CompactServer_t server;
+  MeterCompact_t compact = { 0 };
+  OBIS_Value_t values[METER_REG_COUNT];
+  uint32_t reading[METER_REG_COUNT];
+  uint8_t buffer[64];
+  int keyframe_parts = 0;
+  int uplink;
+
+  for (uint8_t reg = 0; reg < METER_REG_COUNT; reg++)
+  {
+    values[reg].valid = true;
+    values[reg].value = 5000000 + 1000 * reg;
+  }
+  values[METER_REG_PEAK_DEMAND].value = 3456;
+  values[METER_REG_SERIAL].value = INT32_MAX;  /* 5-byte varint */
+
+  /* 11 bytes: a whole keyframe (37 bytes here) never fits, parts until every register is acknowledged */
+  for (uplink = 0; uplink < 40; uplink++)
+  {
+    uint8_t len;
+
+    values[METER_REG_ACTIVE_TOTAL].value += 7;
+    values[METER_REG_ACTIVE_CONSUMED].value += 5;
+    for (uint8_t reg = 0; reg < METER_REG_COUNT; reg++)
+    {
+      CHECK(MeterPayload_GetEncoded(values, reg, &reading[reg]));
+    }
+    len = MeterPayload_EncodeCompact(&compact, buffer, values, 11);
+    CHECK(len > 0 && len <= 11);
+    if (len == 0)
+    {
+      break;
+    }
+    if (!CompactReceive(&server, buffer, len, reading))
+    {
+      CHECK_EQ(compact.sending, 0);
+      break;
+    }
+    keyframe_parts++;
+    CHECK(compact.sending != 0);
+    /* Every other part gets no ACK: its registers are sent again */
+    MeterPayload_CompactSent(&compact, (uplink % 2) == 1);
+  }
+  CHECK(keyframe_parts > 1 && keyframe_parts < 20);
+  CHECK_EQ(compact.reference.mask, (1U << METER_REG_COUNT) - 1U);
+  CHECK_EQ(server.mask[compact.reference.id], (1U << METER_REG_COUNT) - 1U);
+
+  /* Deltas are small: every changed register fits, up to the next keyframe */
+  for (uint8_t n = 1; n < COMPACT_KEYFRAME_INTERVAL; n++)
+  {
+    uint8_t len;
+
+    values[METER_REG_ACTIVE_TOTAL].value += 7;
+    values[METER_REG_ACTIVE_CONSUMED].value += 5;
+    for (uint8_t reg = 0; reg < METER_REG_COUNT; reg++)
+    {
+      MeterPayload_GetEncoded(values, reg, &reading[reg]);
+    }
+    len = MeterPayload_EncodeCompact(&compact, buffer, values, 11);
+    CHECK(len > COMPACT_HEADER_SIZE && len <= 11);
+    CHECK(!CompactReceive(&server, buffer, len, reading));
+    CHECK_EQ(buffer[3], (1U << METER_REG_ACTIVE_TOTAL) | (1U << METER_REG_ACTIVE_CONSUMED));
+    MeterPayload_CompactSent(&compact, false);
+  }
+  CHECK(CompactReceive(&server, buffer, MeterPayload_EncodeCompact(&compact, buffer, values, 11), reading));
+  CHECK_EQ(buffer[2], (uint8_t)(compact.reference.id + 1U));
+
+  /* Less than a header and one register: nothing is written */
+  CHECK_EQ(MeterPayload_EncodeCompact(&compact, buffer, values, COMPACT_HEADER_SIZE), 0);
+  CHECK_EQ(compact.sending, 0);
+}
+
+int main(void)
+{
+  TestTlvMatchesLegacy();
+  TestTlvSplit();
+  TestPacked();
+  TestReportBudget();
+  TestCompactSplitKeyframe();
+  TEST_DONE();
+}
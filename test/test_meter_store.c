@@ -0,0 +1,187 @@
+/*
+ * test_meter_store.c
+ * Outage simulation of the unsent readings ring (meter_store.c) on a RAM copy
+ * of its flash area (same base, pages and page size as lora_app.c): readings
+ * of an N-interval outage are all delivered in order after the link comes
+ * back, across resets in the middle of the outage and of the drain, and the
+ * pages wear evenly. A longer outage loses only its oldest readings.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "test_util.h"
+#include "meter_store.h"
+
+#define FLASH_PAGE_SIZE   2048U
+#define STORE_PAGES       8U
+#define STORE_BASE        0x0803A000UL
+#define OUTAGES           20
+
+static uint8_t flash[STORE_PAGES * FLASH_PAGE_SIZE];
+static uint32_t page_erases[STORE_PAGES];
+static uint32_t program_errors = 0;
+
+static bool SimRead(uint32_t address, void *data, uint32_t size)
+{
+  memcpy(data, &flash[address - STORE_BASE], size);
+  return true;
+}
+
+/* Like the STM32WL: 8-byte units, only on erased memory */
+static bool SimProgram(uint32_t address, const void *data, uint32_t size)
+{
+  uint32_t offset = address - STORE_BASE;
+
+  if ((offset % 8U) != 0U || (size % 8U) != 0U)
+  {
+    program_errors++;
+    return false;
+  }
+  for (uint32_t i = 0; i < size; i++)
+  {
+    if (flash[offset + i] != 0xFFU)
+    {
+      program_errors++;
+      return false;
+    }
+  }
+  memcpy(&flash[offset], data, size);
+  return true;
+}
+
+static bool SimErase(uint32_t page_address)
+{
+  uint32_t offset = page_address - STORE_BASE;
+
+  if ((offset % FLASH_PAGE_SIZE) != 0U)
+  {
+    return false;
+  }
+  memset(&flash[offset], 0xFF, FLASH_PAGE_SIZE);
+  page_erases[offset / FLASH_PAGE_SIZE]++;
+  return true;
+}
+
+static const MeterStore_Flash_t sim_flash =
+{
+  .read = SimRead,
+  .program = SimProgram,
+  .erase = SimErase,
+};
+
+/* Reading of interval n: register r holds n * 8 + r, register 3 missing */
+static void MakeReading(uint32_t n, OBIS_Value_t *values)
+{
+  for (uint8_t reg = 0; reg < METER_STORE_VALUES; reg++)
+  {
+    values[reg].value = (int32_t)(n * 8U + reg);
+    values[reg].valid = (reg != 3U);
+  }
+}
+
+/**
+  * @brief  Store `count` readings from interval `first`, with a reset halfway
+  */
+static void Outage(MeterStore_t *store, uint32_t first, uint16_t count)
+{
+  OBIS_Value_t values[METER_STORE_VALUES];
+
+  for (uint16_t i = 0; i < count; i++)
+  {
+    MakeReading(first + i, values);
+    CHECK(MeterStore_Push(store, 1000U + first + i, values, METER_STORE_VALUES));
+    if (i == count / 2U)
+    {
+      MeterStore_Init(store, &sim_flash, STORE_BASE, STORE_PAGES, FLASH_PAGE_SIZE);
+    }
+  }
+}
+
+/**
+  * @brief  Send everything pending, with a reset a third of the way
+  * @retval number of readings delivered; they must be consecutive intervals
+  *         ending at `last`
+  */
+static uint16_t Drain(MeterStore_t *store, uint32_t last)
+{
+  MeterStore_Record_t record;
+  uint16_t slot;
+  uint16_t delivered = 0;
+  uint16_t pending = MeterStore_Pending(store);
+  uint32_t first = 0;
+
+  while (MeterStore_Peek(store, &record, &slot))
+  {
+    uint32_t n = record.timestamp - 1000U;
+
+    if (delivered == 0U)
+    {
+      first = n;
+    }
+    CHECK_EQ(n, first + delivered);
+    CHECK_EQ(record.values[5], n * 8U + 5U);
+    CHECK_EQ(record.valid_mask, 0xF7);
+    CHECK(MeterStore_MarkSent(store, slot));
+    if (++delivered == pending / 3U)
+    {
+      MeterStore_Init(store, &sim_flash, STORE_BASE, STORE_PAGES, FLASH_PAGE_SIZE);
+    }
+    if (delivered > pending)
+    {
+      break;
+    }
+  }
+  CHECK_EQ(first + delivered - 1U, last);
+  CHECK_EQ(MeterStore_Pending(store), 0);
+  return delivered;
+}
+
+int main(void)
+{
+  MeterStore_t store;
+  uint32_t interval = 0;
+  uint16_t capacity;
+  uint16_t outage;
+  uint32_t min_erases = UINT32_MAX;
+  uint32_t max_erases = 0;
+
+  memset(flash, 0xFF, sizeof(flash));
+  MeterStore_Init(&store, &sim_flash, STORE_BASE, STORE_PAGES, FLASH_PAGE_SIZE);
+  capacity = MeterStore_Capacity(&store);
+  /* The page the ring wraps onto is erased before writing, so one page less is kept for sure */
+  outage = (uint16_t)(capacity - capacity / STORE_PAGES);
+  printf("capacity %u readings, outage of %u intervals\n", capacity, outage);
+
+  for (int n = 0; n < OUTAGES; n++)
+  {
+    Outage(&store, interval, outage);
+    interval += outage;
+    CHECK_EQ(MeterStore_Pending(&store), outage);
+    CHECK_EQ(Drain(&store, interval - 1U), outage);
+    CHECK_EQ(store.dropped, 0);
+  }
+  CHECK_EQ(program_errors, 0);
+
+  for (uint8_t page = 0; page < STORE_PAGES; page++)
+  {
+    min_erases = (page_erases[page] < min_erases) ? page_erases[page] : min_erases;
+    max_erases = (page_erases[page] > max_erases) ? page_erases[page] : max_erases;
+  }
+  printf("page erases: %u..%u\n", (unsigned int)min_erases, (unsigned int)max_erases);
+  CHECK(max_erases > 0U && max_erases - min_erases <= 1U);
+
+  /* Longer than the ring: the oldest readings make room for the newest */
+  MeterStore_Init(&store, &sim_flash, STORE_BASE, STORE_PAGES, FLASH_PAGE_SIZE);
+  Outage(&store, interval, (uint16_t)(capacity + 40U));
+  interval += capacity + 40U;
+  {
+    uint32_t dropped = store.dropped;
+    uint16_t delivered = Drain(&store, interval - 1U);
+
+    CHECK(delivered >= outage);
+    CHECK(dropped > 0U);
+  }
+  CHECK_EQ(program_errors, 0);
+
+  TEST_DONE();
+}
@@ -0,0 +1,194 @@
+/*
+ * test_obis_fixed.c
+ * Fixed-point value decoding (obis_stream.c, scaled and range-checked by
+ * meter_payload.c) against the float path it replaced: ParseOBISFloat() kept
+ * the chars [0-9.+-], (float)atof() converted them and the uplink sent
+ * (uint32_t)value (energy, < 10000000) or (uint16_t)value (1.6.0, < 65.535).
+ * Both must send the same value, or both nothing, for every input except the
+ * intended differences listed in `differences` and the float rounding at the
+ * top of the energy range, where the float lost the decimals (9999999.99 was
+ * 10000000 and was not sent).
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "test_util.h"
+#include "obis_stream.h"
+#include "meter_payload.h"
+
+/* No value sent */
+#define NOT_SENT  (-1LL)
+
+/**
+  * @brief  Former path: ParseOBISFloat() then the range check and cast of SendTxData()
+  */
+static long long LegacySent(uint8_t reg, const char *text)
+{
+  char temp[32];
+  size_t len = 0;
+  float value;
+
+  while (text[len] != '\0' && ((text[len] >= '0' && text[len] <= '9') || text[len] == '.' ||
+                               text[len] == '-' || text[len] == '+'))
+  {
+    len++;
+  }
+  if (len == 0U)
+  {
+    return NOT_SENT;
+  }
+  if (len >= sizeof(temp))
+  {
+    len = sizeof(temp) - 1U;
+  }
+  memcpy(temp, text, len);
+  temp[len] = '\0';
+  value = (float)atof(temp);
+
+  if (reg == METER_REG_PEAK_DEMAND)
+  {
+    return (value >= 0.0f && value < 65.535f) ? (long long)(uint16_t)value : NOT_SENT;
+  }
+  return (value >= 0.0f && value < 10000000.0f) ? (long long)(uint32_t)value : NOT_SENT;
+}
+
+/**
+  * @brief  Current path: "1-0:<code>(<text>*kWh)" through the decoder, then the TLV value
+  */
+static long long FixedSent(uint8_t reg, const char *text)
+{
+  OBIS_Stream_t stream;
+  OBIS_Value_t values[METER_REG_COUNT];
+  char line[96];
+  uint32_t encoded;
+
+  snprintf(line, sizeof(line), "1-0:%s(%s*kWh)\r\n", meter_registers[reg].code, text);
+  OBIS_StreamInit(&stream, meter_registers, METER_REG_COUNT, values, NULL);
+  for (size_t i = 0; line[i] != '\0'; i++)
+  {
+    OBIS_StreamFeed(&stream, (uint8_t)line[i]);
+  }
+  return MeterPayload_GetEncoded(values, reg, &encoded) ? (long long)encoded : NOT_SENT;
+}
+
+/* Registers that went through ParseOBISFloat (C.1.0 was an integer parse) */
+static const uint8_t float_registers[] =
+{
+  METER_REG_ACTIVE_TOTAL, METER_REG_REACTIVE_TOTAL, METER_REG_PEAK_DEMAND, METER_REG_ACTIVE_CONSUMED,
+  METER_REG_ACTIVE_GENERATED, METER_REG_REACTIVE_CONSUMED, METER_REG_REACTIVE_GENERATED,
+};
+
+/* Inputs where both paths must agree */
+static const char *const same[] =
+{
+  /* typical and fractional */
+  "0", "00000000", "0000123", "12345", "0012345.678", "123.999", "0.001", "9999999", "9999999.49",
+  "1234567.875", "3.456", "65.534", "65.5349", "65.535", "65.999", "1.0", "7.", ".5",
+  /* signed */
+  "+12.5", "+0", "-0", "-0.0", "-1", "-5.5", "-1234567", "-65.534",
+  /* overflowing */
+  "10000000", "10000000.5", "16777217", "2147483647", "2147483648", "4294967295", "4294967296",
+  "99999999999", "123456789012345678901234567890",
+  /* too many decimals */
+  "123.456789012345", "1.23456789", "65.5340000001", "0.0000000001", "42.999",
+  /* not a plain number */
+  "1.2.3", "12-3", "1e3", "0x10", " 12", "12 ", "1,5", "12*kWh",
+};
+
+/**
+  * @brief Intended differences: input, register, value sent by atof and by the fixed point path
+  */
+typedef struct
+{
+  const char *text;
+  uint8_t     reg;
+  long long   legacy;
+  long long   fixed;
+} Difference_t;
+
+static const Difference_t differences[] =
+{
+  /* Float rounding: 9999999.99 became 10000000 and was dropped as out of range; truncated it is 9999999 */
+  { "9999999.99",  METER_REG_ACTIVE_TOTAL, NOT_SENT, 9999999 },
+  { "9999999.999", METER_REG_ACTIVE_CONSUMED, NOT_SENT, 9999999 },
+  /* Same for 1.6.0 just below 65.535 kW: it rounded to 65.535f, over the limit */
+  { "65.5349999",  METER_REG_PEAK_DEMAND, NOT_SENT, 65 },
+  /* and any value whose decimals a float cannot hold */
+  { "42.9999999",  METER_REG_REACTIVE_CONSUMED, 43, 42 },
+  /* A negative value that truncates to 0 is sent as 0 (float kept the sign) */
+  { "-0.5",        METER_REG_ACTIVE_TOTAL, NOT_SENT, 0 },
+  { "-0.0004",     METER_REG_PEAK_DEMAND, NOT_SENT, 0 },
+  /* No digit is not a reading (atof gave 0) */
+  { ".",           METER_REG_ACTIVE_TOTAL, 0, NOT_SENT },
+  { "+",           METER_REG_REACTIVE_TOTAL, 0, NOT_SENT },
+  { "-",           METER_REG_PEAK_DEMAND, 0, NOT_SENT },
+  { "+-1",         METER_REG_ACTIVE_GENERATED, 0, NOT_SENT },
+  { "-+1",         METER_REG_REACTIVE_GENERATED, 0, NOT_SENT },
+};
+
+int main(void)
+{
+  int compared = 0;
+  int rounded = 0;
+
+  for (size_t n = 0; n < sizeof(same) / sizeof(same[0]); n++)
+  {
+    for (size_t r = 0; r < sizeof(float_registers); r++)
+    {
+      long long legacy = LegacySent(float_registers[r], same[n]);
+      long long fixed = FixedSent(float_registers[r], same[n]);
+
+      if (legacy != fixed)
+      {
+        printf("\"%s\" %s: atof %lld, fixed %lld\n", same[n], meter_registers[float_registers[r]].code, legacy, fixed);
+      }
+      CHECK_EQ(fixed, legacy);
+      compared++;
+    }
+  }
+
+  /* Two-decimal energy values where a float still resolves 0.01: identical */
+  for (uint32_t n = 0; n < 65536U; n++)
+  {
+    char text[16];
+
+    snprintf(text, sizeof(text), "%u.%02u", (unsigned int)n, (unsigned int)(n % 100U));
+    CHECK_EQ(FixedSent(METER_REG_ACTIVE_TOTAL, text), LegacySent(METER_REG_ACTIVE_TOTAL, text));
+    compared++;
+  }
+  /* Top of the range: a float rounds N.5 and above up (9999999.99 to 10000000, out of range),
+     the fixed point path truncates to N */
+  for (uint32_t n = 9990000U; n < 10000000U; n++)
+  {
+    char text[16];
+    long long legacy;
+
+    snprintf(text, sizeof(text), "%u.%02u", (unsigned int)n, (unsigned int)(n % 100U));
+    legacy = LegacySent(METER_REG_ACTIVE_TOTAL, text);
+    CHECK_EQ(FixedSent(METER_REG_ACTIVE_TOTAL, text), n);
+    CHECK(legacy == n || (n % 100U >= 50U && (legacy == n + 1U || (legacy == NOT_SENT && n == 9999999U))));
+    rounded += (legacy != n);
+  }
+  for (uint32_t w = 0; w < 65535U; w++)
+  {
+    char text[16];
+
+    snprintf(text, sizeof(text), "%u.%03u", (unsigned int)(w / 1000U), (unsigned int)(w % 1000U));
+    CHECK_EQ(FixedSent(METER_REG_PEAK_DEMAND, text), LegacySent(METER_REG_PEAK_DEMAND, text));
+    compared++;
+  }
+
+  for (size_t n = 0; n < sizeof(differences) / sizeof(differences[0]); n++)
+  {
+    CHECK_EQ(LegacySent(differences[n].reg, differences[n].text), differences[n].legacy);
+    CHECK_EQ(FixedSent(differences[n].reg, differences[n].text), differences[n].fixed);
+  }
+  /* The float itself: 9999999.99 is 10000000 in single precision */
+  CHECK((float)atof("9999999.99") == 10000000.0f);
+
+  printf("%d inputs identical to (uint32_t)atof(), %u intended differences,\n"
+         "%d top of range values rounded up by the float and truncated now\n", compared,
+         (unsigned int)(sizeof(differences) / sizeof(differences[0])), rounded);
+  TEST_DONE();
+}
@@ -0,0 +1,69 @@
+/*
+ * test_util.h
+ * Minimal check macros of the host tests: every failed check is printed and
+ * counted, TEST_DONE() turns the count into the exit status seen by ctest.
+ */
+#ifndef __TEST_UTIL_H__
+#define __TEST_UTIL_H__
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+static int test_failures = 0;
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      test_failures++; \
+    } \
+  } while (0)
+
+#define CHECK_EQ(a, b) \
+  do { \
+    long long a_ = (long long)(a), b_ = (long long)(b); \
+    if (a_ != b_) { \
+      printf("%s:%d: %s == %s failed (%lld != %lld)\n", __FILE__, __LINE__, #a, #b, a_, b_); \
+      test_failures++; \
+    } \
+  } while (0)
+
+#define CHECK_MEM(a, b, len) \
+  do { \
+    if (memcmp((a), (b), (len)) != 0) { \
+      printf("%s:%d: %s and %s differ\n", __FILE__, __LINE__, #a, #b); \
+      test_failures++; \
+    } \
+  } while (0)
+
+/**
+  * @brief  Read a whole file (frames of the corpus in test/frames)
+  * @retval number of bytes read, 0 if missing or larger than size
+  */
+static inline size_t ReadFile(const char *path, uint8_t *buf, size_t size)
+{
+  FILE *f = fopen(path, "rb");
+  size_t len;
+
+  if (f == NULL)
+  {
+    printf("cannot open %s\n", path);
+    return 0;
+  }
+  len = fread(buf, 1, size, f);
+  if (!feof(f) && fgetc(f) != EOF)
+  {
+    len = 0;
+  }
+  fclose(f);
+  return len;
+}
+
+#define TEST_DONE() \
+  do { \
+    printf("%s: %s (%d failed checks)\n", __FILE__, test_failures ? "FAIL" : "OK", test_failures); \
+    return test_failures ? 1 : 0; \
+  } while (0)
+
+#endif /* __TEST_UTIL_H__ */